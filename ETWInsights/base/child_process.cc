@@ -38,18 +38,36 @@ _Pre_satisfies_(!(this->hProcess_)) bool ChildProcess::Run(
     const std::wstring& command) {
   DCHECK(!hProcess_);
 
-  if (output_path_.empty())
+  if (output_path_.empty() && !use_output_pipe_)
     return false;
 
   SECURITY_ATTRIBUTES security = {sizeof(security), 0, TRUE};
 
-  hStdOutput_ =
-      CreateFile(output_path_.c_str(), GENERIC_WRITE, 0, &security,
-                 CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, INVALID_HANDLE_VALUE);
+  if (use_output_pipe_) {
+    // Only the write end of the pipe is inherited by the child.
+    if (!CreatePipe(&hOutputRead_, &hStdOutput_, &security,
+                    static_cast<DWORD>(pipe_buffer_size_))) {
+      hOutputRead_ = INVALID_HANDLE_VALUE;
+      hStdOutput_ = INVALID_HANDLE_VALUE;
+      return false;
+    }
+    if (!SetHandleInformation(hOutputRead_, HANDLE_FLAG_INHERIT, 0))
+      return false;
+  } else {
+    hStdOutput_ =
+        CreateFile(output_path_.c_str(), GENERIC_WRITE, 0, &security,
+                   CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, INVALID_HANDLE_VALUE);
+  }
 
   if (hStdOutput_ == INVALID_HANDLE_VALUE)
     return false;
-  if (!DuplicateHandle(GetCurrentProcess(), hStdOutput_, GetCurrentProcess(),
+  // The error output of the child goes to the output file, or to our own
+  // error output when the output is read through a pipe, so that it isn't
+  // mixed with the output that is parsed.
+  HANDLE hError = use_output_pipe_ ? GetStdHandle(STD_ERROR_HANDLE)
+                                   : hStdOutput_;
+  if (hError != NULL && hError != INVALID_HANDLE_VALUE &&
+      !DuplicateHandle(GetCurrentProcess(), hError, GetCurrentProcess(),
                        &hStdError_, 0, TRUE, DUPLICATE_SAME_ACCESS)) {
     return false;
   }
@@ -75,6 +93,10 @@ _Pre_satisfies_(!(this->hProcess_)) bool ChildProcess::Run(
   if (success) {
     CloseHandle(processInfo.hThread);
     hProcess_ = processInfo.hProcess;
+    // Close our copies of the write end of the pipe, so that ReadOutput()
+    // sees the end of the output when the child exits.
+    if (use_output_pipe_)
+      CloseStdHandles();
     return true;
   } else {
     LOG(ERROR) << "Error starting " << base::WStringToString(command) << ": "
@@ -94,12 +116,40 @@ DWORD ChildProcess::GetExitCode() {
   return result;
 }
 
+bool ChildProcess::ReadOutput(char* buffer, size_t size, size_t* bytes_read) {
+  DCHECK(use_output_pipe_);
+  *bytes_read = 0;
+  if (hOutputRead_ == INVALID_HANDLE_VALUE)
+    return false;
+
+  // ReadFile fails with ERROR_BROKEN_PIPE when the child closes its output.
+  DWORD num_bytes = 0;
+  if (!ReadFile(hOutputRead_, buffer, static_cast<DWORD>(size), &num_bytes,
+                NULL) ||
+      num_bytes == 0) {
+    return false;
+  }
+  *bytes_read = num_bytes;
+  return true;
+}
+
 void ChildProcess::WaitForCompletion() {
+  // Close the read end of the output pipe first, so that a child that is
+  // blocked on a full pipe can exit.
+  if (hOutputRead_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(hOutputRead_);
+    hOutputRead_ = INVALID_HANDLE_VALUE;
+  }
+
   if (hProcess_) {
     // Wait for the process to finish.
     WaitForSingleObject(hProcess_, INFINITE);
   }
 
+  CloseStdHandles();
+}
+
+void ChildProcess::CloseStdHandles() {
   // Close the stderr/stdout/stdin handles.
   if (hStdError_ != INVALID_HANDLE_VALUE) {
     CloseHandle(hStdError_);
@@ -34,6 +34,11 @@ namespace base {
 //   child.WaitForCompletion();
 // Run returns immediately. The destructor, GetExitCode(), and
 // WaitForCompletion() will all wait for the process to exit.
+//
+// The output can also be read through a pipe while the process runs:
+//   child.SetOutputPipe(1024 * 1024);
+//   child.Run(L"exename.exe -arg value");
+//   while (child.ReadOutput(buffer, sizeof(buffer), &bytes_read)) ...
 
 class ChildProcess {
  public:
@@ -46,6 +51,22 @@ class ChildProcess {
     output_path_ = output_path;
   }
 
+  // Sends the output to a pipe, read with ReadOutput(). The process blocks
+  // when it gets |buffer_size| bytes ahead of the reader. The error output of
+  // the process isn't sent to the pipe.
+  void SetOutputPipe(size_t buffer_size) {
+    use_output_pipe_ = true;
+    pipe_buffer_size_ = buffer_size;
+  }
+
+  // Reads the output of the process, when it is sent to a pipe. Blocks until
+  // some output is available.
+  // @param buffer buffer that receives the output.
+  // @param size size of |buffer|.
+  // @param bytes_read number of bytes read, output.
+  // @returns false when the process has closed its output, or on error.
+  bool ReadOutput(char* buffer, size_t size, size_t* bytes_read);
+
   // Returns true if the process started. This function returns
   // immediately without waiting for process completion.
   _Pre_satisfies_(!(this->hProcess_)) bool Run(const std::wstring& command);
@@ -60,6 +81,9 @@ class ChildProcess {
   void WaitForCompletion();
 
  private:
+  // Closes the stderr/stdout/stdin handles given to the child.
+  void CloseStdHandles();
+
   // Process, thread, and event handles have an uninitialized state of zero.
   // Files have an uninitialized state of INVALID_HANDLE_VALUE. Yay Windows!
   HANDLE hProcess_ = 0;
@@ -69,9 +93,16 @@ class ChildProcess {
   HANDLE hStdError_ = INVALID_HANDLE_VALUE;
   HANDLE hStdInput_ = INVALID_HANDLE_VALUE;
 
+  // Read end of the output pipe.
+  HANDLE hOutputRead_ = INVALID_HANDLE_VALUE;
+
   // Output path.
   std::wstring output_path_;
 
+  // Output pipe settings.
+  bool use_output_pipe_ = false;
+  size_t pipe_buffer_size_ = 0;
+
   DISALLOW_COPY_AND_ASSIGN(ChildProcess);
 };
 
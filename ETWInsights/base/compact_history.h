@@ -0,0 +1,351 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/types.h"
+
+namespace base {
+
+// An History that associates values to time ranges, like base::History, but
+// stores its timestamps compactly. Elements are grouped in blocks of
+// |kBlockSize| elements. Each block stores the absolute timestamp of its
+// first element, and the timestamps of the other elements are stored as
+// variable-length deltas from the previous element, which usually fit in 1
+// or 2 bytes instead of 8. Finding the value at a timestamp is a binary search
+// over the first timestamps of the blocks followed by a short decode in a
+// block. Elements can only be iterated forward.
+template <typename T, size_t kBlockSize = 128>
+class CompactHistory {
+ public:
+  static_assert(kBlockSize > 0, "Blocks can't be empty.");
+
+  // An element of the history, decoded.
+  struct Element {
+    Element(const base::Timestamp& start_ts, const T& value)
+        : start_ts(start_ts), value(value) {}
+
+    // Time at which the element starts.
+    base::Timestamp start_ts;
+
+    // Value of the element.
+    T value;
+  };
+
+  // Iterates forward over the elements of the history, decoding their
+  // timestamps.
+  class HistoryConstIterator {
+   public:
+    HistoryConstIterator(const CompactHistory* history, size_t index);
+
+    const Element& operator*() const { return element_; }
+    const Element* operator->() const { return &element_; }
+
+    HistoryConstIterator& operator++();
+    HistoryConstIterator operator+(size_t count) const;
+
+    bool operator==(const HistoryConstIterator& other) const {
+      return index_ == other.index_;
+    }
+    bool operator!=(const HistoryConstIterator& other) const {
+      return index_ != other.index_;
+    }
+
+   private:
+    // Decodes the element at |index_|, given that |element_| and |offset_|
+    // describe the previous element.
+    void Decode();
+
+    const CompactHistory* history_;
+
+    // Index of the element.
+    size_t index_;
+
+    // Offset of the delta of the next element in |history_->deltas_|.
+    size_t offset_;
+
+    // The element, decoded. Only valid if |index_| is smaller than the size
+    // of the history.
+    Element element_;
+  };
+
+  CompactHistory() : last_ts_(0) {}
+
+  // Inserts a new value at the end of the history.
+  // @param ts start timestamp for the inserted value.
+  // @param value the value to insert.
+  // @returns true if the value is inserted successfully. Returns false if |ts|
+  //    is earlier than the timestamp of the last inserted value.
+  bool Insert(const base::Timestamp& start_ts, const T& value);
+
+  // Gets the value for the specified timestamp.
+  // @param ts timestamp for which to obtain the value.
+  // @param value value for the specified timestamp.
+  // @returns true if there is a value at the specified timestamp, false
+  //    otherwise.
+  bool GetValue(const base::Timestamp& ts, const T** value) const;
+
+  // Gets the value of the last inserted element.
+  // @param value the last value, output.
+  // @returns true if there is at least one element in the history, false
+  //    otherwise.
+  bool GetLastElementValue(T* value) const;
+
+  // Gets the timestamp of the last inserted element.
+  // @param ts the last timestamp, output.
+  // @returns true if there is at least one element in the history, false
+  //    otherwise.
+  bool GetLastElementTimestamp(base::Timestamp* ts) const;
+
+  // Returns an iterator to the first element of the history that ends after the
+  // specified timestamp.
+  // @param ts timestamp at which the iteration starts.
+  // @returns an iterator to the first value of the history that ends after the
+  //    specified timestamp.
+  HistoryConstIterator IteratorFromTimestamp(const base::Timestamp& ts) const;
+
+  // @returns an iterator to the beginning of the history.
+  HistoryConstIterator IteratorBegin() const {
+    return HistoryConstIterator(this, 0);
+  }
+
+  // @returns an iterator to the end of the history.
+  HistoryConstIterator IteratorEnd() const {
+    return HistoryConstIterator(this, size());
+  }
+
+  // @returns the number of elements in the history.
+  size_t size() const { return values_.size(); }
+
+  // @returns the number of bytes used by the elements of the history.
+  size_t memory_usage() const {
+    return blocks_.capacity() * sizeof(Block) + deltas_.capacity() +
+           values_.capacity() * sizeof(T);
+  }
+
+ private:
+  // A block of |kBlockSize| elements, except for the last block.
+  struct Block {
+    // Timestamp of the first element of the block.
+    base::Timestamp start_ts;
+
+    // Offset in |deltas_| of the delta of the second element of the block.
+    size_t deltas_offset;
+  };
+
+  // Finds the last element of a block that starts at or before |ts|.
+  // @param block_index index of a block whose first element starts at or
+  //    before |ts|.
+  // @param ts a timestamp.
+  // @returns the index of the element.
+  size_t FindInBlock(size_t block_index, const base::Timestamp& ts) const;
+
+  // Appends a delta to |deltas_|, 7 bits per byte, least significant bits
+  // first. The high bit of a byte is set if more bytes follow.
+  void AppendDelta(base::Timestamp delta);
+
+  // Reads a delta from |deltas_|.
+  // @param offset offset of the delta, incremented past the delta.
+  // @returns the delta.
+  base::Timestamp ReadDelta(size_t* offset) const;
+
+  // Blocks of elements, sorted by start timestamp.
+  std::vector<Block> blocks_;
+
+  // Deltas between the timestamps of consecutive elements of a block.
+  std::vector<uint8_t> deltas_;
+
+  // Values of the elements.
+  std::vector<T> values_;
+
+  // Timestamp of the last element.
+  base::Timestamp last_ts_;
+};
+
+template <typename T, size_t kBlockSize>
+CompactHistory<T, kBlockSize>::HistoryConstIterator::HistoryConstIterator(
+    const CompactHistory* history,
+    size_t index)
+    : history_(history), index_(index), offset_(0), element_(0, T()) {
+  if (index_ >= history_->size())
+    return;
+
+  // Decode the elements of the block that precede |index|.
+  size_t block_index = index_ / kBlockSize;
+  size_t target = index_;
+  index_ = block_index * kBlockSize;
+  Decode();
+  while (index_ != target) {
+    ++index_;
+    Decode();
+  }
+}
+
+template <typename T, size_t kBlockSize>
+typename CompactHistory<T, kBlockSize>::HistoryConstIterator&
+CompactHistory<T, kBlockSize>::HistoryConstIterator::operator++() {
+  DCHECK_LT(index_, history_->size());
+  ++index_;
+  if (index_ < history_->size())
+    Decode();
+  return *this;
+}
+
+template <typename T, size_t kBlockSize>
+typename CompactHistory<T, kBlockSize>::HistoryConstIterator
+CompactHistory<T, kBlockSize>::HistoryConstIterator::operator+(
+    size_t count) const {
+  HistoryConstIterator it(*this);
+  for (size_t i = 0; i < count && it.index_ < history_->size(); ++i)
+    ++it;
+  return it;
+}
+
+template <typename T, size_t kBlockSize>
+void CompactHistory<T, kBlockSize>::HistoryConstIterator::Decode() {
+  if (index_ % kBlockSize == 0) {
+    const Block& block = history_->blocks_[index_ / kBlockSize];
+    element_.start_ts = block.start_ts;
+    offset_ = block.deltas_offset;
+  } else {
+    element_.start_ts += history_->ReadDelta(&offset_);
+  }
+  element_.value = history_->values_[index_];
+}
+
+template <typename T, size_t kBlockSize>
+bool CompactHistory<T, kBlockSize>::Insert(const base::Timestamp& start_ts,
+                                           const T& value) {
+  if (!values_.empty()) {
+    if (last_ts_ >= start_ts)
+      return false;
+    if (values_.back() == value)
+      return true;
+  }
+
+  if (values_.size() % kBlockSize == 0)
+    blocks_.push_back({start_ts, deltas_.size()});
+  else
+    AppendDelta(start_ts - last_ts_);
+  values_.push_back(value);
+  last_ts_ = start_ts;
+  return true;
+}
+
+template <typename T, size_t kBlockSize>
+bool CompactHistory<T, kBlockSize>::GetValue(const base::Timestamp& ts,
+                                             const T** value) const {
+  DCHECK(value != nullptr);
+  auto block_it = std::upper_bound(
+      blocks_.begin(), blocks_.end(), ts,
+      [](const base::Timestamp& ts, const Block& block) {
+        return ts < block.start_ts;
+      });
+  if (block_it == blocks_.begin())
+    return false;
+
+  *value = &values_[FindInBlock(block_it - blocks_.begin() - 1, ts)];
+  return true;
+}
+
+template <typename T, size_t kBlockSize>
+bool CompactHistory<T, kBlockSize>::GetLastElementValue(T* value) const {
+  DCHECK(value != nullptr);
+  if (values_.empty())
+    return false;
+
+  *value = values_.back();
+  return true;
+}
+
+template <typename T, size_t kBlockSize>
+bool CompactHistory<T, kBlockSize>::GetLastElementTimestamp(
+    base::Timestamp* ts) const {
+  DCHECK(ts != nullptr);
+  if (values_.empty())
+    return false;
+
+  *ts = last_ts_;
+  return true;
+}
+
+template <typename T, size_t kBlockSize>
+typename CompactHistory<T, kBlockSize>::HistoryConstIterator
+CompactHistory<T, kBlockSize>::IteratorFromTimestamp(
+    const base::Timestamp& ts) const {
+  auto block_it = std::upper_bound(
+      blocks_.begin(), blocks_.end(), ts,
+      [](const base::Timestamp& ts, const Block& block) {
+        return ts < block.start_ts;
+      });
+  if (block_it == blocks_.begin())
+    return IteratorBegin();
+
+  return HistoryConstIterator(
+      this, FindInBlock(block_it - blocks_.begin() - 1, ts));
+}
+
+template <typename T, size_t kBlockSize>
+size_t CompactHistory<T, kBlockSize>::FindInBlock(
+    size_t block_index,
+    const base::Timestamp& ts) const {
+  DCHECK_LT(block_index, blocks_.size());
+  size_t index = block_index * kBlockSize;
+  size_t block_end = index + kBlockSize;
+  if (block_end > values_.size())
+    block_end = values_.size();
+
+  base::Timestamp element_ts = blocks_[block_index].start_ts;
+  size_t offset = blocks_[block_index].deltas_offset;
+  while (index + 1 < block_end) {
+    base::Timestamp next_ts = element_ts + ReadDelta(&offset);
+    if (next_ts > ts)
+      break;
+    element_ts = next_ts;
+    ++index;
+  }
+  return index;
+}
+
+template <typename T, size_t kBlockSize>
+void CompactHistory<T, kBlockSize>::AppendDelta(base::Timestamp delta) {
+  while (delta >= 0x80) {
+    deltas_.push_back(static_cast<uint8_t>(delta | 0x80));
+    delta >>= 7;
+  }
+  deltas_.push_back(static_cast<uint8_t>(delta));
+}
+
+template <typename T, size_t kBlockSize>
+base::Timestamp CompactHistory<T, kBlockSize>::ReadDelta(size_t* offset) const {
+  base::Timestamp delta = 0;
+  int shift = 0;
+  uint8_t byte = 0;
+  do {
+    byte = deltas_[(*offset)++];
+    delta |= static_cast<base::Timestamp>(byte & 0x7F) << shift;
+    shift += 7;
+  } while ((byte & 0x80) != 0);
+  return delta;
+}
+
+}  // namespace base
@@ -49,4 +49,29 @@ bool FilePathExists(const std::wstring& path) {
   return true;
 }
 
+bool GetFileSizeAndLastWriteTime(const std::wstring& path,
+                                 uint64_t* size,
+                                 uint64_t* last_write_time) {
+  WIN32_FILE_ATTRIBUTE_DATA attributes;
+  if (!::GetFileAttributesExW(path.c_str(), GetFileExInfoStandard,
+                              &attributes)) {
+    return false;
+  }
+  *size = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) |
+          attributes.nFileSizeLow;
+  *last_write_time =
+      (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) |
+      attributes.ftLastWriteTime.dwLowDateTime;
+  return true;
+}
+
+bool RenameFile(const std::wstring& from_path, const std::wstring& to_path) {
+  return ::MoveFileExW(from_path.c_str(), to_path.c_str(),
+                       MOVEFILE_REPLACE_EXISTING) != FALSE;
+}
+
+bool RemoveFile(const std::wstring& path) {
+  return ::DeleteFileW(path.c_str()) != FALSE;
+}
+
 }  // namespace base
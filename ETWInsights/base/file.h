@@ -16,6 +16,7 @@ limitations under the License.
 
 #pragma once
 
+#include <stdint.h>
 #include <string>
 
 namespace base {
@@ -33,4 +34,23 @@ std::wstring BaseName(const std::wstring& path);
 // @returns true if the file path exists, false otherwise.
 bool FilePathExists(const std::wstring& path);
 
+// @param path a file path.
+// @param size the size of the file, in bytes, output.
+// @param last_write_time the time of the last write to the file, in 100
+//     nanosecond intervals since January 1, 1601 (UTC), output.
+// @returns true if the attributes of the file were read, false otherwise.
+bool GetFileSizeAndLastWriteTime(const std::wstring& path,
+                                 uint64_t* size,
+                                 uint64_t* last_write_time);
+
+// Moves a file, replacing the destination if it exists.
+// @param from_path path of the file to move.
+// @param to_path new path of the file.
+// @returns true if the file was moved, false otherwise.
+bool RenameFile(const std::wstring& from_path, const std::wstring& to_path);
+
+// @param path a file path.
+// @returns true if the file was removed, false otherwise.
+bool RemoveFile(const std::wstring& path);
+
 }  // namespace base
@@ -16,36 +16,147 @@ limitations under the License.
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || \
+    defined(__x86_64__)
+#include <xmmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 #include <algorithm>
 #include <vector>
 
-#include "base/binary_search.h"
 #include "base/logging.h"
 #include "base/types.h"
 
 namespace base {
 
+namespace internal {
+
+// Hints that |address| will be read soon. Does nothing on processors other
+// than x86.
+inline void Prefetch(const void* address) {
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || \
+    defined(__x86_64__)
+  _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+  (void)address;
+#endif
+}
+
+// @returns the index of the highest bit set in |value|, which can't be 0.
+inline size_t HighestBit(uint64_t value) {
+  DCHECK_NE(0U, value);
+#if defined(_MSC_VER)
+  // _BitScanReverse64 is only available on x64.
+  unsigned long index = 0;
+  const unsigned long high = static_cast<unsigned long>(value >> 32);
+  if (high != 0) {
+    _BitScanReverse(&index, high);
+    return index + 32;
+  }
+  _BitScanReverse(&index, static_cast<unsigned long>(value));
+  return index;
+#else
+  return 63 - __builtin_clzll(value);
+#endif
+}
+
+}  // namespace internal
+
+// A window of time: [start_ts, end_ts[.
+struct TimeWindow {
+  base::Timestamp start_ts;
+  base::Timestamp end_ts;
+};
+
 // An History associates values to time ranges.
+//
+// The start timestamps and the values of the elements are stored in separate
+// arrays, so that searching a timestamp only reads timestamps, whatever the
+// size of the values. Searches are branchless binary searches over the
+// timestamps, or searches in an Eytzinger layout of the timestamps after
+// BuildSearchIndex() has been called.
 template <typename T>
 class History {
  public:
-  // An element of the history.
-  struct Element {
-    Element(const base::Timestamp& start_ts, const T& value)
-        : start_ts(start_ts), value(value) {}
-
+  // A reference to an element of the history.
+  template <typename ValueType>
+  struct ElementReference {
     // Time at which the element starts.
-    base::Timestamp start_ts;
+    const base::Timestamp& start_ts;
 
     // Value of the element.
-    T value;
+    ValueType& value;
   };
 
-  typedef std::vector<Element> HistoryContainer;
-  typedef typename HistoryContainer::iterator HistoryIterator;
-  typedef typename HistoryContainer::const_iterator HistoryConstIterator;
+  // Iterates over the elements of the history. |ValueType| is T or const T.
+  template <typename ValueType>
+  class Iterator {
+   public:
+    typedef ElementReference<ValueType> Reference;
+
+    // Gives access to the members of an element with operator->.
+    class Pointer {
+     public:
+      explicit Pointer(const Reference& reference) : reference_(reference) {}
+      const Reference* operator->() const { return &reference_; }
+
+     private:
+      Reference reference_;
+    };
+
+    Iterator(const base::Timestamp* start_ts, ValueType* value)
+        : start_ts_(start_ts), value_(value) {}
+
+    Reference operator*() const { return Reference{*start_ts_, *value_}; }
+    Pointer operator->() const { return Pointer(**this); }
+
+    Iterator& operator++() {
+      ++start_ts_;
+      ++value_;
+      return *this;
+    }
+    Iterator operator+(ptrdiff_t count) const {
+      return Iterator(start_ts_ + count, value_ + count);
+    }
+    ptrdiff_t operator-(const Iterator& other) const {
+      return start_ts_ - other.start_ts_;
+    }
+
+    bool operator==(const Iterator& other) const {
+      return start_ts_ == other.start_ts_;
+    }
+    bool operator!=(const Iterator& other) const {
+      return start_ts_ != other.start_ts_;
+    }
+
+   private:
+    const base::Timestamp* start_ts_;
+    ValueType* value_;
+  };
 
-  History() {}
+  typedef Iterator<T> HistoryIterator;
+  typedef Iterator<const T> HistoryConstIterator;
+
+  History()
+      : view_timestamps_(nullptr),
+        view_values_(nullptr),
+        view_size_(0),
+        is_view_(false),
+        search_depth_(0) {}
+
+  // Makes the history a read-only view of elements stored elsewhere, e.g. in
+  // a memory-mapped file. Nothing can be inserted in a view.
+  // @param timestamps start timestamps of the elements, sorted. Must outlive
+  //    the history.
+  // @param values values of the elements. Must outlive the history.
+  // @param num_elements number of elements.
+  void SetView(const base::Timestamp* timestamps,
+               const T* values,
+               size_t num_elements);
 
   // Inserts a new value at the end of the history.
   // @param ts start timestamp for the inserted value.
@@ -54,6 +165,13 @@ class History {
   //    is earlier than the timestamp of the last inserted value.
   bool Insert(const base::Timestamp& start_ts, const T& value);
 
+  // Stores the timestamps in an Eytzinger layout, in which the elements
+  // visited by the first steps of all the searches are close to each other,
+  // and the elements visited by the next steps can be prefetched. Makes
+  // GetValue() and IteratorFromTimestamp() faster on large histories, at the
+  // cost of 8 bytes per element. The layout is discarded by Insert().
+  void BuildSearchIndex();
+
   // Gets the value for the specified timestamp.
   // @param ts timestamp for which to obtain the value.
   // @param value value for the specified timestamp.
@@ -61,6 +179,40 @@ class History {
   //    otherwise.
   bool GetValue(const base::Timestamp& ts, const T** value) const;
 
+  // Gets the values for sorted timestamps, in a single walk over the
+  // history. Faster than calling GetValue() for each timestamp.
+  // @param timestamps timestamps sorted in increasing order.
+  // @param values the value for each timestamp, or nullptr if there is no
+  //    value at the timestamp, output.
+  void GetValues(const std::vector<base::Timestamp>& timestamps,
+                 std::vector<const T*>* values) const;
+
+  // Calls a function for each element of the history that overlaps a window,
+  // with the duration of the element within the window.
+  // @param start_ts beginning of the window.
+  // @param end_ts end of the window.
+  // @param end_of_life end timestamp of the last element of the history. No
+  //    element lasts after it.
+  // @param function called with (const T& value, base::Timestamp duration)
+  //    for each element, in order. Elements clipped to an empty range are
+  //    given a duration of 0.
+  template <typename Function>
+  void Aggregate(base::Timestamp start_ts,
+                 base::Timestamp end_ts,
+                 base::Timestamp end_of_life,
+                 Function function) const;
+
+  // Calls a function for each element of the history that overlaps each of
+  // several windows, in a single scan of the history.
+  // @param windows windows sorted by start timestamp, which don't overlap.
+  // @param end_of_life end timestamp of the last element of the history.
+  // @param function called with (size_t window_index, const T& value,
+  //    base::Timestamp duration) for each element of each window, in order.
+  template <typename Function>
+  void Aggregate(const std::vector<TimeWindow>& windows,
+                 base::Timestamp end_of_life,
+                 Function function) const;
+
   // Gets the value of the last inserted element.
   // @param value the last value, output.
   // @returns true if there is at least one element in the history, false
@@ -81,102 +233,338 @@ class History {
   HistoryIterator IteratorFromTimestamp(const base::Timestamp& ts);
   HistoryConstIterator IteratorFromTimestamp(const base::Timestamp& ts) const;
 
+  // @returns an iterator to the beginning of the history.
+  HistoryConstIterator IteratorBegin() const {
+    return HistoryConstIterator(timestamps(), values());
+  }
+
   // @returns an iterator to the end of the history.
   HistoryIterator IteratorEnd();
   HistoryConstIterator IteratorEnd() const;
 
   // @returns the number of elements in the history.
-  size_t size() const { return history_.size(); }
+  size_t size() const { return is_view_ ? view_size_ : timestamps_.size(); }
 
  private:
-  // Elements of the history, sorted by start timestamp.
-  HistoryContainer history_;
+  // @returns the start timestamps of the elements.
+  const base::Timestamp* timestamps() const {
+    return is_view_ ? view_timestamps_ : timestamps_.data();
+  }
+
+  // @returns the values of the elements.
+  const T* values() const { return is_view_ ? view_values_ : values_.data(); }
+
+  // @returns the index of the first element that starts after |ts|, or
+  //    size() if there is none.
+  size_t UpperBound(const base::Timestamp& ts) const;
+
+  // Calls |function| for each element that overlaps |window|, starting at
+  // |it|, which is the element current at the beginning of the window or the
+  // first element of the history.
+  template <typename Function>
+  void AggregateWindow(HistoryConstIterator it,
+                       const TimeWindow& window,
+                       base::Timestamp end_of_life,
+                       Function function) const;
+
+  // @param node index of a node in |search_timestamps_|.
+  // @returns the index of the element of the node in the history.
+  size_t SearchNodeIndex(size_t node) const;
+
+  // Start timestamps and values of the elements, sorted by start timestamp.
+  // Empty for a view.
+  std::vector<base::Timestamp> timestamps_;
+  std::vector<T> values_;
+
+  // Elements of a view, stored outside of the history.
+  const base::Timestamp* view_timestamps_;
+  const T* view_values_;
+  size_t view_size_;
+  bool is_view_;
+
+  // Timestamps in Eytzinger layout: the children of the node at index k are
+  // at indexes 2k and 2k + 1, and index 0 is unused. Empty if no search index
+  // was built.
+  std::vector<base::Timestamp> search_timestamps_;
+
+  // Depth of the deepest nodes of |search_timestamps_|.
+  size_t search_depth_;
 };
 
+template <typename T>
+void History<T>::SetView(const base::Timestamp* timestamps,
+                         const T* values,
+                         size_t num_elements) {
+  timestamps_.clear();
+  values_.clear();
+  search_timestamps_.clear();
+  view_timestamps_ = timestamps;
+  view_values_ = values;
+  view_size_ = num_elements;
+  is_view_ = true;
+}
+
 template <typename T>
 bool History<T>::Insert(const base::Timestamp& start_ts, const T& value) {
-  if (!history_.empty()) {
-    if (history_.back().start_ts >= start_ts)
+  DCHECK(!is_view_);
+  if (!timestamps_.empty()) {
+    if (timestamps_.back() >= start_ts)
       return false;
-    if (history_.back().value == value)
+    if (values_.back() == value)
       return true;
   }
 
-  history_.push_back(Element(start_ts, value));
+  timestamps_.push_back(start_ts);
+  values_.push_back(value);
+  if (!search_timestamps_.empty())
+    search_timestamps_.clear();
   return true;
 }
 
+template <typename T>
+void History<T>::BuildSearchIndex() {
+  if (size() == 0)
+    return;
+  search_timestamps_.assign(size() + 1, 0);
+  search_depth_ = internal::HighestBit(size());
+
+  // An in-order traversal of the implicit tree visits the elements in sorted
+  // order.
+  const base::Timestamp* sorted_timestamps = timestamps();
+  size_t next_index = 0;
+  std::vector<size_t> path;
+  size_t node = 1;
+  while (node <= size() || !path.empty()) {
+    if (node <= size()) {
+      path.push_back(node);
+      node = 2 * node;
+      continue;
+    }
+    node = path.back();
+    path.pop_back();
+    search_timestamps_[node] = sorted_timestamps[next_index];
+    ++next_index;
+    node = 2 * node + 1;
+  }
+}
+
+template <typename T>
+size_t History<T>::UpperBound(const base::Timestamp& ts) const {
+  if (search_timestamps_.empty()) {
+    // Branchless binary search, which prefetches the two elements that can
+    // be read by the next step.
+    const base::Timestamp* base = timestamps();
+    size_t length = size();
+    if (length == 0)
+      return 0;
+    while (length > 1) {
+      const size_t half = length / 2;
+      internal::Prefetch(base + half / 2);
+      internal::Prefetch(base + half + half / 2);
+      base = base[half] <= ts ? base + half : base;
+      length -= half;
+    }
+    return (base - timestamps()) + (*base <= ts ? 1 : 0);
+  }
+
+  // Descend the tree, prefetching the nodes 4 levels below the current node,
+  // which are on the same cache line.
+  const size_t num_nodes = search_timestamps_.size();
+  size_t node = 1;
+  while (node < num_nodes) {
+    if (16 * node < num_nodes)
+      internal::Prefetch(&search_timestamps_[16 * node]);
+    node = 2 * node + (search_timestamps_[node] <= ts ? 1 : 0);
+  }
+
+  // The path ends with a sequence of right turns (1 bits) after the last left
+  // turn, which was at the upper bound. Remove them along with the left turn.
+  while ((node & 1) != 0)
+    node >>= 1;
+  node >>= 1;
+  if (node == 0)
+    return size();
+  return SearchNodeIndex(node);
+}
+
+template <typename T>
+size_t History<T>::SearchNodeIndex(size_t node) const {
+  // In a perfect tree of depth |search_depth_|, the node at position p of
+  // depth d has the in-order index (2p + 1) * 2^(search_depth_ - d) - 1, and
+  // the nodes of the deepest level have the even indexes. Subtract the
+  // missing nodes of the deepest level that precede the node.
+  const size_t depth = internal::HighestBit(node);
+  const size_t position = node - (static_cast<size_t>(1) << depth);
+  size_t index = ((2 * position + 1) << (search_depth_ - depth)) - 1;
+  const size_t num_deepest_nodes =
+      size() - (static_cast<size_t>(1) << search_depth_) + 1;
+  const size_t deepest_nodes_before = (index + 1) / 2;
+  if (deepest_nodes_before > num_deepest_nodes)
+    index -= deepest_nodes_before - num_deepest_nodes;
+  return index;
+}
+
 template <typename T>
 bool History<T>::GetValue(const base::Timestamp& ts, const T** value) const {
   DCHECK(value != nullptr);
-  auto it = base::FindSmallerOrEqual(
-      history_, ts, [](const base::Timestamp& ts, const Element& value) {
-        return ts < value.start_ts;
-      });
-
-  if (it == history_.end())
+  size_t upper_bound = UpperBound(ts);
+  if (upper_bound == 0)
     return false;
 
-  *value = &it->value;
+  *value = &values()[upper_bound - 1];
   return true;
 }
 
+template <typename T>
+void History<T>::GetValues(const std::vector<base::Timestamp>& timestamps,
+                           std::vector<const T*>* values) const {
+  DCHECK(values != nullptr);
+  values->assign(timestamps.size(), nullptr);
+  if (timestamps.empty())
+    return;
+
+  // |upper_bound| is the index of the first element that starts after the
+  // current timestamp. It only moves forward: by exponential steps, then by a
+  // binary search over the last step, so that sparse timestamps don't walk
+  // over all the elements between them.
+  const base::Timestamp* history_timestamps = this->timestamps();
+  const size_t history_size = size();
+  size_t upper_bound = UpperBound(timestamps.front());
+  for (size_t i = 0; i < timestamps.size(); ++i) {
+    const base::Timestamp ts = timestamps[i];
+    DCHECK(i == 0 || timestamps[i - 1] <= ts);
+
+    size_t step = 1;
+    size_t low = upper_bound;
+    while (upper_bound < history_size &&
+           history_timestamps[upper_bound] <= ts) {
+      low = upper_bound + 1;
+      upper_bound = (history_size - upper_bound > step) ? upper_bound + step
+                                                        : history_size;
+      step *= 2;
+    }
+    if (low < upper_bound) {
+      upper_bound = std::upper_bound(history_timestamps + low,
+                                     history_timestamps + upper_bound, ts) -
+                    history_timestamps;
+    }
+
+    if (upper_bound != 0)
+      (*values)[i] = &this->values()[upper_bound - 1];
+  }
+}
+
+template <typename T>
+template <typename Function>
+void History<T>::Aggregate(base::Timestamp start_ts,
+                           base::Timestamp end_ts,
+                           base::Timestamp end_of_life,
+                           Function function) const {
+  AggregateWindow(IteratorFromTimestamp(start_ts), {start_ts, end_ts},
+                  end_of_life, function);
+}
+
+template <typename T>
+template <typename Function>
+void History<T>::Aggregate(const std::vector<TimeWindow>& windows,
+                           base::Timestamp end_of_life,
+                           Function function) const {
+  if (windows.empty() || size() == 0)
+    return;
+
+  // The element current at the beginning of each window is found by moving
+  // forward from the one of the previous window.
+  HistoryConstIterator it = IteratorFromTimestamp(windows.front().start_ts);
+  HistoryConstIterator end_it = IteratorEnd();
+  for (size_t i = 0; i < windows.size(); ++i) {
+    const TimeWindow& window = windows[i];
+    DCHECK(i == 0 || windows[i - 1].end_ts <= window.start_ts);
+    for (HistoryConstIterator next_it = it + 1;
+         next_it != end_it && next_it->start_ts <= window.start_ts;
+         ++next_it) {
+      it = next_it;
+    }
+    AggregateWindow(it, window, end_of_life,
+                    [&function, i](const T& value, base::Timestamp duration) {
+                      function(i, value, duration);
+                    });
+  }
+}
+
+template <typename T>
+template <typename Function>
+void History<T>::AggregateWindow(HistoryConstIterator it,
+                                 const TimeWindow& window,
+                                 base::Timestamp end_of_life,
+                                 Function function) const {
+  HistoryConstIterator end_it = IteratorEnd();
+  const base::Timestamp window_end_ts =
+      window.end_ts < end_of_life ? window.end_ts : end_of_life;
+  for (; it != end_it && it->start_ts < window.end_ts; ++it) {
+    base::Timestamp element_start_ts =
+        it->start_ts > window.start_ts ? it->start_ts : window.start_ts;
+
+    base::Timestamp element_end_ts = window_end_ts;
+    HistoryConstIterator next_it = it + 1;
+    if (next_it != end_it && next_it->start_ts < element_end_ts)
+      element_end_ts = next_it->start_ts;
+
+    if (element_end_ts < element_start_ts)
+      continue;
+
+    function(it->value, element_end_ts - element_start_ts);
+  }
+}
+
 template <typename T>
 bool History<T>::GetLastElementValue(T* value) const {
   DCHECK(value != nullptr);
-  if (history_.empty())
+  if (size() == 0)
     return false;
 
-  *value = history_.back().value;
+  *value = values()[size() - 1];
   return true;
 }
 
 template <typename T>
 bool History<T>::GetLastElementTimestamp(base::Timestamp* ts) const {
   DCHECK(ts != nullptr);
-  if (history_.empty())
+  if (size() == 0)
     return false;
 
-  *ts = history_.back().start_ts;
+  *ts = timestamps()[size() - 1];
   return true;
 }
 
 template <typename T>
 typename History<T>::HistoryIterator History<T>::IteratorFromTimestamp(
     const base::Timestamp& ts) {
-  typename History<T>::HistoryIterator it = base::FindSmallerOrEqual(
-      history_, ts, [](const base::Timestamp& ts, const Element& value) {
-        return ts < value.start_ts;
-      });
-
-  if (it == history_.end())
-    return history_.begin();
-
-  return it;
+  DCHECK(!is_view_);
+  size_t upper_bound = UpperBound(ts);
+  size_t index = upper_bound == 0 ? 0 : upper_bound - 1;
+  return HistoryIterator(timestamps_.data() + index, values_.data() + index);
 }
 
 template <typename T>
 typename History<T>::HistoryConstIterator History<T>::IteratorFromTimestamp(
     const base::Timestamp& ts) const {
-  auto it = base::FindSmallerOrEqual(
-      history_, ts, [](const base::Timestamp& ts, const Element& value) {
-        return ts < value.start_ts;
-      });
-
-  if (it == history_.end())
-    return history_.begin();
-
-  return it;
+  // Last element that starts at or before |ts|, or the first element if they
+  // all start after |ts|.
+  size_t upper_bound = UpperBound(ts);
+  size_t index = upper_bound == 0 ? 0 : upper_bound - 1;
+  return HistoryConstIterator(timestamps() + index, values() + index);
 }
 
 template <typename T>
 typename History<T>::HistoryIterator History<T>::IteratorEnd() {
-  return history_.end();
+  DCHECK(!is_view_);
+  return HistoryIterator(timestamps_.data() + timestamps_.size(),
+                         values_.data() + values_.size());
 }
 
 template <typename T>
 typename History<T>::HistoryConstIterator History<T>::IteratorEnd() const {
-  return history_.end();
+  return HistoryConstIterator(timestamps() + size(), values() + size());
 }
 
 }  // namespace base
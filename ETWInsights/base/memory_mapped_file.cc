@@ -0,0 +1,146 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "base/memory_mapped_file.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include "base/error_string.h"
+#include "base/logging.h"
+#include "base/string_utils.h"
+
+namespace base {
+
+MemoryMappedFile::MemoryMappedFile()
+    : file_(INVALID_HANDLE_VALUE),
+      mapping_(NULL),
+      owns_handles_(true),
+      view_(nullptr),
+      data_(nullptr),
+      offset_(0),
+      length_(0),
+      size_(0) {
+  SYSTEM_INFO system_info = {};
+  ::GetSystemInfo(&system_info);
+  allocation_granularity_ = system_info.dwAllocationGranularity;
+}
+
+MemoryMappedFile::~MemoryMappedFile() {
+  Close();
+}
+
+bool MemoryMappedFile::Open(const std::wstring& path) {
+  DCHECK(file_ == INVALID_HANDLE_VALUE);
+
+  file_ = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    LOG(ERROR) << "Unable to open " << WStringToString(path) << ": "
+               << GetLastWindowsErrorString();
+    return false;
+  }
+
+  LARGE_INTEGER file_size = {};
+  if (!::GetFileSizeEx(file_, &file_size)) {
+    LOG(ERROR) << "Unable to get the size of " << WStringToString(path) << ": "
+               << GetLastWindowsErrorString();
+    Close();
+    return false;
+  }
+  size_ = static_cast<uint64_t>(file_size.QuadPart);
+
+  // A mapping can't be created for an empty file.
+  if (size_ == 0)
+    return true;
+
+  mapping_ = ::CreateFileMappingW(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping_ == NULL) {
+    LOG(ERROR) << "Unable to map " << WStringToString(path) << ": "
+               << GetLastWindowsErrorString();
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+bool MemoryMappedFile::OpenShared(const MemoryMappedFile& other) {
+  DCHECK(file_ == INVALID_HANDLE_VALUE);
+  if (other.file_ == INVALID_HANDLE_VALUE)
+    return false;
+
+  file_ = other.file_;
+  mapping_ = other.mapping_;
+  owns_handles_ = false;
+  size_ = other.size_;
+  return true;
+}
+
+void MemoryMappedFile::Close() {
+  Unmap();
+  if (owns_handles_) {
+    if (mapping_ != NULL)
+      ::CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE)
+      ::CloseHandle(file_);
+  }
+  mapping_ = NULL;
+  file_ = INVALID_HANDLE_VALUE;
+  owns_handles_ = true;
+  size_ = 0;
+}
+
+bool MemoryMappedFile::Map(uint64_t offset, size_t length) {
+  Unmap();
+
+  if (offset >= size_ || mapping_ == NULL) {
+    offset_ = offset;
+    return offset == size_;
+  }
+  if (length > size_ - offset)
+    length = static_cast<size_t>(size_ - offset);
+
+  uint64_t view_offset = offset - (offset % allocation_granularity_);
+  size_t view_length = static_cast<size_t>(offset - view_offset) + length;
+
+  view_ = ::MapViewOfFile(mapping_, FILE_MAP_READ,
+                          static_cast<DWORD>(view_offset >> 32),
+                          static_cast<DWORD>(view_offset & 0xFFFFFFFF),
+                          view_length);
+  if (view_ == nullptr) {
+    LOG(ERROR) << "Unable to map a view of " << view_length
+               << " bytes at offset " << view_offset << ": "
+               << GetLastWindowsErrorString();
+    return false;
+  }
+
+  data_ = static_cast<const char*>(view_) + (offset - view_offset);
+  offset_ = offset;
+  length_ = length;
+  return true;
+}
+
+void MemoryMappedFile::Unmap() {
+  if (view_ != nullptr) {
+    ::UnmapViewOfFile(view_);
+    view_ = nullptr;
+  }
+  data_ = nullptr;
+  length_ = 0;
+}
+
+}  // namespace base
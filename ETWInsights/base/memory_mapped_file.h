@@ -0,0 +1,104 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include "base/base.h"
+
+namespace base {
+
+// Maps a read-only file in memory. Only one view of the file is mapped at a
+// time, so that files larger than the address space of the process can be
+// read by moving the view. Typical usage is:
+//   MemoryMappedFile file;
+//   file.Open(L"trace.etl.csv");
+//   file.Map(offset, length);
+//   const char* bytes = file.data();
+class MemoryMappedFile {
+ public:
+  MemoryMappedFile();
+  ~MemoryMappedFile();
+
+  // Opens a file for reading.
+  // @param path path of the file to open.
+  // @returns true if the file was opened successfully, false otherwise.
+  bool Open(const std::wstring& path);
+
+  // Opens the file opened by another MemoryMappedFile, sharing its file
+  // mapping, so that views of the file can be mapped from several threads
+  // without opening the file again.
+  // @param other an opened file. Must stay open as long as this file.
+  // @returns true if successful, false otherwise.
+  bool OpenShared(const MemoryMappedFile& other);
+
+  // Unmaps the current view and closes the file.
+  void Close();
+
+  // Maps a view of the file. The previous view is unmapped, which invalidates
+  // all pointers obtained from data().
+  // @param offset offset of the first byte to map. Doesn't need to be aligned.
+  // @param length number of bytes to map. Truncated at the end of the file.
+  // @returns true if the view was mapped successfully, false otherwise.
+  bool Map(uint64_t offset, size_t length);
+
+  // @returns a pointer to the byte at offset() in the file.
+  const char* data() const { return data_; }
+
+  // @returns the offset in the file of the first byte of the view.
+  uint64_t offset() const { return offset_; }
+
+  // @returns the number of bytes accessible from data().
+  size_t length() const { return length_; }
+
+  // @returns the size of the file.
+  uint64_t size() const { return size_; }
+
+ private:
+  // Unmaps the current view.
+  void Unmap();
+
+  // File and file mapping handles. They are HANDLEs, declared as void* so that
+  // readers of mapped files don't include Windows.h.
+  void* file_;
+  void* mapping_;
+
+  // Whether |file_| and |mapping_| are closed by this object, false when they
+  // are shared with another MemoryMappedFile.
+  bool owns_handles_;
+
+  // Base address of the mapped view, aligned on the allocation granularity.
+  void* view_;
+
+  // Pointer to the byte at |offset_| in the view.
+  const char* data_;
+
+  // Offset and length of the part of the view that is exposed.
+  uint64_t offset_;
+  size_t length_;
+
+  // Size of the file.
+  uint64_t size_;
+
+  // Views must start at a multiple of this value.
+  uint64_t allocation_granularity_;
+
+  DISALLOW_COPY_AND_ASSIGN(MemoryMappedFile);
+};
+
+}  // namespace base
@@ -0,0 +1,143 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include "base/base.h"
+#include "base/history.h"
+#include "base/logging.h"
+#include "base/types.h"
+
+namespace base {
+
+// Iterates over the elements of several histories in the order of their start
+// timestamps, e.g. to build a timeline of all the threads of a process in a
+// single pass. The next element of each history is kept in a min-heap, so
+// each step costs O(log k) for k histories, and nothing is copied. The end
+// timestamp of an element is only read when it is requested. Typical usage
+// is:
+//   MergedHistoryIterator<StackId> it;
+//   it.AddHistory(tid, &thread.Stacks(), thread.end_ts(), start_ts);
+//   ...
+//   for (; !it.Done() && it.start_ts() < end_ts; it.Next())
+//     Use(it.id(), it.start_ts(), it.end_ts(), it.value());
+template <typename T>
+class MergedHistoryIterator {
+ public:
+  MergedHistoryIterator() {}
+
+  // Adds a history to the iteration. Must be called before Next().
+  // @param id identifies the history in the iteration, e.g. a thread id.
+  //    Elements that start at the same time are returned by increasing id.
+  // @param history the history. Must outlive the iterator.
+  // @param end_ts end timestamp of the last element of the history.
+  // @param start_ts the iteration of the history starts at the element that
+  //    is current at this timestamp, which may start before it, or at its
+  //    first element if there is none.
+  void AddHistory(uint64_t id,
+                  const History<T>* history,
+                  base::Timestamp end_ts,
+                  base::Timestamp start_ts = 0);
+
+  // @returns true if all the elements of all the histories were visited.
+  bool Done() const { return heap_.empty(); }
+
+  // Moves to the element that starts next, in any history.
+  void Next();
+
+  // @returns the id of the history of the current element.
+  uint64_t id() const { return top().id; }
+
+  // @returns the start timestamp of the current element.
+  base::Timestamp start_ts() const { return top().it->start_ts; }
+
+  // @returns the end timestamp of the current element: the start timestamp
+  //    of the next element of its history, or the end timestamp of the
+  //    history.
+  base::Timestamp end_ts() const;
+
+  // @returns the value of the current element.
+  const T& value() const { return top().it->value; }
+
+ private:
+  typedef typename History<T>::HistoryConstIterator HistoryConstIterator;
+
+  // Position in a history.
+  struct Cursor {
+    HistoryConstIterator it;
+    HistoryConstIterator end;
+    uint64_t id;
+    base::Timestamp end_ts;
+  };
+
+  // Orders the heap so that its front is the cursor that starts first.
+  static bool StartsAfter(const Cursor& a, const Cursor& b) {
+    if (a.it->start_ts != b.it->start_ts)
+      return a.it->start_ts > b.it->start_ts;
+    return a.id > b.id;
+  }
+
+  const Cursor& top() const {
+    DCHECK(!heap_.empty());
+    return heap_.front();
+  }
+
+  // Heap of the cursors that haven't reached the end of their history.
+  std::vector<Cursor> heap_;
+
+  DISALLOW_COPY_AND_ASSIGN(MergedHistoryIterator);
+};
+
+template <typename T>
+void MergedHistoryIterator<T>::AddHistory(uint64_t id,
+                                          const History<T>* history,
+                                          base::Timestamp end_ts,
+                                          base::Timestamp start_ts) {
+  DCHECK(history != nullptr);
+  Cursor cursor{history->IteratorFromTimestamp(start_ts),
+                history->IteratorEnd(), id, end_ts};
+  if (cursor.it == cursor.end)
+    return;
+  heap_.push_back(cursor);
+  std::push_heap(heap_.begin(), heap_.end(), &StartsAfter);
+}
+
+template <typename T>
+void MergedHistoryIterator<T>::Next() {
+  DCHECK(!heap_.empty());
+  std::pop_heap(heap_.begin(), heap_.end(), &StartsAfter);
+  Cursor& cursor = heap_.back();
+  ++cursor.it;
+  if (cursor.it == cursor.end)
+    heap_.pop_back();
+  else
+    std::push_heap(heap_.begin(), heap_.end(), &StartsAfter);
+}
+
+template <typename T>
+base::Timestamp MergedHistoryIterator<T>::end_ts() const {
+  const Cursor& cursor = top();
+  HistoryConstIterator next = cursor.it + 1;
+  if (next == cursor.end)
+    return cursor.end_ts;
+  return next->start_ts;
+}
+
+}  // namespace base
@@ -16,41 +16,42 @@ limitations under the License.
 
 #include "base/numeric_conversions.h"
 
-#include <stdlib.h>
-
 #include "base/logging.h"
 
 namespace base {
 
+ParseStatus ParseULongHex(std::string_view str, uint64_t* value) {
+  if (str.size() >= 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X'))
+    str.remove_prefix(2);
+  if (str.empty())
+    return kParseEmpty;
+  return internal::FromChars(str.data(), str.data() + str.size(), 16, value);
+}
+
 bool StrToULong(const std::string& str, uint64_t* ulong) {
   DCHECK(ulong);
-  try {
-    *ulong = std::stoull(str);
-    return true;
-  } catch (std::invalid_argument&) {
-    return false;
-  }
+  return ParseULong(str, ulong) == kParseOk;
 }
 
 bool StrToULong(const std::wstring& str, uint64_t* ulong) {
   DCHECK(ulong);
-  try {
-    *ulong = std::stoull(str);
-    return true;
-  } catch (std::invalid_argument&) {
+  // Numbers only contain ASCII characters.
+  const size_t kMaxDigits = 32;
+  char digits[kMaxDigits];
+  if (str.size() > kMaxDigits)
     return false;
+  for (size_t i = 0; i < str.size(); ++i) {
+    if (str[i] < L'0' || str[i] > L'9')
+      return false;
+    digits[i] = static_cast<char>(str[i]);
   }
+  return ParseULong(std::string_view(digits, str.size()), ulong) ==
+         kParseOk;
 }
 
 bool StrToULongHex(const std::string& str, uint64_t* ulong) {
   DCHECK(ulong);
-  try {
-    size_t pos = 0;
-    *ulong = std::stoull(str, &pos, 16);
-    return true;
-  } catch (std::invalid_argument&) {
-    return false;
-  }
+  return ParseULongHex(str, ulong) == kParseOk;
 }
 
 }  // namespace base
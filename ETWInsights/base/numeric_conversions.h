@@ -17,10 +17,61 @@ limitations under the License.
 #pragma once
 
 #include <stdint.h>
+#include <charconv>
 #include <string>
+#include <string_view>
+#include <system_error>
 
 namespace base {
 
+// Result of the conversion of a string to a number.
+enum ParseStatus {
+  kParseOk,
+  // The string is empty.
+  kParseEmpty,
+  // The string isn't a number, or has characters after the number.
+  kParseInvalid,
+  // The number doesn't fit in the result type.
+  kParseOutOfRange,
+};
+
+namespace internal {
+
+// Converts [begin, end) to an unsigned integer in |base|.
+inline ParseStatus FromChars(const char* begin,
+                             const char* end,
+                             int base,
+                             uint64_t* value) {
+  uint64_t result = 0;
+  const std::from_chars_result status =
+      std::from_chars(begin, end, result, base);
+  if (status.ec == std::errc::result_out_of_range)
+    return kParseOutOfRange;
+  if (status.ec != std::errc() || status.ptr != end)
+    return kParseInvalid;
+  *value = result;
+  return kParseOk;
+}
+
+}  // namespace internal
+
+// Converts a decimal string to an unsigned integer. Doesn't allocate memory
+// or throw exceptions. The whole string must be a number, without spaces or
+// sign.
+// @param str the string to convert.
+// @param value the result of the conversion, output. Not modified if the
+//     conversion fails.
+// @returns the status of the conversion.
+inline ParseStatus ParseULong(std::string_view str, uint64_t* value) {
+  if (str.empty())
+    return kParseEmpty;
+  return internal::FromChars(str.data(), str.data() + str.size(), 10, value);
+}
+
+// Converts a hexadecimal string, with or without a 0x prefix, to an unsigned
+// integer. Same rules as ParseULong().
+ParseStatus ParseULongHex(std::string_view str, uint64_t* value);
+
 // @param str a string to convert to unsigned long.
 // @param ulong the result of the conversion.
 // @returns true if the conversion was successful, false otherwise.
@@ -0,0 +1,76 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <array>
+
+namespace base {
+
+// A buffer that keeps the last |kCapacity| values that were pushed into it.
+// Pushing a value into a full buffer overwrites the oldest value, so the
+// memory used by the buffer never grows.
+template <typename T, size_t kCapacity>
+class RingBuffer {
+ public:
+  static_assert(kCapacity > 0, "A ring buffer can't be empty.");
+
+  RingBuffer() : next_(0), size_(0) {}
+
+  // Adds a value to the buffer, in place of the oldest value if the buffer is
+  // full.
+  // @param value the value to add.
+  void Push(const T& value) {
+    values_[next_] = value;
+    ++next_;
+    if (next_ == kCapacity)
+      next_ = 0;
+    if (size_ < kCapacity)
+      ++size_;
+  }
+
+  // Finds the most recently pushed value that satisfies a predicate.
+  // @param predicate function that takes a value and returns a bool.
+  // @returns a pointer to the value, or nullptr if no value of the buffer
+  //    satisfies |predicate|.
+  template <typename Predicate>
+  const T* FindLast(Predicate predicate) const {
+    size_t index = next_;
+    for (size_t i = 0; i < size_; ++i) {
+      index = (index == 0 ? kCapacity : index) - 1;
+      if (predicate(values_[index]))
+        return &values_[index];
+    }
+    return nullptr;
+  }
+
+  // @returns the number of values in the buffer.
+  size_t size() const { return size_; }
+
+  // @returns true if the buffer is empty.
+  bool empty() const { return size_ == 0; }
+
+ private:
+  // Values of the buffer. The next value is written at |next_|.
+  std::array<T, kCapacity> values_;
+  size_t next_;
+
+  // Number of values in the buffer.
+  size_t size_;
+};
+
+}  // namespace base
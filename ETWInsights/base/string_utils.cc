@@ -77,10 +77,11 @@ std::vector<T> SplitStringInternal(const T& str, const T& separator) {
 template <typename T>
 T TrimInternal(const T& str) {
   // Find position of first and last non-space character.
-  auto first = std::find_if(str.begin(), str.end(),
-                            std::not1(std::ptr_fun(std::isspace)));
-  auto last = std::find_if(str.rbegin(), str.rend(),
-                           std::not1(std::ptr_fun(std::isspace)));
+  auto is_not_space = [](typename T::value_type c) {
+    return !std::isspace(static_cast<int>(c));
+  };
+  auto first = std::find_if(str.begin(), str.end(), is_not_space);
+  auto last = std::find_if(str.rbegin(), str.rend(), is_not_space);
 
   auto first_index = std::distance(str.begin(), first);
   auto length = std::distance(last, str.rend()) - first_index;
@@ -0,0 +1,69 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "base/thread_pool.h"
+
+#include "base/logging.h"
+
+namespace base {
+
+ThreadPool::ThreadPool(size_t num_threads) : stopping_(false) {
+  DCHECK_GT(num_threads, 0U);
+  for (size_t i = 0; i < num_threads; ++i)
+    threads_.emplace_back([this]() { RunWorker(); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    stopping_ = true;
+  }
+  tasks_available_.notify_all();
+  for (auto& thread : threads_)
+    thread.join();
+}
+
+size_t ThreadPool::DefaultNumThreads() {
+  size_t num_threads = std::thread::hardware_concurrency();
+  return num_threads != 0 ? num_threads : 1;
+}
+
+void ThreadPool::PostInternal(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    DCHECK(!stopping_);
+    tasks_.push_back(std::move(task));
+  }
+  tasks_available_.notify_one();
+}
+
+void ThreadPool::RunWorker() {
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(lock_);
+      tasks_available_.wait(lock,
+                            [this]() { return stopping_ || !tasks_.empty(); });
+      if (tasks_.empty())
+        return;
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
+}  // namespace base
@@ -0,0 +1,86 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "base/base.h"
+
+namespace base {
+
+// A fixed set of worker threads that run tasks in the order in which they are
+// posted. Typical usage is:
+//   ThreadPool pool(ThreadPool::DefaultNumThreads());
+//   std::future<int> result = pool.Post([]() { return 42; });
+//   result.get();
+// The destructor runs the tasks that are still pending and joins the threads.
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t num_threads);
+  ~ThreadPool();
+
+  // Posts a task.
+  // @param task the task to run.
+  // @returns a future that holds the result of the task.
+  template <typename Task>
+  auto Post(Task task) -> std::future<decltype(task())>;
+
+  // @returns the number of worker threads.
+  size_t num_threads() const { return threads_.size(); }
+
+  // @returns the number of hardware threads, or 1 if it is unknown.
+  static size_t DefaultNumThreads();
+
+ private:
+  // Posts a task that doesn't return anything.
+  void PostInternal(std::function<void()> task);
+
+  // Main function of the worker threads.
+  void RunWorker();
+
+  // Worker threads.
+  std::vector<std::thread> threads_;
+
+  // Tasks that haven't started yet, protected by |lock_|.
+  std::deque<std::function<void()>> tasks_;
+  bool stopping_;
+  std::mutex lock_;
+  std::condition_variable tasks_available_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+template <typename Task>
+auto ThreadPool::Post(Task task) -> std::future<decltype(task())> {
+  typedef decltype(task()) Result;
+
+  // std::function must be copyable, std::packaged_task isn't.
+  auto packaged_task =
+      std::make_shared<std::packaged_task<Result()>>(std::move(task));
+  std::future<Result> result = packaged_task->get_future();
+  PostInternal([packaged_task]() { (*packaged_task)(); });
+  return result;
+}
+
+}  // namespace base
@@ -0,0 +1,328 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Compares the speed of the ways to split the lines of the CSV dump of a
+// trace into trimmed fields, on synthetic lines padded like xperf pads them.
+
+#include <string.h>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "base/command_line.h"
+#include "base/numeric_conversions.h"
+#include "base/string_utils.h"
+#include "etw_reader/csv_tokenizer.h"
+
+using namespace etw_insights;
+
+namespace {
+
+// Default number of synthetic lines.
+const uint64_t kDefaultNumLines = 200000;
+
+// Default number of times that each tokenizer splits all the lines.
+const uint64_t kDefaultNumIterations = 10;
+
+// Columns of the synthetic lines: width of the column, and whether the values
+// are numbers. xperf right-aligns all values in their column.
+const struct {
+  size_t width;
+  bool is_number;
+} kColumns[] = {
+    {18, false}, {11, true}, {24, false}, {11, true}, {5, true},
+    {4, true},   {12, false}, {11, true}, {24, false}, {11, true},
+    {5, true},   {4, true},   {12, false}, {8, true},  {5, true},
+    {8, false},  {14, false}, {8, true},   {8, true},  {60, false},
+};
+
+void ShowUsage() {
+  std::cout << "Usage: csv_tokenizer_benchmark.exe [options]" << std::endl
+            << std::endl
+            << "Options:" << std::endl
+            << "  --lines: Number of synthetic lines. Default: "
+            << kDefaultNumLines << std::endl
+            << "  --iterations: Number of times that each tokenizer splits "
+               "all the lines. Default: "
+            << kDefaultNumIterations << std::endl;
+}
+
+// Generates lines that look like the CSV dump of a trace.
+std::vector<std::string> GenerateLines(uint64_t num_lines) {
+  std::mt19937 generator(42);
+  std::uniform_int_distribution<int> letter('a', 'z');
+  std::uniform_int_distribution<int> digit('0', '9');
+
+  std::vector<std::string> lines;
+  lines.reserve(static_cast<size_t>(num_lines));
+  for (uint64_t i = 0; i < num_lines; ++i) {
+    std::string line;
+    for (const auto& column : kColumns) {
+      size_t value_length = 1 + generator() % column.width;
+      std::string value;
+      for (size_t j = 0; j < value_length; ++j) {
+        value.push_back(
+            static_cast<char>(column.is_number ? digit(generator)
+                                               : letter(generator)));
+      }
+      if (!line.empty())
+        line.push_back(',');
+      line.append(column.width + 1 - value_length, ' ');
+      line.append(value);
+    }
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+// Splits a line with SplitString() and trims each token with Trim().
+size_t TokenizeWithSplitString(const std::string& line) {
+  std::vector<std::string> tokens(base::SplitString(line, ","));
+  size_t total_length = 0;
+  for (auto& token : tokens) {
+    token = base::Trim(token);
+    total_length += token.size();
+  }
+  return total_length;
+}
+
+bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' ||
+         c == '\f';
+}
+
+// Finds each separator with memchr() and trims each token byte by byte.
+size_t TokenizeWithMemchr(const std::string& line) {
+  size_t total_length = 0;
+  const char* token_begin = line.data();
+  const char* line_end = line.data() + line.size();
+  while (token_begin < line_end) {
+    const char* token_end = static_cast<const char*>(
+        memchr(token_begin, ',', line_end - token_begin));
+    if (token_end == nullptr)
+      token_end = line_end;
+    const char* next_token_begin = token_end + 1;
+    while (token_begin != token_end && IsSpace(*token_begin))
+      ++token_begin;
+    while (token_end != token_begin && IsSpace(*(token_end - 1)))
+      --token_end;
+    total_length += token_end - token_begin;
+    token_begin = next_token_begin;
+  }
+  return total_length;
+}
+
+// Splits a line with a CsvTokenizer.
+size_t TokenizeWithCsvTokenizer(const std::string& line,
+                                CsvTokenizer::InstructionSet instruction_set) {
+  size_t total_length = 0;
+  CsvTokenizer tokenizer(line, instruction_set);
+  const char* token_begin = nullptr;
+  const char* token_end = nullptr;
+  while (tokenizer.NextField(&token_begin, &token_end))
+    total_length += token_end - token_begin;
+  return total_length;
+}
+
+// A trimmed field of a line: offset of its first character in the line, and
+// length.
+typedef std::pair<size_t, size_t> Field;
+
+// Splits a line in trimmed fields, finding each separator with memchr(). This
+// is the reference to which the other tokenizers are compared.
+void SplitWithMemchr(const std::string& line, std::vector<Field>* fields) {
+  fields->clear();
+  const char* token_begin = line.data();
+  const char* line_end = line.data() + line.size();
+  while (token_begin < line_end) {
+    const char* token_end = static_cast<const char*>(
+        memchr(token_begin, ',', line_end - token_begin));
+    if (token_end == nullptr)
+      token_end = line_end;
+    const char* next_token_begin = token_end + 1;
+    while (token_begin != token_end && IsSpace(*token_begin))
+      ++token_begin;
+    while (token_end != token_begin && IsSpace(*(token_end - 1)))
+      --token_end;
+    fields->emplace_back(token_begin - line.data(), token_end - token_begin);
+    token_begin = next_token_begin;
+  }
+}
+
+// Splits a line in trimmed fields with a CsvTokenizer.
+void SplitWithCsvTokenizer(const std::string& line,
+                           CsvTokenizer::InstructionSet instruction_set,
+                           std::vector<Field>* fields) {
+  fields->clear();
+  CsvTokenizer tokenizer(line, instruction_set);
+  const char* token_begin = nullptr;
+  const char* token_end = nullptr;
+  while (tokenizer.NextField(&token_begin, &token_end))
+    fields->emplace_back(token_begin - line.data(), token_end - token_begin);
+}
+
+// Checks that all the tokenizers split each line in the same fields: same
+// number of fields, at the same offsets, with the same length.
+// @param lines the lines to split.
+// @param instruction_sets the instruction sets of CsvTokenizer to check.
+// @returns true if the tokenizers agree on all the lines, false otherwise.
+bool CheckTokenizers(
+    const std::vector<std::string>& lines,
+    const std::vector<CsvTokenizer::InstructionSet>& instruction_sets) {
+  std::vector<Field> expected_fields;
+  std::vector<Field> fields;
+  for (size_t line_index = 0; line_index < lines.size(); ++line_index) {
+    const std::string& line = lines[line_index];
+    SplitWithMemchr(line, &expected_fields);
+
+    // SplitString() + Trim() returns copies of the fields: compare their
+    // content.
+    std::vector<std::string> tokens(base::SplitString(line, ","));
+    bool split_string_agrees = tokens.size() == expected_fields.size();
+    for (size_t i = 0; split_string_agrees && i < tokens.size(); ++i) {
+      split_string_agrees =
+          base::Trim(tokens[i]) ==
+          line.substr(expected_fields[i].first, expected_fields[i].second);
+    }
+    if (!split_string_agrees) {
+      std::cout << "SplitString + Trim disagrees on line " << line_index
+                << "." << std::endl;
+      return false;
+    }
+
+    for (CsvTokenizer::InstructionSet instruction_set : instruction_sets) {
+      SplitWithCsvTokenizer(line, instruction_set, &fields);
+      if (fields != expected_fields) {
+        std::cout << "CsvTokenizer (instruction set " << instruction_set
+                  << ") disagrees on line " << line_index << "."
+                  << std::endl;
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Splits all the lines |num_iterations| times and reports the throughput.
+// @returns the total length of the tokens, which must be the same for all
+//     tokenizers.
+template <typename Tokenizer>
+size_t RunBenchmark(const char* name,
+                    const std::vector<std::string>& lines,
+                    uint64_t num_iterations,
+                    const Tokenizer& tokenizer) {
+  size_t num_bytes = 0;
+  for (const auto& line : lines)
+    num_bytes += line.size();
+
+  size_t total_length = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < num_iterations; ++i) {
+    total_length = 0;
+    for (const auto& line : lines)
+      total_length += tokenizer(line);
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  double megabytes =
+      static_cast<double>(num_bytes) * num_iterations / (1024 * 1024);
+  std::cout << std::left << std::setw(24) << name << std::right
+            << std::setw(10) << std::fixed << std::setprecision(1)
+            << megabytes / seconds << " MB/s" << std::endl;
+  return total_length;
+}
+
+}  // namespace
+
+int wmain(int argc, wchar_t* argv[], wchar_t* /*envp */ []) {
+  base::CommandLine command_line(argc, argv);
+
+  if (command_line.HasSwitch(L"help")) {
+    ShowUsage();
+    return 1;
+  }
+
+  uint64_t num_lines = kDefaultNumLines;
+  uint64_t num_iterations = kDefaultNumIterations;
+  if ((command_line.HasSwitch(L"lines") &&
+       !base::StrToULong(command_line.GetSwitchValue(L"lines"), &num_lines)) ||
+      (command_line.HasSwitch(L"iterations") &&
+       !base::StrToULong(command_line.GetSwitchValue(L"iterations"),
+                         &num_iterations))) {
+    ShowUsage();
+    return 1;
+  }
+
+  std::vector<std::string> lines(GenerateLines(num_lines));
+
+  const struct {
+    const char* name;
+    CsvTokenizer::InstructionSet instruction_set;
+  } kTokenizers[] = {
+      {"CsvTokenizer (scalar)", CsvTokenizer::kScalar},
+      {"CsvTokenizer (SSE2)", CsvTokenizer::kSSE2},
+      {"CsvTokenizer (AVX2)", CsvTokenizer::kAVX2},
+  };
+
+  // Check the boundaries of the fields before measuring anything.
+  std::vector<CsvTokenizer::InstructionSet> instruction_sets;
+  for (const auto& tokenizer : kTokenizers) {
+    if (tokenizer.instruction_set <= CsvTokenizer::BestInstructionSet())
+      instruction_sets.push_back(tokenizer.instruction_set);
+  }
+  if (!CheckTokenizers(lines, instruction_sets)) {
+    std::cout << "Tokenizers don't agree on the fields." << std::endl;
+    return 1;
+  }
+
+  size_t expected_length =
+      RunBenchmark("SplitString + Trim", lines, num_iterations,
+                   TokenizeWithSplitString);
+  std::vector<size_t> lengths;
+  lengths.push_back(RunBenchmark("memchr + scalar trim", lines,
+                                 num_iterations, TokenizeWithMemchr));
+
+  for (const auto& tokenizer : kTokenizers) {
+    if (tokenizer.instruction_set > CsvTokenizer::BestInstructionSet()) {
+      std::cout << std::left << std::setw(24) << tokenizer.name
+                << "   not supported" << std::endl;
+      continue;
+    }
+    lengths.push_back(
+        RunBenchmark(tokenizer.name, lines, num_iterations,
+                     [&tokenizer](const std::string& line) {
+                       return TokenizeWithCsvTokenizer(
+                           line, tokenizer.instruction_set);
+                     }));
+  }
+
+  for (size_t length : lengths) {
+    if (length != expected_length) {
+      std::cout << "Tokenizers don't agree on the content of the fields."
+                << std::endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
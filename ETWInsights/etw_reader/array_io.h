@@ -0,0 +1,109 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <fstream>
+#include <vector>
+
+namespace etw_insights {
+
+// Arrays are aligned on this number of bytes in the binary files written next
+// to a trace (the cache of its events, the snapshot of its history).
+const size_t kArrayAlignment = 8;
+
+// Writes arrays to a binary file, aligned on kArrayAlignment bytes.
+class ArrayWriter {
+ public:
+  explicit ArrayWriter(std::ofstream* out) : out_(out), offset_(0) {}
+
+  template <typename T>
+  void WriteArray(const T* data, size_t count) {
+    size_t num_bytes = count * sizeof(T);
+    if (num_bytes != 0)
+      out_->write(reinterpret_cast<const char*>(data), num_bytes);
+    offset_ += num_bytes;
+
+    static const char kPadding[kArrayAlignment] = {};
+    size_t padding = (kArrayAlignment - offset_ % kArrayAlignment) %
+                     kArrayAlignment;
+    out_->write(kPadding, padding);
+    offset_ += padding;
+  }
+
+  template <typename T>
+  void operator()(const std::vector<T>* column, uint64_t /* count */) {
+    WriteArray(column->data(), column->size());
+  }
+
+  uint64_t offset() const { return offset_; }
+
+ private:
+  std::ofstream* out_;
+  uint64_t offset_;
+};
+
+// Reads arrays from a mapped binary file, checking that they are within the
+// bounds of the file.
+class ArrayReader {
+ public:
+  ArrayReader(const char* data, size_t size)
+      : data_(data), size_(size), offset_(0), valid_(true) {}
+
+  template <typename T>
+  bool ReadArray(uint64_t count, const T** array) {
+    if (!valid_ || count > (size_ - offset_) / sizeof(T)) {
+      valid_ = false;
+      *array = nullptr;
+      return false;
+    }
+    *array = reinterpret_cast<const T*>(data_ + offset_);
+    offset_ += static_cast<size_t>(count) * sizeof(T);
+    offset_ += (kArrayAlignment - offset_ % kArrayAlignment) %
+               kArrayAlignment;
+    if (offset_ > size_)
+      offset_ = size_;
+    return true;
+  }
+
+  template <typename T>
+  void operator()(const T** column, uint64_t count) {
+    ReadArray(count, column);
+  }
+
+  bool valid() const { return valid_; }
+
+ private:
+  const char* data_;
+  size_t size_;
+  size_t offset_;
+  bool valid_;
+};
+
+// @returns true if |values| is sorted and starts at 0, as the offsets of a
+// table of strings must be.
+inline bool IsSorted(const uint64_t* values, uint64_t count) {
+  if (count == 0 || values[0] != 0)
+    return false;
+  for (uint64_t i = 1; i < count; ++i) {
+    if (values[i] < values[i - 1])
+      return false;
+  }
+  return true;
+}
+
+}  // namespace etw_insights
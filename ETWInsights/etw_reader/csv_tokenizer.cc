@@ -0,0 +1,298 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "etw_reader/csv_tokenizer.h"
+
+#include <string.h>
+
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#include "base/logging.h"
+
+// Allows a function to use AVX2 instructions, even if the rest of the file is
+// compiled for an older instruction set.
+#if defined(_MSC_VER)
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace etw_insights {
+
+namespace {
+
+// CSV column separator.
+const char kSeparator = ',';
+
+// Characters considered as spaces: ' ' and the range ['\t', '\r'].
+const char kSpace = ' ';
+const char kFirstControlSpace = '\t';
+const char kLastControlSpace = '\r';
+
+const uint32_t kAllBits = static_cast<uint32_t>(-1);
+
+// @returns the index of the lowest bit set in |mask|, which can't be 0.
+size_t LowestBit(uint32_t mask) {
+  DCHECK_NE(0U, mask);
+#if defined(_MSC_VER)
+  unsigned long index = 0;
+  _BitScanForward(&index, mask);
+  return index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+// @returns the index of the highest bit set in |mask|, which can't be 0.
+size_t HighestBit(uint32_t mask) {
+  DCHECK_NE(0U, mask);
+#if defined(_MSC_VER)
+  unsigned long index = 0;
+  _BitScanReverse(&index, mask);
+  return index;
+#else
+  return 31 - __builtin_clz(mask);
+#endif
+}
+
+bool IsSpace(char c) {
+  return c == kSpace || (c >= kFirstControlSpace && c <= kLastControlSpace);
+}
+
+void ScanBlockScalar(const char* block,
+                     uint32_t* separators,
+                     uint32_t* non_spaces) {
+  uint32_t separators_mask = 0;
+  uint32_t non_spaces_mask = 0;
+  for (size_t i = 0; i < CsvTokenizer::kBlockSize; ++i) {
+    if (block[i] == kSeparator)
+      separators_mask |= 1U << i;
+    if (!IsSpace(block[i]))
+      non_spaces_mask |= 1U << i;
+  }
+  *separators = separators_mask;
+  *non_spaces = non_spaces_mask;
+}
+
+// Computes the masks of 16 bytes.
+void ScanHalfBlockSSE2(const char* data,
+                       uint32_t* separators,
+                       uint32_t* non_spaces) {
+  const __m128i bytes =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+  const __m128i is_separator =
+      _mm_cmpeq_epi8(bytes, _mm_set1_epi8(kSeparator));
+  const __m128i is_control_space = _mm_and_si128(
+      _mm_cmpgt_epi8(bytes, _mm_set1_epi8(kFirstControlSpace - 1)),
+      _mm_cmplt_epi8(bytes, _mm_set1_epi8(kLastControlSpace + 1)));
+  const __m128i is_space = _mm_or_si128(
+      _mm_cmpeq_epi8(bytes, _mm_set1_epi8(kSpace)), is_control_space);
+  *separators = static_cast<uint32_t>(_mm_movemask_epi8(is_separator));
+  *non_spaces = ~static_cast<uint32_t>(_mm_movemask_epi8(is_space)) & 0xFFFF;
+}
+
+void ScanBlockSSE2(const char* block,
+                   uint32_t* separators,
+                   uint32_t* non_spaces) {
+  uint32_t low_separators = 0;
+  uint32_t low_non_spaces = 0;
+  uint32_t high_separators = 0;
+  uint32_t high_non_spaces = 0;
+  ScanHalfBlockSSE2(block, &low_separators, &low_non_spaces);
+  ScanHalfBlockSSE2(block + 16, &high_separators, &high_non_spaces);
+  *separators = low_separators | (high_separators << 16);
+  *non_spaces = low_non_spaces | (high_non_spaces << 16);
+}
+
+TARGET_AVX2 void ScanBlockAVX2(const char* block,
+                               uint32_t* separators,
+                               uint32_t* non_spaces) {
+  const __m256i bytes =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+  const __m256i is_separator =
+      _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(kSeparator));
+  const __m256i is_control_space = _mm256_and_si256(
+      _mm256_cmpgt_epi8(bytes, _mm256_set1_epi8(kFirstControlSpace - 1)),
+      _mm256_cmpgt_epi8(_mm256_set1_epi8(kLastControlSpace + 1), bytes));
+  const __m256i is_space = _mm256_or_si256(
+      _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(kSpace)), is_control_space);
+  *separators = static_cast<uint32_t>(_mm256_movemask_epi8(is_separator));
+  *non_spaces = ~static_cast<uint32_t>(_mm256_movemask_epi8(is_space));
+}
+
+CsvTokenizer::InstructionSet DetectInstructionSet() {
+#if defined(_MSC_VER)
+  int info[4] = {};
+  __cpuid(info, 0);
+  const int max_leaf = info[0];
+  if (max_leaf < 1)
+    return CsvTokenizer::kScalar;
+
+  __cpuid(info, 1);
+  const bool has_sse2 = (info[3] & (1 << 26)) != 0;
+  const bool has_osxsave = (info[2] & (1 << 27)) != 0;
+  const bool has_avx = (info[2] & (1 << 28)) != 0;
+
+  // AVX2 also requires the OS to save the YMM registers.
+  bool has_avx2 = false;
+  if (max_leaf >= 7 && has_osxsave && has_avx &&
+      (_xgetbv(0) & 0x6) == 0x6) {
+    __cpuidex(info, 7, 0);
+    has_avx2 = (info[1] & (1 << 5)) != 0;
+  }
+#else
+  __builtin_cpu_init();
+  const bool has_sse2 = __builtin_cpu_supports("sse2") != 0;
+  const bool has_avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+
+  if (has_avx2)
+    return CsvTokenizer::kAVX2;
+  if (has_sse2)
+    return CsvTokenizer::kSSE2;
+  return CsvTokenizer::kScalar;
+}
+
+}  // namespace
+
+CsvTokenizer::CsvTokenizer(std::string_view line)
+    : CsvTokenizer(line, BestInstructionSet()) {}
+
+CsvTokenizer::CsvTokenizer(std::string_view line,
+                           InstructionSet instruction_set)
+    : line_begin_(line.data()),
+      line_end_(line.data() + line.size()),
+      cursor_(line.data()),
+      block_(line.data()),
+      block_end_(line.data()),
+      separators_(0),
+      non_spaces_(0),
+      at_end_(false) {
+  switch (instruction_set) {
+    case kAVX2:
+      scan_block_ = ScanBlockAVX2;
+      break;
+    case kSSE2:
+      scan_block_ = ScanBlockSSE2;
+      break;
+    default:
+      scan_block_ = ScanBlockScalar;
+      break;
+  }
+}
+
+bool CsvTokenizer::NextField(const char** begin, const char** end) {
+  return ReadField(true, begin, end);
+}
+
+bool CsvTokenizer::RestOfLine(const char** begin, const char** end) {
+  return ReadField(false, begin, end);
+}
+
+CsvTokenizer::InstructionSet CsvTokenizer::BestInstructionSet() {
+  static const InstructionSet best_instruction_set = DetectInstructionSet();
+  return best_instruction_set;
+}
+
+void CsvTokenizer::ScanBlock() {
+  if (static_cast<size_t>(line_end_ - cursor_) >= kBlockSize) {
+    block_ = cursor_;
+    block_end_ = block_ + kBlockSize;
+    scan_block_(block_, &separators_, &non_spaces_);
+    return;
+  }
+
+  // The end of the line is shorter than a block. If the line is long enough,
+  // scan the last block of the line: the bytes that precede the cursor are
+  // masked out by ReadField().
+  block_end_ = line_end_;
+  if (static_cast<size_t>(line_end_ - line_begin_) >= kBlockSize) {
+    block_ = line_end_ - kBlockSize;
+    scan_block_(block_, &separators_, &non_spaces_);
+    return;
+  }
+
+  // Otherwise, pad the line with spaces, which are ignored.
+  char padded_block[kBlockSize];
+  memset(padded_block, kSpace, kBlockSize);
+  memcpy(padded_block, line_begin_, line_end_ - line_begin_);
+  block_ = line_begin_;
+  scan_block_(padded_block, &separators_, &non_spaces_);
+}
+
+bool CsvTokenizer::ReadField(bool stop_at_separator,
+                             const char** begin,
+                             const char** end) {
+  DCHECK(begin != nullptr);
+  DCHECK(end != nullptr);
+
+  if (at_end_)
+    return false;
+
+  const char* first_non_space = nullptr;
+  const char* last_non_space = nullptr;
+  const char* field_end = line_end_;
+
+  while (cursor_ != line_end_) {
+    if (cursor_ == block_end_)
+      ScanBlock();
+
+    // Ignore the bytes of the block that precede the cursor.
+    const uint32_t cursor_mask = kAllBits << (cursor_ - block_);
+    uint32_t separators = stop_at_separator ? separators_ & cursor_mask : 0;
+    uint32_t non_spaces = non_spaces_ & cursor_mask;
+
+    // Ignore the bytes that follow the end of the field.
+    size_t separator_index = 0;
+    if (separators != 0) {
+      separator_index = LowestBit(separators);
+      non_spaces &= ~(kAllBits << separator_index);
+    }
+
+    if (non_spaces != 0) {
+      if (first_non_space == nullptr)
+        first_non_space = block_ + LowestBit(non_spaces);
+      last_non_space = block_ + HighestBit(non_spaces);
+    }
+
+    if (separators != 0) {
+      field_end = block_ + separator_index;
+      cursor_ = field_end + 1;
+      break;
+    }
+    cursor_ = block_end_;
+  }
+
+  // The last field of the line doesn't end with a separator.
+  if (field_end == line_end_)
+    at_end_ = true;
+
+  if (first_non_space != nullptr) {
+    *begin = first_non_space;
+    *end = last_non_space + 1;
+  } else {
+    *begin = field_end;
+    *end = field_end;
+  }
+  return true;
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,110 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string_view>
+
+#include "base/base.h"
+
+namespace etw_insights {
+
+// Splits a line of a CSV file into fields, without the spaces that surround
+// them. The line is scanned once, in blocks of 32 bytes: vector instructions
+// find the separators and the non-space characters of a block, then the
+// boundaries of the fields are read from the resulting bit masks. Typical
+// usage is:
+//   CsvTokenizer tokenizer(line);
+//   const char* begin;
+//   const char* end;
+//   while (tokenizer.NextField(&begin, &end))
+//     ...
+class CsvTokenizer {
+ public:
+  // Instruction sets that can be used to scan a line.
+  enum InstructionSet {
+    kScalar,
+    kSSE2,
+    kAVX2,
+  };
+
+  // Creates a tokenizer that uses the best instruction set supported by the
+  // processor.
+  explicit CsvTokenizer(std::string_view line);
+
+  // Creates a tokenizer that uses a specific instruction set.
+  CsvTokenizer(std::string_view line, InstructionSet instruction_set);
+
+  // Reads the next field. A line that contains N separators has N + 1 fields.
+  // @param begin beginning of the field, without leading spaces, output.
+  // @param end end of the field, without trailing spaces, output.
+  // @returns false if all the fields have been read.
+  bool NextField(const char** begin, const char** end);
+
+  // Reads all the remaining fields as a single field, separators included.
+  // @param begin beginning of the remaining fields, output.
+  // @param end end of the remaining fields, output.
+  // @returns false if all the fields have been read.
+  bool RestOfLine(const char** begin, const char** end);
+
+  // @returns true if all the fields have been read.
+  bool AtEnd() const { return at_end_; }
+
+  // @returns the best instruction set supported by the processor.
+  static InstructionSet BestInstructionSet();
+
+  // Number of bytes scanned at once.
+  static const size_t kBlockSize = 32;
+
+ private:
+  // Computes the masks of a block. Bit i of a mask is set if byte i of the
+  // block is a separator (|separators|) or isn't a space (|non_spaces|).
+  typedef void (*ScanBlockFunction)(const char* block,
+                                    uint32_t* separators,
+                                    uint32_t* non_spaces);
+
+  // Scans the block that starts at |cursor_|.
+  void ScanBlock();
+
+  // Reads the next field.
+  // @param stop_at_separator whether the field ends at the next separator or
+  //     at the end of the line.
+  bool ReadField(bool stop_at_separator, const char** begin, const char** end);
+
+  // Function that computes the masks of a block.
+  ScanBlockFunction scan_block_;
+
+  // Beginning and end of the line.
+  const char* const line_begin_;
+  const char* const line_end_;
+
+  // Next character to read.
+  const char* cursor_;
+
+  // Block that contains |cursor_|, and its masks.
+  const char* block_;
+  const char* block_end_;
+  uint32_t separators_;
+  uint32_t non_spaces_;
+
+  // Whether all the fields have been read.
+  bool at_end_;
+
+  DISALLOW_COPY_AND_ASSIGN(CsvTokenizer);
+};
+
+}  // namespace etw_insights
@@ -16,83 +16,206 @@ limitations under the License.
 
 #include "etw_reader/etw_reader.h"
 
+#include <fstream>
+
 #include "base/child_process.h"
 #include "base/file.h"
 #include "base/logging.h"
 #include "base/numeric_conversions.h"
 #include "base/string_utils.h"
+#include "etw_reader/csv_tokenizer.h"
+#include "etw_reader/timestamp_index.h"
 
 namespace etw_insights {
 
 namespace {
 // CSV column separator.
-const char kSeparator[] = ",";
+const char kSeparator = ',';
 
 // Extension for a CSV file.
 const wchar_t kCSVFileExtension[] = L".csv";
 
+// Column that holds the timestamp of events.
+const char kTimestampColumn[] = "TimeStamp";
+
 // Invalid line index.
 const size_t kInvalidLineIndex = static_cast<size_t>(-1);
 
-std::vector<std::string> ExtractTokens(const std::string& str) {
-  std::vector<std::string> tokens(base::SplitString(str, kSeparator));
-  for (auto& token : tokens)
-    token = base::Trim(token);
-  return tokens;
+// Splits |str| at each separator and trims the resulting tokens. The tokens
+// point into |str|. A separator at the end of |str| doesn't start a token.
+void ExtractTokens(std::string_view str,
+                   std::vector<std::string_view>* tokens) {
+  tokens->clear();
+  if (str.empty())
+    return;
+
+  CsvTokenizer tokenizer(str);
+  const char* token_begin = nullptr;
+  const char* token_end = nullptr;
+  while (tokenizer.NextField(&token_begin, &token_end))
+    tokens->push_back(std::string_view(token_begin, token_end - token_begin));
+
+  if (str.back() == kSeparator)
+    tokens->pop_back();
 }
 
-std::wstring ConvertEtlToCsv(const std::wstring& etl_path) {
-  // Generate the name of the CSV file.
-  std::wstring csv_path = etl_path + kCSVFileExtension;
+// Maximum number of bytes that xperf can write ahead of the parser.
+const size_t kXperfPipeBufferSize = 4 * 1024 * 1024;
+
+// Extension of the CSV dump while it is being written.
+const wchar_t kTemporaryFileExtension[] = L".tmp";
+
+// @returns the executable that dumps traces: xperf, unless the XPERF
+//     environment variable names another one, such as a stand-in that writes a
+//     fixture CSV file to its output.
+std::wstring GetXperfPath() {
+  wchar_t path[MAX_PATH] = {};
+  DWORD length = ::GetEnvironmentVariableW(L"XPERF", path, MAX_PATH);
+  if (length == 0 || length >= MAX_PATH)
+    return L"xperf";
+  return std::wstring(path, length);
+}
 
-  // Check if the CSV file already exists.
-  if (base::FilePathExists(csv_path))
-    return csv_path;
+// Reads the CSV dump of a trace from the output of xperf, and writes it to the
+// CSV file of the trace as it is read, so that later analyses of the trace can
+// map it. The CSV file is written under a temporary name, and only gets its
+// final name once xperf has exited successfully.
+class XperfOutputStream : public ByteStream {
+ public:
+  XperfOutputStream() : finished_(false), failed_(false) {}
+
+  // Finishes the CSV file if the stream wasn't read to the end. This waits for
+  // xperf to write the rest of the trace.
+  ~XperfOutputStream() override {
+    char buffer[64 * 1024];
+    size_t bytes_read = 0;
+    while (!finished_ && Read(buffer, sizeof(buffer), &bytes_read)) {
+    }
+  }
 
-  // Tell the user what we are doing.
-  LOG(INFO) << "Converting trace file to CSV format." << std::endl;
+  // Starts xperf.
+  // @param etl_path Path to the .etl file to dump.
+  // @param csv_path Path to the CSV file to write.
+  // @returns true if xperf was started successfully, false otherwise.
+  bool Start(const std::wstring& etl_path, const std::wstring& csv_path) {
+    csv_path_ = csv_path;
+    temporary_csv_path_ = csv_path + kTemporaryFileExtension;
+    csv_file_.open(temporary_csv_path_, std::ios::out | std::ios::binary);
+    if (!csv_file_.is_open()) {
+      LOG(ERROR) << "Unable to create "
+                 << base::WStringToString(temporary_csv_path_) << ".";
+    }
 
-  // Generate the CSV file.
-  base::ChildProcess xperf_process;
-  xperf_process.SetOutputPath(csv_path);
-  std::wstringstream command;
-  command << L"xperf -i \"" << etl_path << "\" -symbols";
-  xperf_process.Run(command.str());
+    xperf_process_.SetOutputPipe(kXperfPipeBufferSize);
+    std::wstringstream command;
+    command << L"\"" << GetXperfPath() << L"\" -i \"" << etl_path
+            << L"\" -symbols";
+    if (!xperf_process_.Run(command.str())) {
+      failed_ = true;
+      return false;
+    }
+    return true;
+  }
 
-  return csv_path;
-}
+  // ByteStream implementation.
+  bool Read(char* buffer, size_t size, size_t* bytes_read) override {
+    if (finished_) {
+      *bytes_read = 0;
+      return false;
+    }
+    if (!xperf_process_.ReadOutput(buffer, size, bytes_read)) {
+      Finish();
+      return false;
+    }
+    if (csv_file_.is_open())
+      csv_file_.write(buffer, *bytes_read);
+    return true;
+  }
+
+  bool failed() const override { return failed_; }
+
+ private:
+  // Checks the exit code of xperf once all its output has been read, and
+  // gives the CSV file its final name if xperf succeeded.
+  void Finish() {
+    finished_ = true;
+    DWORD exit_code = xperf_process_.GetExitCode();
+    if (exit_code != 0) {
+      LOG(ERROR) << "xperf failed with exit code " << exit_code << ".";
+      failed_ = true;
+    }
+
+    if (!csv_file_.is_open())
+      return;
+    csv_file_.close();
+    if (failed_ || csv_file_.fail() ||
+        !base::RenameFile(temporary_csv_path_, csv_path_)) {
+      base::RemoveFile(temporary_csv_path_);
+    }
+  }
+
+  base::ChildProcess xperf_process_;
+
+  // The CSV file, and its final and temporary paths.
+  std::ofstream csv_file_;
+  std::wstring csv_path_;
+  std::wstring temporary_csv_path_;
+
+  // Whether all the output of xperf has been read, and whether xperf failed.
+  bool finished_;
+  bool failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(XperfOutputStream);
+};
 }  // namespace
 
 const char* ETWReader::kEmptyEventType = "Empty";
 
-ETWReader::Line::Line() {}
+ETWReader::Line::Line()
+    : data_(nullptr),
+      type_id_(kUnknownEventTypeId),
+      schema_(nullptr),
+      num_fields_(0) {}
+
+bool ETWReader::Line::GetField(const std::string& name,
+                               std::string_view* value) const {
+  if (schema_ == nullptr || num_fields_ == 0)
+    return false;
+  return GetFieldByIndex(schema_->GetColumnIndex(type_id_, name), value);
+}
 
 bool ETWReader::Line::GetFieldAsString(const std::string& name,
                                        std::string* value) const {
-  auto look = values_.find(name);
-  if (look == values_.end())
+  std::string_view value_view;
+  if (!GetField(name, &value_view))
     return false;
-  *value = look->second;
+  value->assign(value_view.data(), value_view.size());
   return true;
 }
 
 bool ETWReader::Line::GetFieldAsULong(const std::string& name,
                                       uint64_t* value) const {
-  std::string value_str;
-  if (!GetFieldAsString(name, &value_str))
+  std::string_view value_view;
+  if (!GetField(name, &value_view))
     return false;
-  return base::StrToULong(value_str, value);
+  return base::ParseULong(value_view, value) == base::kParseOk;
 }
 
 bool ETWReader::Line::GetFieldAsULongHex(const std::string& name,
                                          uint64_t* value) const {
-  std::string value_str;
-  if (!GetFieldAsString(name, &value_str))
+  std::string_view value_view;
+  if (!GetField(name, &value_view))
     return false;
-  return base::StrToULongHex(value_str, value);
+  return base::ParseULongHex(value_view, value) == base::kParseOk;
 }
 
-ETWReader::Iterator::Iterator() : current_line_index_(kInvalidLineIndex) {}
+ETWReader::Iterator::Iterator()
+    : line_source_(nullptr),
+      schema_(nullptr),
+      ranges_(nullptr),
+      range_index_(0),
+      current_line_index_(kInvalidLineIndex),
+      current_line_offset_(0) {}
 
 bool ETWReader::Iterator::operator==(const ETWReader::Iterator& other) const {
   return current_line_index_ == other.current_line_index_;
@@ -103,116 +226,198 @@ bool ETWReader::Iterator::operator!=(const ETWReader::Iterator& other) const {
 }
 
 ETWReader::Iterator& ETWReader::Iterator::operator++() {
-  // Reset the current line values.
-  current_line_.values_.clear();
-
-  // Read the current line.
-  std::string line;
-  if (!std::getline(file_, line)) {
-    current_line_index_ = kInvalidLineIndex;
-    return *this;
+  // Read lines until one is selected by the subscription.
+  for (;;) {
+    std::string_view line;
+    if (line_source_)
+      current_line_offset_ = line_source_->offset();
+    if (!line_source_ || !SeekToRange() || !line_source_->ReadLine(&line)) {
+      current_line_index_ = kInvalidLineIndex;
+      current_line_.num_fields_ = 0;
+      return *this;
+    }
+    if (ParseLine(line))
+      break;
   }
   ++current_line_index_;
-  auto tokens = ExtractTokens(line);
 
-  // Check if the current line is empty.
-  if (tokens.empty()) {
-    current_line_.type_ = kEmptyEventType;
-    return *this;
-  }
-
-  // Set the current line type.
-  current_line_.type_ = tokens.front();
-
-  // Get the column names for this line type.
-  auto look_column_names = header_.find(current_line_.type());
-  if (look_column_names == header_.end()) {
-    current_line_.values_.clear();
-    return *this;
-  }
-  const auto& column_names = look_column_names->second;
-
-  // Check that we got the expected number of tokens.
-  if ((tokens.size() - 1) < column_names.size()) {
-    LOG(ERROR) << "Unexpected number of tokens for line of type "
-               << current_line_.type() << ".";
-    return *this;
-  }
-
-  // Create a map of Column Name -> Column Value for the current line.
-  for (size_t column_index = 0; column_index < column_names.size();
-       ++column_index) {
-    size_t token_index = column_index + 1;
-    std::string value = tokens[token_index];
-
-    // If this is the last column, use all the remaining tokens as the value.
-    // TODO(fdoray): Find a cleaner solution.
-    if (column_index == column_names.size() - 1) {
-      ++token_index;
-      while (token_index < tokens.size()) {
-        value += ",";
-        value += tokens[token_index];
-        ++token_index;
-      }
-    }
+  return *this;
+}
 
-    current_line_.values_[column_names[column_index]] = value;
+ETWReader::Iterator::Iterator(const ETWReader& reader,
+                              uint64_t first_line_offset,
+                              bool skip_partial_line)
+    : line_reader_(new LineReader),
+      line_source_(line_reader_.get()),
+      schema_(&reader.schema_),
+      ranges_(&reader.ranges_),
+      range_index_(0),
+      current_line_index_(static_cast<size_t>(0)),
+      current_line_offset_(first_line_offset) {
+  current_line_.schema_ = schema_;
+  if (!reader.subscription_.SelectsAll()) {
+    filter_.reset(new SubscriptionFilter(reader.subscription_, *schema_));
+    timestamp_column_ = schema_->ColumnForAllTypes(kTimestampColumn);
   }
 
-  return *this;
-}
+  // Open the CSV file and move to the first line.
+  if (!line_reader_->OpenShared(reader.csv_file_) ||
+      !line_reader_->Seek(first_line_offset)) {
+    current_line_index_ = kInvalidLineIndex;
+    return;
+  }
 
-ETWReader::Iterator::Iterator(const std::wstring& file_path)
-    : current_line_index_(static_cast<size_t>(0)) {
-  // Open the CSV file.
-  file_.open(file_path);
+  // Skip the end of the line that contains |first_line_offset|.
+  if (skip_partial_line) {
+    std::string_view partial_line;
+    line_reader_->ReadLine(&partial_line);
+  }
 
-  // Parse the header.
-  ParseHeader();
+  // Read the first event line.
+  ++(*this);
+}
 
-  // Skip the line with the trace metadata.
-  std::string dummy;
-  std::getline(file_, dummy);
-  ++current_line_index_;
+ETWReader::Iterator::Iterator(const ETWReader& reader,
+                              LineSource* line_source)
+    : line_source_(line_source),
+      schema_(&reader.schema_),
+      ranges_(nullptr),
+      range_index_(0),
+      current_line_index_(static_cast<size_t>(0)),
+      current_line_offset_(line_source->offset()) {
+  current_line_.schema_ = schema_;
+  if (!reader.subscription_.SelectsAll()) {
+    filter_.reset(new SubscriptionFilter(reader.subscription_, *schema_));
+    timestamp_column_ = schema_->ColumnForAllTypes(kTimestampColumn);
+  }
 
   // Read the first event line.
   ++(*this);
 }
 
-void ETWReader::Iterator::ParseHeader() {
-  bool read_first_line = false;
-  std::string line;
-  while (std::getline(file_, line)) {
-    ++current_line_index_;
+bool ETWReader::Iterator::SeekToRange() {
+  if (ranges_ == nullptr)
+    return true;
 
-    // Ignore the first line.
-    if (!read_first_line) {
-      read_first_line = true;
-      continue;
-    }
+  // Find the first range that ends after the next line.
+  while (range_index_ < ranges_->size() &&
+         current_line_offset_ >= (*ranges_)[range_index_].end_offset) {
+    ++range_index_;
+  }
+  if (range_index_ == ranges_->size())
+    return false;
 
-    // Stop when the EndHeader line is encountered.
-    if (line == "EndHeader")
-      break;
+  // Skip the lines that precede the range.
+  const TimestampIndex::Range& range = (*ranges_)[range_index_];
+  if (current_line_offset_ < range.begin_offset) {
+    if (!line_reader_->Seek(range.begin_offset))
+      return false;
+    current_line_offset_ = range.begin_offset;
+  }
 
-    // Extract tokens names from the line.
-    auto tokens = ExtractTokens(line);
+  if (filter_)
+    filter_->set_outside_window(!range.in_window);
+  return true;
+}
+
+bool ETWReader::Iterator::ParseLine(std::string_view line) {
+  Line& current_line = current_line_;
+  current_line.data_ = line.data();
+  current_line.num_fields_ = 0;
+
+  CsvTokenizer tokenizer(line);
 
-    // The first token is the line type.
-    auto type = tokens.front();
+  // The first token is the line type.
+  const char* type_begin = nullptr;
+  const char* type_end = nullptr;
+  tokenizer.NextField(&type_begin, &type_end);
+  const bool has_fields = !tokenizer.AtEnd();
 
-    // The other tokens are column names.
-    auto column_names =
-        std::vector<std::string>(tokens.begin() + 1, tokens.end());
+  // Check if the current line is empty.
+  if (type_begin == type_end && !has_fields) {
+    current_line.type_ = kEmptyEventType;
+    current_line.type_id_ = kEmptyEventTypeId;
+    return true;
+  }
 
-    // Save the Line type -> Column names pair.
-    header_[type] = column_names;
+  current_line.type_ = std::string_view(type_begin, type_end - type_begin);
+  current_line.type_id_ = schema_->GetTypeId(current_line.type_);
+
+  // Select the line from its type. If the timestamp of the line must be
+  // checked, it is checked as soon as it is read.
+  size_t timestamp_index = kInvalidColumnIndex;
+  if (filter_) {
+    SubscriptionFilter::TypeSelection selection =
+        filter_->SelectType(current_line.type_id_);
+    if (selection == SubscriptionFilter::kSkipped)
+      return false;
+    if (selection == SubscriptionFilter::kNeedsTimestamp)
+      timestamp_index = timestamp_column_.IndexForType(current_line.type_id_);
   }
+
+  if (current_line.type_id_ == kUnknownEventTypeId)
+    return true;
+
+  // Split the rest of the line in as many fields as there are columns. The
+  // last column gets everything that follows the previous separator, since
+  // its values may contain separators.
+  const size_t num_columns = schema_->GetNumColumns(current_line.type_id_);
+  for (size_t column_index = 0; column_index < num_columns; ++column_index) {
+    const bool is_last_column = column_index == num_columns - 1;
+    if (tokenizer.AtEnd()) {
+      LOG(ERROR) << "Unexpected number of tokens for line of type "
+                 << current_line.type() << ".";
+      return true;
+    }
+    const char* field_begin = nullptr;
+    const char* field_end = nullptr;
+    if (is_last_column)
+      tokenizer.RestOfLine(&field_begin, &field_end);
+    else
+      tokenizer.NextField(&field_begin, &field_end);
+    current_line.field_begin_[column_index] =
+        static_cast<uint32_t>(field_begin - line.data());
+    current_line.field_end_[column_index] =
+        static_cast<uint32_t>(field_end - line.data());
+
+    if (column_index == timestamp_index) {
+      uint64_t ts = 0;
+      if (base::ParseULong(std::string_view(field_begin,
+                                            field_end - field_begin),
+                           &ts) == base::kParseOk &&
+          !filter_->SelectTimestamp(ts)) {
+        return false;
+      }
+    }
+  }
+  current_line.num_fields_ = num_columns;
+  return true;
 }
 
-ETWReader::ETWReader() {}
+ETWReader::ETWReader()
+    : first_event_offset_(0) {}
+
+std::wstring ETWReader::CsvPathForTrace(const std::wstring& trace_path) {
+  return trace_path + kCSVFileExtension;
+}
+
+bool ETWReader::GetSourceSizeAndLastWriteTime(const std::wstring& trace_path,
+                                              uint64_t* size,
+                                              uint64_t* last_write_time) {
+  std::wstring csv_path = CsvPathForTrace(trace_path);
+  const std::wstring& source_path =
+      base::FilePathExists(csv_path) ? csv_path : trace_path;
+  return base::GetFileSizeAndLastWriteTime(source_path, size, last_write_time);
+}
 
 bool ETWReader::Open(const std::wstring& trace_path) {
+  return Open(trace_path, Subscription());
+}
+
+bool ETWReader::Open(const std::wstring& trace_path,
+                     const Subscription& subscription) {
+  subscription_ = subscription;
+
   // Check that the ETL file exists.
   if (!base::FilePathExists(trace_path)) {
     LOG(ERROR) << "Trace file " << base::WStringToString(trace_path)
@@ -220,15 +425,111 @@ bool ETWReader::Open(const std::wstring& trace_path) {
     return false;
   }
 
-  // Convert the ETL file to CSV.
-  csv_file_path_ = ConvertEtlToCsv(trace_path);
+  // Use the CSV dump of the trace if it exists.
+  std::wstring csv_path = CsvPathForTrace(trace_path);
+  if (base::FilePathExists(csv_path)) {
+    if (!OpenCsv(csv_path, subscription))
+      return false;
+
+    // Find the ranges of the file that contain the selected lines.
+    TimestampIndex index;
+    if (subscription_.HasWindow() &&
+        index.Load(trace_path, schema_, first_event_offset_)) {
+      ranges_.clear();
+      index.GetRanges(subscription_, schema_, &ranges_);
+    }
+    return true;
+  }
+
+  // Otherwise, parse the output of xperf as it is produced, and write it to
+  // the CSV file for the next analyses of the trace.
+  LOG(INFO) << "Converting trace file to CSV format." << std::endl;
+  std::unique_ptr<XperfOutputStream> xperf_output(new XperfOutputStream);
+  if (!xperf_output->Start(trace_path, csv_path)) {
+    LOG(ERROR) << "Unable to run xperf.";
+    return false;
+  }
+  return OpenStream(std::move(xperf_output), subscription);
+}
+
+bool ETWReader::OpenCsv(const std::wstring& csv_path,
+                        const Subscription& subscription) {
+  subscription_ = subscription;
+  csv_file_path_ = csv_path;
+  LineReader line_reader;
+  if (!csv_file_.Open(csv_file_path_) || !line_reader.OpenShared(csv_file_) ||
+      !ParseHeader(&line_reader)) {
+    return false;
+  }
+
+  ranges_.clear();
+  ranges_.push_back({first_event_offset_, UINT64_MAX, true});
+  return true;
+}
+
+bool ETWReader::OpenStream(std::unique_ptr<ByteStream> stream,
+                           const Subscription& subscription) {
+  subscription_ = subscription;
+  stream_reader_.reset(new StreamLineReader(std::move(stream)));
+  return ParseHeader(stream_reader_.get());
+}
 
+bool ETWReader::ParseHeader(LineSource* line_source) {
+  std::vector<std::string_view> tokens;
+  bool read_first_line = false;
+  std::string_view line;
+  while (line_source->ReadLine(&line)) {
+    // Ignore the first line.
+    if (!read_first_line) {
+      read_first_line = true;
+      continue;
+    }
+
+    // Stop when the EndHeader line is encountered.
+    if (line == "EndHeader")
+      break;
+
+    // Extract tokens names from the line.
+    ExtractTokens(line, &tokens);
+    if (tokens.empty())
+      continue;
+
+    // The first token is the line type. The other tokens are column names.
+    schema_.AddType(tokens.front(), std::vector<std::string_view>(
+                                        tokens.begin() + 1, tokens.end()));
+  }
+
+  // Skip the line with the trace metadata.
+  line_source->ReadLine(&line);
+
+  first_event_offset_ = line_source->offset();
   return true;
 }
 
 ETWReader::Iterator ETWReader::begin() const {
+  if (is_stream())
+    return Iterator(*this, stream_reader_.get());
+  DCHECK(!csv_file_path_.empty());
+  if (ranges_.empty())
+    return end();
+  return Iterator(*this, begin_offset(), false);
+}
+
+ETWReader::Iterator ETWReader::IteratorFrom(uint64_t offset) const {
+  DCHECK(!is_stream());
   DCHECK(!csv_file_path_.empty());
-  return Iterator(csv_file_path_);
+  if (offset <= begin_offset())
+    return begin();
+
+  // Start from the previous byte. If it is an end of line, the first line
+  // starts exactly at |offset|.
+  return Iterator(*this, offset - 1, true);
+}
+
+uint64_t ETWReader::begin_offset() const {
+  if (ranges_.empty())
+    return first_event_offset_;
+  return ranges_.front().begin_offset;
 }
 
 ETWReader::Iterator ETWReader::end() const {
@@ -16,13 +16,20 @@ limitations under the License.
 
 #pragma once
 
-#include <fstream>
 #include <memory>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
 #include "base/base.h"
+#include "base/memory_mapped_file.h"
+#include "base/numeric_conversions.h"
+#include "etw_reader/event_schema.h"
+#include "etw_reader/line_reader.h"
+#include "etw_reader/line_source.h"
+#include "etw_reader/stream_line_reader.h"
+#include "etw_reader/subscription.h"
+#include "etw_reader/timestamp_index.h"
 
 namespace etw_insights {
 
@@ -31,13 +38,55 @@ class ETWReader {
  public:
   class Iterator;
 
-  // A line of an ETW trace dumped into a CSV file.
+  // A line of an ETW trace dumped into a CSV file. The type and the values of
+  // a line point directly into the mapped CSV file, or into the buffer of the
+  // stream it is read from. They are only valid until
+  // the iterator that produced the line is incremented.
   class Line {
    public:
     Line();
 
-    const std::string& type() const { return type_; }
+    std::string_view type() const { return type_; }
+    EventTypeId type_id() const { return type_id_; }
 
+    // Reads a field of the line. Columns bound with ETWReader::Column() are
+    // read without any lookup. Numbers are converted in place, without
+    // allocating memory. The conversions return false if the line doesn't
+    // have the column or if its value isn't a number.
+    bool GetField(const ColumnRef& column, std::string_view* value) const {
+      if (column.type_id != type_id_)
+        return false;
+      return GetFieldByIndex(column.index, value);
+    }
+    bool GetField(const AnyTypeColumnRef& column,
+                  std::string_view* value) const {
+      return GetFieldByIndex(column.IndexForType(type_id_), value);
+    }
+    bool GetFieldAsULong(const ColumnRef& column, uint64_t* value) const {
+      std::string_view value_view;
+      return GetField(column, &value_view) &&
+             base::ParseULong(value_view, value) == base::kParseOk;
+    }
+    bool GetFieldAsULong(const AnyTypeColumnRef& column,
+                         uint64_t* value) const {
+      std::string_view value_view;
+      return GetField(column, &value_view) &&
+             base::ParseULong(value_view, value) == base::kParseOk;
+    }
+    bool GetFieldAsULongHex(const ColumnRef& column, uint64_t* value) const {
+      std::string_view value_view;
+      return GetField(column, &value_view) &&
+             base::ParseULongHex(value_view, value) == base::kParseOk;
+    }
+    bool GetFieldAsULongHex(const AnyTypeColumnRef& column,
+                            uint64_t* value) const {
+      std::string_view value_view;
+      return GetField(column, &value_view) &&
+             base::ParseULongHex(value_view, value) == base::kParseOk;
+    }
+
+    // Reads a field of the line by column name.
+    bool GetField(const std::string& name, std::string_view* value) const;
     bool GetFieldAsString(const std::string& name, std::string* value) const;
     bool GetFieldAsULong(const std::string& name, uint64_t* value) const;
     bool GetFieldAsULongHex(const std::string& name, uint64_t* value) const;
@@ -45,14 +94,38 @@ class ETWReader {
    private:
     friend class etw_insights::ETWReader::Iterator;
 
-    std::string type_;
-    std::unordered_map<std::string, std::string> values_;
+    // @param index index of a column.
+    // @param value value of the column, output.
+    // @returns true if the line has a value for the column.
+    bool GetFieldByIndex(size_t index, std::string_view* value) const {
+      if (index >= num_fields_)
+        return false;
+      *value = std::string_view(data_ + field_begin_[index],
+                                field_end_[index] - field_begin_[index]);
+      return true;
+    }
+
+    // Raw line.
+    const char* data_;
+
+    std::string_view type_;
+    EventTypeId type_id_;
+
+    // Schema of the trace.
+    const EventSchema* schema_;
+
+    // Offsets of the beginning and end of each field, relative to |data_|, in
+    // the order of the columns of the line type.
+    size_t num_fields_;
+    uint32_t field_begin_[EventSchema::kMaxColumns];
+    uint32_t field_end_[EventSchema::kMaxColumns];
   };
 
   // Iterates through the events of an ETW trace.
   class Iterator {
    public:
     Iterator();
+    Iterator(Iterator&& other) = default;
 
     const Line& operator*() const { return current_line_; }
     const Line* operator->() const { return &current_line_; }
@@ -60,46 +133,193 @@ class ETWReader {
     bool operator!=(const Iterator& other) const;
     Iterator& operator++();
 
+    // @returns the offset of the current line in the CSV file.
+    uint64_t offset() const { return current_line_offset_; }
+
    private:
     friend class etw_insights::ETWReader;
 
-    Iterator(const std::wstring& file_path);
+    Iterator(const ETWReader& reader,
+             uint64_t first_line_offset,
+             bool skip_partial_line);
+
+    // Iterates through the lines of a source owned by the ETWReader.
+    Iterator(const ETWReader& reader, LineSource* line_source);
+
+    // Moves to the range of the CSV file that contains the next line, or to
+    // the beginning of the next range if the next line isn't in a range.
+    // @returns false if there is no range after the next line.
+    bool SeekToRange();
+
+    // Splits a line in fields, according to the columns of its type.
+    // @returns false if the line isn't selected by the subscription.
+    bool ParseLine(std::string_view line);
+
+    // Reader for the lines of the CSV file, when the iterator owns it.
+    std::unique_ptr<LineReader> line_reader_;
 
-    void ParseHeader();
+    // Source of the lines.
+    LineSource* line_source_;
 
-    // CSV file stream.
-    std::ifstream file_;
+    // Schema of the trace.
+    const EventSchema* schema_;
 
-    // CSV header: Line type -> Column names.
-    std::unordered_map<std::string, std::vector<std::string>> header_;
+    // Selects the lines of the subscription. Null when all lines are
+    // selected.
+    std::unique_ptr<SubscriptionFilter> filter_;
+
+    // Timestamp column, read to select the lines in the window of the
+    // subscription.
+    AnyTypeColumnRef timestamp_column_;
+
+    // Ranges of the CSV file to read, and index of the range of the current
+    // line. Null when the lines are read from a stream.
+    const std::vector<TimestampIndex::Range>* ranges_;
+    size_t range_index_;
 
     // Current line index.
     size_t current_line_index_;
 
+    // Offset of the current line in the CSV file.
+    uint64_t current_line_offset_;
+
     // Current line.
     Line current_line_;
+
+    DISALLOW_COPY_AND_ASSIGN(Iterator);
   };
 
   ETWReader();
 
-  // Opens an ETW trace.
+  // Opens an ETW trace and parses its header. If the trace hasn't been dumped
+  // into a CSV file yet, the output of xperf is parsed as it is produced, and
+  // written to the CSV file for the next analyses of the trace. The CSV file
+  // is only complete once xperf exits: if the trace isn't read to the end,
+  // the rest of the output of xperf is written when the reader is destroyed.
   // @param trace_path Path to a .etl file.
   // @returns true if the trace was opened successfully, false otherwise.
   bool Open(const std::wstring& trace_path);
 
+  // Opens an ETW trace whose iterators only produce the lines selected by
+  // |subscription|. The lines of other types are skipped after reading their
+  // type, and the lines outside of the window after reading their timestamp.
+  // Empty lines are always produced. When the subscription has a window, a
+  // sparse index of the timestamps and event types of the CSV dump is used,
+  // and built if needed: outside of the window, only the parts of the trace
+  // that have lines of the types read in the whole trace are read.
+  // @param trace_path Path to a .etl file.
+  // @param subscription the events to read.
+  // @returns true if the trace was opened successfully, false otherwise.
+  bool Open(const std::wstring& trace_path, const Subscription& subscription);
+
+  // Opens a CSV dump of an ETW trace that isn't next to its trace, and parses
+  // its header. The timestamp index isn't used: the whole file is read.
+  // @param csv_path Path to the CSV dump.
+  // @param subscription the events to read.
+  // @returns true if the CSV dump was opened successfully, false otherwise.
+  bool OpenCsv(const std::wstring& csv_path, const Subscription& subscription);
+
+  // Opens a CSV dump of an ETW trace that is read from a stream, and parses
+  // its header.
+  // @param stream the CSV dump.
+  // @param subscription the events to read.
+  // @returns true if the header was parsed successfully, false otherwise.
+  bool OpenStream(std::unique_ptr<ByteStream> stream,
+                  const Subscription& subscription);
+
+  // @returns true if the trace is read from a stream. The events of a stream
+  //     can only be iterated once, in order: IteratorFrom() isn't supported.
+  bool is_stream() const { return stream_reader_ != nullptr; }
+
+  // @returns true if the stream from which the trace is read ended with an
+  //     error, such as a failure of xperf. Valid once all the lines have been
+  //     read.
+  bool stream_failed() const {
+    return stream_reader_ != nullptr && stream_reader_->failed();
+  }
+
+  // @returns the event types and columns of the trace. Valid after Open().
+  const EventSchema& schema() const { return schema_; }
+
+  // Binds a column of an event type, so that it can be read without any
+  // lookup. Valid after Open().
+  ColumnRef Column(std::string_view type_name,
+                   std::string_view column_name) const {
+    return schema_.Column(type_name, column_name);
+  }
+
+  // Binds a column in all event types that have it. Valid after Open().
+  AnyTypeColumnRef ColumnForAllTypes(std::string_view column_name) const {
+    return schema_.ColumnForAllTypes(column_name);
+  }
+
   // Returns an iterator to the first event of an ETW trace.
   Iterator begin() const;
 
+  // Returns an iterator to the first line that starts at or after |offset| in
+  // the CSV file.
+  Iterator IteratorFrom(uint64_t offset) const;
+
+  // @returns the offset of the first event in the CSV file.
+  uint64_t first_event_offset() const { return first_event_offset_; }
+
+  // @returns the offset of the first line read by iterators. Iterators skip
+  //     the parts of the CSV file that don't have any line selected by the
+  //     subscription, according to the timestamp index.
+  uint64_t begin_offset() const;
+
   // Returns an iterator to the end of an ETW trace.
   Iterator end() const;
 
+  // @param trace_path Path to a .etl file.
+  // @returns the path of the CSV dump of the trace.
+  static std::wstring CsvPathForTrace(const std::wstring& trace_path);
+
+  // Reads the size and last write time of the file from which the events of a
+  // trace are decoded: its CSV dump if there is one, otherwise the .etl file,
+  // whose xperf output is parsed directly. Files derived from a trace record
+  // them to detect that they are out of date.
+  // @param trace_path Path to a .etl file.
+  // @param size the size of the file, output.
+  // @param last_write_time the last write time of the file, output.
+  // @returns true if the attributes of the file were read, false otherwise.
+  static bool GetSourceSizeAndLastWriteTime(const std::wstring& trace_path,
+                                            uint64_t* size,
+                                            uint64_t* last_write_time);
+
   // Empty event type.
   static const char* kEmptyEventType;
 
  private:
+  // Parses the header of the CSV dump.
+  // @param line_source the lines of the CSV dump.
+  // @returns true if successful, false otherwise.
+  bool ParseHeader(LineSource* line_source);
+
   // Path to the CSV dump of an ETW trace.
   std::wstring csv_file_path_;
 
+  // The CSV dump, opened once and shared by all the iterators, which map
+  // their own views of it.
+  base::MemoryMappedFile csv_file_;
+
+  // Reader for the CSV dump, when it is read from a stream.
+  std::unique_ptr<StreamLineReader> stream_reader_;
+
+  // Events to read.
+  Subscription subscription_;
+
+  // Ranges of the CSV file that contain the lines selected by the
+  // subscription, from the timestamp index. The whole file if there is no
+  // window or no index.
+  std::vector<TimestampIndex::Range> ranges_;
+
+  // Event types and columns, from the header of the CSV file.
+  EventSchema schema_;
+
+  // Offset of the first event in the CSV file.
+  uint64_t first_event_offset_;
+
   DISALLOW_COPY_AND_ASSIGN(ETWReader);
 };
 
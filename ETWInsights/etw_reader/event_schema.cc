@@ -0,0 +1,106 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "etw_reader/event_schema.h"
+
+#include "base/logging.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Names of the reserved event types.
+const char kEmptyEventTypeName[] = "Empty";
+const char kUnknownEventTypeName[] = "";
+
+}  // namespace
+
+EventSchema::EventSchema() {
+  types_.emplace_back(new EventType);
+  types_.back()->name = kEmptyEventTypeName;
+  types_.emplace_back(new EventType);
+  types_.back()->name = kUnknownEventTypeName;
+}
+
+EventTypeId EventSchema::AddType(
+    std::string_view name,
+    const std::vector<std::string_view>& column_names) {
+  EventTypeId type_id = GetTypeId(name);
+  if (type_id == kUnknownEventTypeId) {
+    type_id = static_cast<EventTypeId>(types_.size());
+    types_.emplace_back(new EventType);
+    types_.back()->name = std::string(name);
+    type_ids_.insert({types_.back()->name, type_id});
+  }
+
+  EventType& type = *types_[type_id];
+  type.column_names.assign(column_names.begin(), column_names.end());
+  if (type.column_names.size() > kMaxColumns) {
+    LOG(WARNING) << "Event type " << name << " has "
+                 << type.column_names.size() << " columns. Only the first "
+                 << kMaxColumns << " will be readable.";
+    type.column_names.resize(kMaxColumns);
+  }
+
+  return type_id;
+}
+
+EventTypeId EventSchema::GetTypeId(std::string_view name) const {
+  auto look = type_ids_.find(name);
+  if (look == type_ids_.end())
+    return kUnknownEventTypeId;
+  return look->second;
+}
+
+const std::string& EventSchema::GetTypeName(EventTypeId type_id) const {
+  DCHECK_LT(type_id, types_.size());
+  return types_[type_id]->name;
+}
+
+size_t EventSchema::GetNumColumns(EventTypeId type_id) const {
+  DCHECK_LT(type_id, types_.size());
+  return types_[type_id]->column_names.size();
+}
+
+size_t EventSchema::GetColumnIndex(EventTypeId type_id,
+                                   std::string_view column_name) const {
+  DCHECK_LT(type_id, types_.size());
+  const auto& column_names = types_[type_id]->column_names;
+  for (size_t index = 0; index < column_names.size(); ++index) {
+    if (column_names[index] == column_name)
+      return index;
+  }
+  return kInvalidColumnIndex;
+}
+
+ColumnRef EventSchema::Column(std::string_view type_name,
+                              std::string_view column_name) const {
+  EventTypeId type_id = GetTypeId(type_name);
+  if (type_id == kUnknownEventTypeId)
+    return ColumnRef();
+  return ColumnRef(type_id, GetColumnIndex(type_id, column_name));
+}
+
+AnyTypeColumnRef EventSchema::ColumnForAllTypes(
+    std::string_view column_name) const {
+  AnyTypeColumnRef column;
+  column.indexes_.resize(types_.size(), kInvalidColumnIndex);
+  for (EventTypeId type_id = 0; type_id < types_.size(); ++type_id)
+    column.indexes_[type_id] = GetColumnIndex(type_id, column_name);
+  return column;
+}
+
+}  // namespace etw_insights
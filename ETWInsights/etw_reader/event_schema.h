@@ -0,0 +1,147 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "base/base.h"
+
+namespace etw_insights {
+
+// Identifies an event type of a trace. Ids are assigned when the header of
+// the trace is parsed.
+typedef uint32_t EventTypeId;
+
+// Id of empty lines.
+const EventTypeId kEmptyEventTypeId = 0;
+
+// Id of lines whose type doesn't appear in the header of the trace.
+const EventTypeId kUnknownEventTypeId = 1;
+
+// Invalid column index.
+const size_t kInvalidColumnIndex = static_cast<size_t>(-1);
+
+// Refers to a column of a specific event type.
+struct ColumnRef {
+  ColumnRef() : type_id(kUnknownEventTypeId), index(kInvalidColumnIndex) {}
+  ColumnRef(EventTypeId type_id, size_t index)
+      : type_id(type_id), index(index) {}
+
+  bool IsValid() const { return index != kInvalidColumnIndex; }
+
+  EventTypeId type_id;
+  size_t index;
+};
+
+// Refers to a column that has the same name in several event types (e.g.
+// "TimeStamp").
+class AnyTypeColumnRef {
+ public:
+  AnyTypeColumnRef() {}
+
+  // @param type_id an event type id.
+  // @returns the index of the column in events of type |type_id|, or
+  //     kInvalidColumnIndex if these events don't have this column.
+  size_t IndexForType(EventTypeId type_id) const {
+    if (type_id >= indexes_.size())
+      return kInvalidColumnIndex;
+    return indexes_[type_id];
+  }
+
+ private:
+  friend class EventSchema;
+
+  // Event type id -> Column index.
+  std::vector<size_t> indexes_;
+};
+
+// Event types and columns of a trace, as declared in the header of its CSV
+// dump.
+class EventSchema {
+ public:
+  // Maximum number of columns of an event type. Columns that come after are
+  // merged in the last column.
+  static const size_t kMaxColumns = 64;
+
+  EventSchema();
+
+  // Adds an event type to the schema.
+  // @param name name of the event type.
+  // @param column_names names of the columns of the event type.
+  // @returns the id of the event type.
+  EventTypeId AddType(std::string_view name,
+                      const std::vector<std::string_view>& column_names);
+
+  // @param name name of an event type.
+  // @returns the id of the event type, or kUnknownEventTypeId if it isn't in
+  //     the schema.
+  EventTypeId GetTypeId(std::string_view name) const;
+
+  // @param type_id an event type id.
+  // @returns the name of the event type.
+  const std::string& GetTypeName(EventTypeId type_id) const;
+
+  // @param type_id an event type id.
+  // @returns the number of columns of the event type.
+  size_t GetNumColumns(EventTypeId type_id) const;
+
+  // @param type_id an event type id.
+  // @param column_name name of a column.
+  // @returns the index of the column for the event type, or
+  //     kInvalidColumnIndex if it doesn't exist.
+  size_t GetColumnIndex(EventTypeId type_id,
+                        std::string_view column_name) const;
+
+  // @returns the number of event types, including the empty and unknown
+  //     types. Event type ids are smaller than this number.
+  size_t num_types() const { return types_.size(); }
+
+  // Binds a column of an event type.
+  // @param type_name name of an event type.
+  // @param column_name name of a column.
+  // @returns a reference to the column. Invalid if the event type or the
+  //     column doesn't exist.
+  ColumnRef Column(std::string_view type_name,
+                   std::string_view column_name) const;
+
+  // Binds a column in all event types that have it.
+  // @param column_name name of a column.
+  // @returns a reference to the column.
+  AnyTypeColumnRef ColumnForAllTypes(std::string_view column_name) const;
+
+ private:
+  struct EventType {
+    std::string name;
+    std::vector<std::string> column_names;
+  };
+
+  // Event types, indexed by id. Allocated separately so that the keys of
+  // |type_ids_| remain valid when the vector grows.
+  std::vector<std::unique_ptr<EventType>> types_;
+
+  // Event type name -> Event type id. Keys point to the names in |types_|.
+  std::unordered_map<std::string_view, EventTypeId> type_ids_;
+
+  DISALLOW_COPY_AND_ASSIGN(EventSchema);
+};
+
+}  // namespace etw_insights
@@ -0,0 +1,63 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "etw_reader/frame_table.h"
+
+#include "base/logging.h"
+
+namespace etw_insights {
+
+FrameTable::FrameTable()
+    : view_offsets_(nullptr),
+      view_data_(nullptr),
+      view_size_(0),
+      is_view_(false) {}
+
+void FrameTable::SetView(const uint64_t* offsets,
+                         const char* data,
+                         size_t num_frames) {
+  frames_.clear();
+  frame_ids_.clear();
+  view_offsets_ = offsets;
+  view_data_ = data;
+  view_size_ = num_frames;
+  is_view_ = true;
+}
+
+FrameId FrameTable::GetFrameId(std::string_view frame) {
+  DCHECK(!is_view_);
+  auto look = frame_ids_.find(frame);
+  if (look != frame_ids_.end())
+    return look->second;
+
+  FrameId frame_id = static_cast<FrameId>(frames_.size());
+  frames_.emplace_back(frame);
+  frame_ids_.insert({frames_.back(), frame_id});
+  return frame_id;
+}
+
+std::string_view FrameTable::GetFrame(FrameId frame_id) const {
+  DCHECK_LT(frame_id, size());
+  if (is_view_) {
+    return std::string_view(
+        view_data_ + view_offsets_[frame_id],
+        static_cast<size_t>(view_offsets_[frame_id + 1] -
+                            view_offsets_[frame_id]));
+  }
+  return frames_[frame_id];
+}
+
+}  // namespace etw_insights
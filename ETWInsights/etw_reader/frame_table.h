@@ -0,0 +1,78 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "base/base.h"
+
+namespace etw_insights {
+
+// Identifies a stack frame in a FrameTable.
+typedef uint32_t FrameId;
+
+// Table of the stack frames of a trace. Each distinct frame is stored once
+// and identified by a 32-bit id. A table can also be a read-only view of
+// frames stored elsewhere, e.g. in a memory-mapped file.
+class FrameTable {
+ public:
+  FrameTable();
+
+  // Makes the table a read-only view of frames stored elsewhere. No frame can
+  // be added to a view.
+  // @param offsets offsets of the frames in |data|. Frame i ends where frame
+  //     i + 1 begins. Contains |num_frames| + 1 elements. Must outlive the
+  //     table.
+  // @param data characters of the frames. Must outlive the table.
+  // @param num_frames number of frames.
+  void SetView(const uint64_t* offsets, const char* data, size_t num_frames);
+
+  // @param frame a stack frame, e.g. "chrome.dll!base::MessageLoop::RunTask".
+  // @returns the id of the frame. The frame is added to the table if it isn't
+  //     already in it.
+  FrameId GetFrameId(std::string_view frame);
+
+  // @param frame_id a frame id returned by GetFrameId().
+  // @returns the frame.
+  std::string_view GetFrame(FrameId frame_id) const;
+
+  // @returns the number of frames in the table. Frame ids are smaller than
+  //     this number.
+  size_t size() const { return is_view_ ? view_size_ : frames_.size(); }
+
+ private:
+  // Frames, indexed by id. A deque doesn't move its elements when it grows,
+  // so the keys of |frame_ids_| remain valid.
+  std::deque<std::string> frames_;
+
+  // Frame -> Frame id. Keys point to the frames in |frames_|.
+  std::unordered_map<std::string_view, FrameId> frame_ids_;
+
+  // Frames of a view, stored outside of the table.
+  const uint64_t* view_offsets_;
+  const char* view_data_;
+  size_t view_size_;
+  bool is_view_;
+
+  DISALLOW_COPY_AND_ASSIGN(FrameTable);
+};
+
+}  // namespace etw_insights
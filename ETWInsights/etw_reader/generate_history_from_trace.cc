@@ -16,14 +16,17 @@ limitations under the License.
 
 #include "etw_reader/generate_history_from_trace.h"
 
-#include <map>
+#include <future>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
-#include "base/numeric_conversions.h"
-#include "base/string_utils.h"
+#include "base/logging.h"
+#include "base/ring_buffer.h"
+#include "base/thread_pool.h"
 #include "base/types.h"
-#include "etw_reader/etw_reader.h"
+#include "etw_reader/system_history_snapshot.h"
+#include "etw_reader/trace_event_decoder.h"
 
 namespace etw_insights {
 
@@ -32,66 +35,36 @@ namespace {
 // [Off-CPU] stack frame.
 const char kOffCpuStackFrame[] = "[Off-CPU]";
 
-// Generic event fields.
-const char kTimestampField[] = "TimeStamp";
-const char kThreadIDField[] = "ThreadID";
-const char kProcessNameField[] = "Process Name ( PID)";
-
-// Stack event.
-const char kStackType[] = "Stack";
-const char kStackSymbolField[] = "Image!Function";
-
-// Sampled profile event.
+// Event types referenced by the stack handler.
 const char kSampledProfileType[] = "SampledProfile";
-
-// CSwitch event.
 const char kCSwitchType[] = "CSwitch";
-const char kCSwitchNewTidField[] = "New TID";
-const char kCSwitchOldTidField[] = "Old TID";
-const char kCSwitchTimeSinceLastField[] = "TmSinceLast";
-
-// Process start event.
-const char kProcessStartType[] = "P-Start";
-const char kProcessDCStartType[] = "P-DCStart";
-
-// Thread start event.
-const char kThreadStartType[] = "T-Start";
-const char kThreadDCStartType[] = "T-DCStart";
-
-// Thread end event.
-const char kThreadEndType[] = "T-End";
-const char kThreadDCEndType[] = "T-DCEnd";
-
-// FileIo events.
-const char kFileIoCreateType[] = "FileIoCreate";
-const char kFileIoCleanupType[] = "FileIoCleanup";
-const char kFileIoCloseType[] = "FileIoClose";
-const char kFileIoFlushType[] = "FileIoFlush";
-const char kFileIoReadType[] = "FileIoRead";
-const char kFileIoWriteType[] = "FileIoWrite";
-const char kFileIoSetInfoType[] = "FileIoSetInfo";
-const char kFileIoQueryInfoType[] = "FileIoQueryInfo";
-const char kFileIoFSCTLType[] = "FileIoFSCTL";
-const char kFileIoDeleteType[] = "FileIoDelete";
-const char kFileIoRenameType[] = "FileIoRename";
-const char kFileIoDirEnumType[] = "FileIoDirEnum";
-const char kFileIoDirNotifyType[] = "FileIoDirNotify";
-const char kFileIoOpEnd[] = "FileIoOpEnd";
-const char kFileIoFileNameField[] = "FileName";
-const char kFileIoTypeField[] = "Type";
-const char kFileIoLoggingThreadIdField[] = "LoggingThreadID";
-
-// Chrome events.
-const char kChromeType[] = "Chrome//win:Info";
-const char kChromeNameField[] = "Name";
-const char kChromePhaseField[] = "Phase";
-const char kChromeNonEmptyPaint[] =
-    "\"Startup.FirstWebContents.NonEmptyPaint\"";
-const char kChromePhaseAsyncBegin[] = "\"Async End\"";
 
 // Unknown stack frame.
 const char kUnknownStackFrame[] = "[Unknown]";
 
+// Time before a window during which call stacks and context switches are
+// read, in microseconds, so that the call stack that each thread is running
+// when the window starts is known: any thread that runs during that time has
+// sampled or context switch stacks.
+const base::Timestamp kStackLookback = 100 * 1000;
+
+// Number of recent events remembered for each thread. The lines of a stack
+// closely follow the event that they belong to, so only the last events of a
+// thread are looked up.
+const size_t kNumRecentEvents = 16;
+
+// An event encountered on a thread.
+struct RecentEvent {
+  base::Timestamp ts;
+  EventTypeId type_id;
+};
+
+// Timestamp of the last switch out that occurred before a switch in.
+struct SwitchIn {
+  base::Timestamp switch_in_ts;
+  base::Timestamp switch_out_ts;
+};
+
 // State of a thread.
 struct ThreadState {
   ThreadState() {}
@@ -99,123 +72,118 @@ struct ThreadState {
   // Active file operation.
   std::string file_operation;
 
-  // Last events encountered on the thread (timestamp -> type).
-  std::map<base::Timestamp, std::string> last_events;
+  // Last events encountered on the thread.
+  base::RingBuffer<RecentEvent, kNumRecentEvents> last_events;
 
-  // Timestamp of the last switch out that occurred before each switch in.
-  // (Switch in ts -> Switch out ts).
-  std::map<base::Timestamp, base::Timestamp> last_switch_out_before_switch_in_;
+  // Last switches in of the thread.
+  base::RingBuffer<SwitchIn, kNumRecentEvents> last_switches_in;
 };
 
 typedef std::unordered_map<base::Tid, ThreadState> ThreadStates;
 
-Stack ConcatenateStacks(std::initializer_list<Stack> stacks) {
-  Stack stack_res;
-  for (const auto& stack : stacks)
-    stack_res.insert(stack_res.end(), stack.begin(), stack.end());
-  return stack_res;
-}
+// State of the traversal of a trace, shared by the event handlers.
+struct TraceContext {
+  TraceContext(const EventSchema& schema, SystemHistory* system_history)
+      : sampled_profile_type_id(schema.GetTypeId(kSampledProfileType)),
+        cswitch_type_id(schema.GetTypeId(kCSwitchType)),
+        off_cpu_frame_id(
+            system_history->stack_trie().GetFrameId(kOffCpuStackFrame)),
+        unknown_frame_id(
+            system_history->stack_trie().GetFrameId(kUnknownStackFrame)),
+        system_history(system_history),
+        should_stop(false) {}
+
+  // Ids of the event types referenced by the stack handler.
+  EventTypeId sampled_profile_type_id;
+  EventTypeId cswitch_type_id;
+
+  // Ids of the synthetic stack frames.
+  FrameId off_cpu_frame_id;
+  FrameId unknown_frame_id;
 
-void SplitProcessNameField(const std::string& value,
-                           std::string* process_name,
-                           base::Pid* pid) {
-  auto tokens = base::SplitString(value, " ");
-  *process_name = tokens[0];
-
-  size_t start_pos = 0;
-  if (tokens.back()[0] == '(')
-    start_pos = 1;
-
-  if (!base::StrToULong(
-          tokens.back().substr(start_pos, tokens.back().size() - 1 - start_pos),
-          pid)) {
-    LOG(ERROR) << "Unable to extract process id from process name field ("
-               << value << ").";
-  }
-}
+  // Keeps track of the current state of each thread.
+  ThreadStates thread_states;
 
-void HandleStackEvent(base::Timestamp ts,
-                      ETWReader::Iterator& it,
-                      ThreadStates* thread_states,
-                      SystemHistory* system_history) {
-  // Get the event tid.
-  base::Tid tid = 0;
-  if (!it->GetFieldAsULong(kThreadIDField, &tid))
-    LOG(ERROR) << "Unable to read column ThreadID of Stack event.";
-
-  // Get the event stack.
-  Stack stack;
-  while (it->type() == kStackType) {
-    std::string symbol;
-    if (!it->GetFieldAsString(kStackSymbolField, &symbol))
-      continue;
-    stack.push_back(symbol);
-    ++it;
-  }
-  DCHECK_EQ(ETWReader::kEmptyEventType, it->type());
+  // The system history to fill.
+  SystemHistory* system_history;
+
+  // Should we stop parsing the trace?
+  bool should_stop;
+};
 
+// Handles a decoded event.
+typedef void (*EventHandler)(const TraceEvent* event, TraceContext* context);
+
+void HandleStackEvent(const TraceEvent* event, TraceContext* context) {
   // Get the associated event type.
-  const ThreadState& thread_state = (*thread_states)[tid];
-  auto look_associated_event_type = thread_state.last_events.find(ts);
-  if (look_associated_event_type == thread_state.last_events.end())
+  const ThreadState& thread_state = context->thread_states[event->tid];
+  base::Timestamp ts = event->ts;
+  const RecentEvent* associated_event = thread_state.last_events.FindLast(
+      [ts](const RecentEvent& recent_event) { return recent_event.ts == ts; });
+  if (associated_event == nullptr ||
+      associated_event->type_id == kUnknownEventTypeId) {
     return;
-  auto associated_event_type = look_associated_event_type->second;
+  }
+  EventTypeId associated_event_type = associated_event->type_id;
 
   // Get the stack history for the thread.
-  auto& stack_history = system_history->GetThread(tid).Stacks();
+  StackTrie& stack_trie = context->system_history->stack_trie();
+  auto& stack_history = context->system_history->GetThread(event->tid).Stacks();
   base::Timestamp last_stack_ts = 0;
   stack_history.GetLastElementTimestamp(&last_stack_ts);
 
-  if (associated_event_type == kSampledProfileType) {
+  if (associated_event_type == context->sampled_profile_type_id) {
     // Handle a call stack associated with a SampledProfile event.
-    if (last_stack_ts == ts) {
-      auto stack_history_it = stack_history.IteratorFromTimestamp(ts);
-      stack_history_it->value =
-          ConcatenateStacks({stack_history_it->value, stack});
+    if (last_stack_ts == event->ts) {
+      auto stack_history_it = stack_history.IteratorFromTimestamp(event->ts);
+      stack_history_it->value = stack_trie.Concatenate(
+          stack_history_it->value, stack_trie.Insert(event->stack));
     } else {
-      stack_history.Insert(ts, stack);
+      stack_history.Insert(event->ts, stack_trie.Insert(event->stack));
     }
-  } else if (associated_event_type == kCSwitchType) {
+  } else if (associated_event_type == context->cswitch_type_id) {
     // Handle a call stack associated with a CSwitch event.
 
     // Get the switch in and switch out times.
-    base::Timestamp switch_in_time = ts;
-    auto look_switch_out_time =
-        thread_state.last_switch_out_before_switch_in_.find(switch_in_time);
-    if (look_switch_out_time ==
-        thread_state.last_switch_out_before_switch_in_.end()) {
+    base::Timestamp switch_in_time = event->ts;
+    const SwitchIn* switch_in = thread_state.last_switches_in.FindLast(
+        [switch_in_time](const SwitchIn& switch_in) {
+          return switch_in.switch_in_ts == switch_in_time;
+        });
+    if (switch_in == nullptr) {
       LOG(ERROR) << "No switch out time for CSwitch stack.";
       return;
     }
-    base::Timestamp switch_out_time = look_switch_out_time->second;
+    base::Timestamp switch_out_time = switch_in->switch_out_ts;
 
     // Update the call stack history.
     if (switch_in_time != switch_out_time) {
-      if (last_stack_ts == ts) {
+      if (last_stack_ts == event->ts) {
         // Concatenate this CSwitch stack to another CSwitch stack that we got
         // previously.
         auto stack_history_it =
             stack_history.IteratorFromTimestamp(switch_out_time);
-        stack_history_it->value =
-            ConcatenateStacks({stack_history_it->value, stack});
+        stack_history_it->value = stack_trie.Concatenate(
+            stack_history_it->value, stack_trie.Insert(event->stack));
       } else {
         // Save the previous stack.
-        Stack previous_stack;
+        StackId previous_stack = kEmptyStackId;
         stack_history.GetLastElementValue(&previous_stack);
 
         // Add the blocked stack.
-        Stack off_cpu_synthetic_stack;
-        if (!thread_state.file_operation.empty())
-          off_cpu_synthetic_stack.push_back(thread_state.file_operation);
-        off_cpu_synthetic_stack.push_back(kOffCpuStackFrame);
+        StackId off_cpu_stack = stack_trie.PushFrame(
+            stack_trie.Insert(event->stack), context->off_cpu_frame_id);
+        if (!thread_state.file_operation.empty()) {
+          off_cpu_stack =
+              stack_trie.PushFrame(off_cpu_stack, thread_state.file_operation);
+        }
 
-        stack_history.Insert(
-            switch_out_time,
-            ConcatenateStacks({off_cpu_synthetic_stack, stack}));
+        stack_history.Insert(switch_out_time, off_cpu_stack);
 
         // Add the stack that follow the blocked stack.
-        if (previous_stack.empty()) {
-          previous_stack.push_back(kUnknownStackFrame);
+        if (previous_stack == kEmptyStackId) {
+          previous_stack =
+              stack_trie.PushFrame(kEmptyStackId, context->unknown_frame_id);
         }
 
         stack_history.Insert(switch_in_time, previous_stack);
@@ -224,206 +192,424 @@ void HandleStackEvent(base::Timestamp ts,
   }
 }
 
-void HandleCSwitchEvent(base::Timestamp ts,
-                        const ETWReader::Line& event,
-                        ThreadStates* thread_states) {
-  base::Tid new_tid = 0;
-  base::Tid old_tid = 0;
-  base::Timestamp time_since_last = 0;
-  if (!event.GetFieldAsULong(kCSwitchNewTidField, &new_tid) ||
-      !event.GetFieldAsULong(kCSwitchOldTidField, &old_tid) ||
-      !event.GetFieldAsULong(kCSwitchTimeSinceLastField, &time_since_last)) {
-    LOG(ERROR) << "Missing some fields in CSwitch event at ts=" << ts << ".";
-    return;
+void HandleCSwitchEvent(const TraceEvent* event, TraceContext* context) {
+  ThreadState& new_thread_state = context->thread_states[event->new_tid];
+  new_thread_state.last_switches_in.Push(
+      {event->ts, event->ts - event->time_since_last});
+}
+
+void HandleProcessStartEvent(const TraceEvent* event, TraceContext* context) {
+  context->system_history->SetProcessName(event->pid, event->text);
+}
+
+void HandleThreadStartEvent(const TraceEvent* event, TraceContext* context) {
+  auto& thread_history = context->system_history->GetThread(event->tid);
+  thread_history.set_start_ts(event->ts);
+  thread_history.set_parent_process_id(event->pid);
+}
+
+void HandleThreadEndEvent(const TraceEvent* event, TraceContext* context) {
+  auto& thread_history = context->system_history->GetThread(event->tid);
+  thread_history.set_end_ts(event->ts);
+}
+
+void HandleFileIoEvent(const TraceEvent* event, TraceContext* context) {
+  auto& thread_state = context->thread_states[event->logging_tid];
+  thread_state.file_operation = event->text;
+}
+
+void HandleFileIoOpEndEvent(const TraceEvent* event, TraceContext* context) {
+  auto& thread_state = context->thread_states[event->logging_tid];
+  thread_state.file_operation.clear();
+}
+
+void HandleChromeEvent(const TraceEvent* event, TraceContext* context) {
+  if (event->is_first_non_empty_paint) {
+    context->system_history->set_first_non_empty_paint_ts(event->ts);
+    context->should_stop = true;
   }
+}
 
-  ThreadState& new_thread_state = (*thread_states)[new_tid];
-  new_thread_state.last_switch_out_before_switch_in_[ts] = ts - time_since_last;
+// Handlers of each kind of event, indexed by TraceEventKind.
+const EventHandler kEventHandlers[] = {
+    nullptr,                  // kOtherEventKind
+    HandleStackEvent,         // kStackEventKind
+    HandleCSwitchEvent,       // kCSwitchEventKind
+    HandleProcessStartEvent,  // kProcessStartEventKind
+    HandleThreadStartEvent,   // kThreadStartEventKind
+    HandleThreadEndEvent,     // kThreadEndEventKind
+    HandleFileIoEvent,        // kFileIoEventKind
+    HandleFileIoOpEndEvent,   // kFileIoOpEndEventKind
+    HandleChromeEvent,        // kChromeEventKind
+};
+static_assert(sizeof(kEventHandlers) / sizeof(kEventHandlers[0]) ==
+                  kNumEventKinds,
+              "Missing handlers in kEventHandlers.");
+
+// @returns true if the handler of an event only updates the state and the
+//     history of one thread: the thread returned by GetHandlerThread().
+bool IsThreadEventKind(TraceEventKind kind) {
+  switch (kind) {
+    case kStackEventKind:
+    case kCSwitchEventKind:
+    case kThreadStartEventKind:
+    case kThreadEndEventKind:
+    case kFileIoEventKind:
+    case kFileIoOpEndEventKind:
+      return true;
+    default:
+      return false;
+  }
 }
 
-void HandleProcessStartEvent(base::Timestamp ts,
-                             const ETWReader::Line& event,
-                             SystemHistory* system_history) {
-  std::string process_name_field;
-  if (!event.GetFieldAsString(kProcessNameField, &process_name_field)) {
-    LOG(ERROR) << "Missing some fields in Process Start event at ts=" << ts
-               << ".";
-    return;
+// @returns the thread whose state or history is updated by the handler of an
+//     event whose kind satisfies IsThreadEventKind().
+base::Tid GetHandlerThread(const TraceEvent* event) {
+  switch (event->kind) {
+    case kCSwitchEventKind:
+      return event->new_tid;
+    case kFileIoEventKind:
+    case kFileIoOpEndEventKind:
+      return event->logging_tid;
+    default:
+      return event->tid;
   }
+}
 
-  std::string process_name;
-  base::Pid process_id = base::kInvalidPid;
-  SplitProcessNameField(process_name_field, &process_name, &process_id);
+// @returns true if the event is remembered as the last event of its thread,
+//     by RememberEvent(). The lines of a stack don't count as events of the
+//     thread.
+bool IsRememberedEvent(const TraceEvent* event) {
+  return event->kind != kStackEventKind && event->tid != base::kInvalidTid;
+}
 
-  system_history->SetProcessName(process_id, process_name);
+// Remembers the last event types encountered on each thread.
+void RememberEvent(const TraceEvent* event, TraceContext* context) {
+  ThreadState& thread_state = context->thread_states[event->tid];
+  thread_state.last_events.Push({event->ts, event->type_id});
 }
 
-void HandleThreadStartEvent(base::Timestamp ts,
-                            const ETWReader::Line& event,
-                            SystemHistory* system_history) {
-  base::Tid thread_id = 0;
-  std::string process_name_field;
-  if (!event.GetFieldAsULong(kThreadIDField, &thread_id) ||
-      !event.GetFieldAsString(kProcessNameField, &process_name_field)) {
-    LOG(ERROR) << "Missing some fields in Thread Start event at ts=" << ts
-               << ".";
-    return;
+// Keeps track of the timestamp of the first and last events of the trace.
+void UpdateTraceBounds(const TraceEvent* event,
+                       SystemHistory* system_history) {
+  base::Timestamp ts = event->ts;
+  if (ts != 0) {
+    if (system_history->first_event_ts() == 0 ||
+        system_history->first_event_ts() > ts) {
+      system_history->set_first_event_ts(ts);
+    }
+    if (system_history->last_event_ts() == base::kInvalidTimestamp ||
+        system_history->last_event_ts() < ts) {
+      system_history->set_last_event_ts(ts);
+    }
   }
+}
+
+// Updates the system history with a decoded event.
+// @returns false if the traversal of the trace should stop.
+bool HandleEvent(const TraceEvent* event, TraceContext* context) {
+  // Handle the event.
+  EventHandler handler = kEventHandlers[event->kind];
+  if (handler != nullptr)
+    handler(event, context);
 
-  std::string process_name;
-  base::Pid process_id = base::kInvalidPid;
-  SplitProcessNameField(process_name_field, &process_name, &process_id);
+  if (IsRememberedEvent(event))
+    RememberEvent(event, context);
 
-  auto& thread_history = system_history->GetThread(thread_id);
-  thread_history.set_start_ts(ts);
-  thread_history.set_parent_process_id(process_id);
+  UpdateTraceBounds(event, context->system_history);
+
+  return !context->should_stop;
 }
 
-void HandleThreadEndEvent(base::Timestamp ts,
-                          const ETWReader::Line& event,
-                          SystemHistory* system_history) {
-  base::Tid thread_id = 0;
-  if (!event.GetFieldAsULong(kThreadIDField, &thread_id)) {
-    LOG(ERROR) << "Missing some fields in Thread End event at ts=" << ts << ".";
-    return;
+// Fills a system history from the events of a trace.
+class SystemHistoryAnalyzer : public TraceAnalyzer {
+ public:
+  SystemHistoryAnalyzer(const Subscription& subscription,
+                        SystemHistory* system_history)
+      : subscription_(subscription), system_history_(system_history) {}
+
+  Subscription GetSubscription() const override { return subscription_; }
+
+  void OnBeginTrace(const EventSchema& schema) override {
+    context_.reset(new TraceContext(schema, system_history_));
   }
 
-  auto& thread_history = system_history->GetThread(thread_id);
-  thread_history.set_end_ts(ts);
-}
+  bool OnEvent(const TraceEvent& event) override {
+    return HandleEvent(&event, context_.get());
+  }
 
-void HandleFileIoEvent(base::Timestamp ts,
-                       const ETWReader::Line& event,
-                       ThreadStates* thread_states) {
-  base::Tid thread_id = 0;
-  std::string file_name;
-  if (!event.GetFieldAsULong(kFileIoLoggingThreadIdField, &thread_id) ||
-      !event.GetFieldAsString(kFileIoFileNameField, &file_name)) {
-    LOG(ERROR) << "Missing some fields in FileIo event at ts=" << ts << ".";
-    return;
+ private:
+  // Events added to the history.
+  Subscription subscription_;
+
+  // The system history to fill.
+  SystemHistory* system_history_;
+
+  // State of the traversal of the trace.
+  std::unique_ptr<TraceContext> context_;
+
+  DISALLOW_COPY_AND_ASSIGN(SystemHistoryAnalyzer);
+};
+
+// Fills a system history from the events of a trace, and builds the
+// histories of the threads on a pool of worker threads. The pool can also
+// decode the trace: its tasks never wait for each other.
+//
+// The threads are divided in shards, by thread id. The events that update the
+// state of a thread are given to the shard of the thread, in the order of the
+// trace: a context switch goes to the shard of the new thread, and also to
+// the shard of the thread on which it occurred. Each shard builds the
+// histories of its threads in its own SystemHistory, and the shards are
+// merged in the system history at the end of the trace. The other events
+// (process starts, Chrome events) are handled as they are received.
+class ParallelSystemHistoryAnalyzer : public TraceAnalyzer {
+ public:
+  ParallelSystemHistoryAnalyzer(const Subscription& subscription,
+                                base::ThreadPool* thread_pool,
+                                SystemHistory* system_history)
+      : subscription_(subscription),
+        system_history_(system_history),
+        thread_pool_(thread_pool),
+        shards_(thread_pool->num_threads() * kShardsPerThread),
+        num_pending_events_(0) {}
+
+  ~ParallelSystemHistoryAnalyzer() override { WaitForShards(); }
+
+  Subscription GetSubscription() const override { return subscription_; }
+
+  void OnBeginTrace(const EventSchema& schema) override {
+    context_.reset(new TraceContext(schema, system_history_));
+    for (auto& shard : shards_) {
+      shard.history.reset(new SystemHistory);
+      shard.context.reset(new TraceContext(schema, shard.history.get()));
+    }
   }
 
-  std::string event_str(std::string("[") + event.type() + ": " + file_name +
-                        "]");
-  auto& thread_state = (*thread_states)[thread_id];
-  thread_state.file_operation = event_str;
-}
+  bool OnEvent(const TraceEvent& event) override {
+    // Give the event to the shards of the threads that it updates.
+    size_t handler_shard = shards_.size();
+    if (IsThreadEventKind(event.kind)) {
+      handler_shard = GetShardIndex(GetHandlerThread(&event));
+      AddPendingEvent(handler_shard, event);
+    }
+    if (IsRememberedEvent(&event)) {
+      size_t shard = GetShardIndex(event.tid);
+      if (shard != handler_shard)
+        AddPendingEvent(shard, event);
+    }
 
-void HandleFileIoOpEndEvent(base::Timestamp ts,
-                            const ETWReader::Line& event,
-                            ThreadStates* thread_states) {
-  base::Tid thread_id = 0;
-  std::string file_name;
-  if (!event.GetFieldAsULong(kFileIoLoggingThreadIdField, &thread_id) ||
-      !event.GetFieldAsString(kFileIoFileNameField, &file_name)) {
-    LOG(ERROR) << "Missing some fields in FileIoOpEnd event at ts=" << ts
-               << ".";
-    return;
+    // Handle the other events.
+    if (!IsThreadEventKind(event.kind)) {
+      EventHandler handler = kEventHandlers[event.kind];
+      if (handler != nullptr)
+        handler(&event, context_.get());
+    }
+    UpdateTraceBounds(&event, system_history_);
+
+    if (num_pending_events_ >= kEventsPerRound)
+      StartRound();
+
+    return !context_->should_stop;
   }
 
-  auto& thread_state = (*thread_states)[thread_id];
-  thread_state.file_operation.clear();
-}
+  void OnEndTrace() override {
+    StartRound();
+    WaitForShards();
+    for (const auto& shard : shards_)
+      MergeShard(*shard.history);
+  }
 
-void HandleChromeEvent(base::Timestamp ts,
-                       const ETWReader::Line& event,
-                       SystemHistory* system_history,
-                       bool* should_stop) {
-  std::string name;
-  std::string phase;
-  if (!event.GetFieldAsString(kChromeNameField, &name) ||
-      !event.GetFieldAsString(kChromePhaseField, &phase)) {
-    LOG(ERROR) << "Missing some fields in Chrome event at ts=" << ts << ".";
-    return;
+ private:
+  // Number of shards per worker thread. Having more shards than threads
+  // balances the work when some threads of the trace are busier than others.
+  static const size_t kShardsPerThread = 4;
+
+  // Number of events given to the shards between two rounds.
+  static const size_t kEventsPerRound = 16 * 1024;
+
+  struct Shard {
+    // History of the threads of the shard, and state of their traversal.
+    std::unique_ptr<SystemHistory> history;
+    std::unique_ptr<TraceContext> context;
+
+    // Events received since the last round.
+    std::vector<TraceEvent> pending_events;
+
+    // Events handled by the current round.
+    std::vector<TraceEvent> events;
+  };
+
+  // @returns the index of the shard of a thread.
+  size_t GetShardIndex(base::Tid tid) const {
+    return static_cast<size_t>(tid % shards_.size());
   }
 
-  if (name == kChromeNonEmptyPaint && phase == kChromePhaseAsyncBegin) {
-    system_history->set_first_non_empty_paint_ts(ts);
-    *should_stop = true;
+  void AddPendingEvent(size_t shard_index, const TraceEvent& event) {
+    shards_[shard_index].pending_events.push_back(event);
+    ++num_pending_events_;
   }
-}
 
-}  // namespace
+  // Handles the pending events of each shard on the thread pool. The events
+  // of a shard are handled in order, after the previous round is done.
+  void StartRound() {
+    WaitForShards();
+    for (size_t i = 0; i < shards_.size(); ++i) {
+      Shard* shard = &shards_[i];
+      shard->events.clear();
+      shard->events.swap(shard->pending_events);
+      if (shard->events.empty())
+        continue;
+      size_t num_shards = shards_.size();
+      round_.push_back(thread_pool_->Post([shard, i, num_shards]() {
+        for (const auto& event : shard->events)
+          HandleShardEvent(&event, i, num_shards, shard->context.get());
+      }));
+    }
+    num_pending_events_ = 0;
+  }
 
-bool GenerateHistoryFromTrace(const std::wstring& trace_path,
-                              SystemHistory* system_history) {
-  // Keeps track of the current state of each thread.
-  std::unordered_map<base::Tid, ThreadState> thread_states;
+  // Waits until the current round is done.
+  void WaitForShards() {
+    for (auto& shard_done : round_)
+      shard_done.get();
+    round_.clear();
+  }
 
-  // Open the CSV trace.
-  ETWReader etw_reader;
-  if (!etw_reader.Open(trace_path))
-    return false;
+  // Handles an event given to a shard. Only the state of the threads of the
+  // shard is updated.
+  static void HandleShardEvent(const TraceEvent* event,
+                               size_t shard_index,
+                               size_t num_shards,
+                               TraceContext* context) {
+    if (IsThreadEventKind(event->kind) &&
+        GetHandlerThread(event) % num_shards == shard_index) {
+      kEventHandlers[event->kind](event, context);
+    }
+    if (IsRememberedEvent(event) && event->tid % num_shards == shard_index)
+      RememberEvent(event, context);
+  }
 
-  // Tell the user what we are doing.
-  LOG(INFO) << "Reading trace events." << std::endl;
-
-  // Traverse all the events of the CSV trace.
-  for (auto it = etw_reader.begin(); it != etw_reader.end(); ++it) {
-    // Should we stop parsing the trace?
-    bool should_stop = false;
-
-    // Get the event timestamp.
-    base::Timestamp ts = 0;
-    it->GetFieldAsULong(kTimestampField, &ts);
-
-    // Handle each event type.
-    if (it->type() == kStackType)
-      HandleStackEvent(ts, it, &thread_states, system_history);
-    else if (it->type() == kCSwitchType)
-      HandleCSwitchEvent(ts, *it, &thread_states);
-    else if (it->type() == kProcessStartType ||
-             it->type() == kProcessDCStartType)
-      HandleProcessStartEvent(ts, *it, system_history);
-    else if (it->type() == kThreadStartType || it->type() == kThreadDCStartType)
-      HandleThreadStartEvent(ts, *it, system_history);
-    else if (it->type() == kThreadEndType || it->type() == kThreadDCEndType)
-      HandleThreadEndEvent(ts, *it, system_history);
-    else if (it->type() == kFileIoCreateType ||
-             it->type() == kFileIoCleanupType ||
-             it->type() == kFileIoCloseType ||
-             it->type() == kFileIoFlushType ||
-             it->type() == kFileIoReadType ||
-             it->type() == kFileIoWriteType ||
-             it->type() == kFileIoSetInfoType ||
-             it->type() == kFileIoQueryInfoType ||
-             it->type() == kFileIoFSCTLType ||
-             it->type() == kFileIoDeleteType ||
-             it->type() == kFileIoRenameType ||
-             it->type() == kFileIoDirEnumType ||
-             it->type() == kFileIoDirNotifyType)
-      HandleFileIoEvent(ts, *it, &thread_states);
-    else if (it->type() == kFileIoOpEnd)
-      HandleFileIoOpEndEvent(ts, *it, &thread_states);
-    else if (it->type() == kChromeType)
-      HandleChromeEvent(ts, *it, system_history, &should_stop);
-
-    // Remember the last event types encountered on each thread.
-    base::Tid tid = 0;
-    if (it->GetFieldAsULong(kThreadIDField, &tid) ||
-        it->GetFieldAsULong(kCSwitchNewTidField, &tid)) {
-      ThreadState& thread_state = thread_states[tid];
-      thread_state.last_events[ts] = it->type();
+  // Moves the thread histories built by a shard to the system history.
+  void MergeShard(const SystemHistory& shard_history) {
+    // Map the stacks of the shard to the stacks of the system history. A
+    // stack is always added to a trie after the stack below its top frame.
+    const StackTrie& shard_trie = shard_history.stack_trie();
+    StackTrie& stack_trie = system_history_->stack_trie();
+    std::vector<FrameId> frame_ids(shard_trie.frames().size());
+    for (FrameId frame_id = 0; frame_id < frame_ids.size(); ++frame_id) {
+      frame_ids[frame_id] =
+          stack_trie.GetFrameId(shard_trie.frames().GetFrame(frame_id));
+    }
+    std::vector<StackId> stack_ids(shard_trie.size(), kEmptyStackId);
+    for (StackId stack_id = 1; stack_id < stack_ids.size(); ++stack_id) {
+      stack_ids[stack_id] =
+          stack_trie.PushFrame(stack_ids[shard_trie.parent(stack_id)],
+                               frame_ids[shard_trie.frame(stack_id)]);
     }
 
-    // Keep track of the timestamp of the first and last events of the trace.
-    if (ts != 0) {
-      if (system_history->first_event_ts() == 0 ||
-          system_history->first_event_ts() > ts) {
-        system_history->set_first_event_ts(ts);
-      }
-      if (system_history->last_event_ts() == base::kInvalidTimestamp ||
-          system_history->last_event_ts() < ts) {
-        system_history->set_last_event_ts(ts);
+    for (auto it = shard_history.threads_begin();
+         it != shard_history.threads_end(); ++it) {
+      ThreadHistory& thread_history = system_history_->GetThread(it->first);
+      thread_history = it->second;
+      auto& stacks = thread_history.Stacks();
+      for (auto stack_it = stacks.IteratorFromTimestamp(0);
+           stack_it != stacks.IteratorEnd(); ++stack_it) {
+        stack_it->value = stack_ids[stack_it->value];
       }
     }
+  }
+
+  // Events added to the history.
+  Subscription subscription_;
+
+  // The system history to fill, and the state of the traversal of the events
+  // that aren't given to the shards.
+  SystemHistory* system_history_;
+  std::unique_ptr<TraceContext> context_;
+
+  // Runs the rounds of the shards.
+  base::ThreadPool* thread_pool_;
+
+  std::vector<Shard> shards_;
+
+  // Number of events given to the shards since the last round.
+  size_t num_pending_events_;
 
-    // Stop parsing the trace.
-    if (should_stop)
-      break;
+  // Completion of the shards of the current round.
+  std::vector<std::future<void>> round_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParallelSystemHistoryAnalyzer);
+};
+
+}  // namespace
+
+std::unique_ptr<TraceAnalyzer> CreateSystemHistoryAnalyzer(
+    const Subscription& subscription,
+    base::ThreadPool* thread_pool,
+    SystemHistory* system_history) {
+  if (thread_pool != nullptr) {
+    return std::unique_ptr<TraceAnalyzer>(new ParallelSystemHistoryAnalyzer(
+        subscription, thread_pool, system_history));
   }
+  return std::unique_ptr<TraceAnalyzer>(
+      new SystemHistoryAnalyzer(subscription, system_history));
+}
 
+bool GenerateHistoryFromTrace(const std::wstring& trace_path,
+                              size_t num_threads,
+                              const Subscription& subscription,
+                              SystemHistory* system_history) {
+  // Read the history from its snapshot, if it is up to date. The snapshot
+  // contains the history of all the events, which can be used for any
+  // subscription.
+  if (OpenSystemHistorySnapshot(trace_path, system_history)) {
+    LOG(INFO) << "Reading system history from snapshot." << std::endl;
+    return true;
+  }
+
+  // The same threads decode the trace and build the histories of its threads.
+  std::unique_ptr<base::ThreadPool> thread_pool;
+  if (num_threads > 1)
+    thread_pool.reset(new base::ThreadPool(num_threads));
+
+  std::unique_ptr<TraceAnalyzer> analyzer(CreateSystemHistoryAnalyzer(
+      subscription, thread_pool.get(), system_history));
+  if (!AnalyzeTrace(trace_path, thread_pool.get(), {analyzer.get()}))
+    return false;
+  analyzer.reset();
+
+  // Only the history of all the events can be saved in a snapshot.
+  if (subscription.SelectsAll()) {
+    LOG(INFO) << "Writing system history snapshot." << std::endl;
+    WriteSystemHistorySnapshot(*system_history, trace_path);
+  }
   return true;
 }
 
+Subscription GetHistorySubscription(base::Timestamp start_ts,
+                                    base::Timestamp end_ts) {
+  Subscription subscription;
+  subscription.start_ts =
+      start_ts > kStackLookback ? start_ts - kStackLookback : 0;
+  subscription.end_ts = end_ts;
+
+  // Events that update the stacks of threads.
+  subscription.event_types[kSampledProfileType] = kSubscribedInWindow;
+  for (TraceEventKind kind : {kStackEventKind, kCSwitchEventKind}) {
+    for (const auto& type : GetEventTypesOfKind(kind))
+      subscription.event_types[type] = kSubscribedInWindow;
+  }
+
+  // Events that describe processes, threads and file operations, and the
+  // Chrome event that ends the analysis.
+  for (TraceEventKind kind :
+       {kProcessStartEventKind, kThreadStartEventKind, kThreadEndEventKind,
+        kFileIoEventKind, kFileIoOpEndEventKind, kChromeEventKind}) {
+    for (const auto& type : GetEventTypesOfKind(kind))
+      subscription.event_types[type] = kSubscribedInWholeTrace;
+  }
+
+  return subscription;
+}
+
 }  // namespace etw_insights
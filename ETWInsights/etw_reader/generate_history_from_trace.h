@@ -16,17 +16,59 @@ limitations under the License.
 
 #pragma once
 
+#include <memory>
 #include <string>
 
+#include "base/thread_pool.h"
+#include "base/types.h"
+#include "etw_reader/subscription.h"
 #include "etw_reader/system_history.h"
+#include "etw_reader/trace_analyzer.h"
 
 namespace etw_insights {
 
-// Traverses the event of an ETW trace to fill a system history.
+// Creates an analyzer that fills a system history from the events of a trace.
+// It can be fed by AnalyzeTrace() along with other analyzers.
+// @param subscription The events added to the history.
+// @param thread_pool Threads used to build the histories of the threads of
+//     the trace, or nullptr to build them on the calling thread. With a thread
+//     pool, the events are divided by thread and the histories are built on
+//     the pool. The resulting history is the same, but stack ids may be
+//     assigned in another order. The pool can be shared with AnalyzeTrace(),
+//     and must outlive the analyzer.
+// @param system_history The system history to fill. Must outlive the
+//     analyzer.
+// @returns the analyzer.
+std::unique_ptr<TraceAnalyzer> CreateSystemHistoryAnalyzer(
+    const Subscription& subscription,
+    base::ThreadPool* thread_pool,
+    SystemHistory* system_history);
+
+// Traverses the event of an ETW trace to fill a system history. If the
+// snapshot of the history of the trace is up to date, the history is read
+// from it instead, whatever the subscription.
 // @param trace_path Path to a .etl trace file.
-// @param system_history The system history to fill.
+// @param num_threads Number of threads used to parse the trace and to build
+//     the history.
+// @param subscription The events added to the history. Unless it selects
+//     all events, the subscription is applied while the trace is parsed and
+//     neither the cache of the trace nor the snapshot of the history is
+//     written.
+// @param system_history The system history to fill. Must be empty.
 // @returns true if the history was filled successfully, false otherwise.
 bool GenerateHistoryFromTrace(const std::wstring& trace_path,
+                              size_t num_threads,
+                              const Subscription& subscription,
                               SystemHistory* system_history);
 
+// @param start_ts Beginning of a window of time.
+// @param end_ts End of a window of time.
+// @returns a subscription to the events needed to generate the history of
+//     the window: call stacks and context switches that occur in the window
+//     or shortly before it, so that the call stack that each thread runs when
+//     the window starts is known, and events that describe processes, threads
+//     and file operations in the whole trace.
+Subscription GetHistorySubscription(base::Timestamp start_ts,
+                                    base::Timestamp end_ts);
+
 }  // namespace etw_insights
@@ -0,0 +1,96 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "etw_reader/line_reader.h"
+
+#include <string.h>
+
+#include "base/logging.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Size of the views of the file mapped in memory. Large enough for the cost of
+// mapping a view to be negligible, small enough for the views of one reader
+// per worker thread to fit in the address space of a 32-bit process.
+const size_t kViewSize = 16 * 1024 * 1024;
+
+}  // namespace
+
+LineReader::LineReader() : view_pos_(0), view_size_(kViewSize) {}
+
+bool LineReader::Open(const std::wstring& path) {
+  view_pos_ = 0;
+  return file_.Open(path);
+}
+
+bool LineReader::OpenShared(const base::MemoryMappedFile& file) {
+  view_pos_ = 0;
+  return file_.OpenShared(file);
+}
+
+bool LineReader::Seek(uint64_t offset) {
+  // Stay in the current view if possible.
+  if (offset >= file_.offset() && offset <= file_.offset() + file_.length()) {
+    view_pos_ = static_cast<size_t>(offset - file_.offset());
+    return true;
+  }
+
+  view_pos_ = 0;
+  return file_.Map(offset, view_size_);
+}
+
+bool LineReader::ReadLine(std::string_view* line) {
+  DCHECK(line != nullptr);
+
+  for (;;) {
+    const char* begin = file_.data() + view_pos_;
+    size_t remaining = file_.length() - view_pos_;
+    uint64_t line_offset = file_.offset() + view_pos_;
+
+    const char* end = nullptr;
+    if (remaining != 0)
+      end = static_cast<const char*>(memchr(begin, '\n', remaining));
+
+    if (end != nullptr) {
+      view_pos_ += (end - begin) + 1;
+    } else if (line_offset + remaining >= file_.size()) {
+      // This is the last line of the file. It has no end of line character.
+      if (remaining == 0)
+        return false;
+      end = begin + remaining;
+      view_pos_ += remaining;
+    } else {
+      // The line straddles the end of the view. Map a new view that starts at
+      // the beginning of the line. If the line didn't fit in the previous
+      // view, make the new view bigger.
+      if (view_pos_ == 0 && remaining != 0)
+        view_size_ *= 2;
+      if (!file_.Map(line_offset, view_size_))
+        return false;
+      view_pos_ = 0;
+      continue;
+    }
+
+    if (end != begin && *(end - 1) == '\r')
+      --end;
+    *line = std::string_view(begin, end - begin);
+    return true;
+  }
+}
+
+}  // namespace etw_insights
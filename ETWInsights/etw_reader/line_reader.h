@@ -0,0 +1,67 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+
+#include "base/base.h"
+#include "base/memory_mapped_file.h"
+#include "etw_reader/line_source.h"
+
+namespace etw_insights {
+
+// Reads the lines of a text file mapped in memory. Lines point directly into
+// the mapped file and are valid until the next call to ReadLine().
+class LineReader : public LineSource {
+ public:
+  LineReader();
+
+  // Opens a file.
+  // @param path path of the file to read.
+  // @returns true if the file was opened successfully, false otherwise.
+  bool Open(const std::wstring& path);
+
+  // Opens a file that is already opened, sharing its file mapping.
+  // @param file an opened file. Must stay open as long as the reader.
+  // @returns true if the file was opened successfully, false otherwise.
+  bool OpenShared(const base::MemoryMappedFile& file);
+
+  // Moves to an offset of the file. The next line read starts at |offset|.
+  // @param offset the new offset.
+  // @returns true if successful, false otherwise.
+  bool Seek(uint64_t offset);
+
+  // LineSource implementation.
+  bool ReadLine(std::string_view* line) override;
+  uint64_t offset() const override { return file_.offset() + view_pos_; }
+
+ private:
+  // Mapped file.
+  base::MemoryMappedFile file_;
+
+  // Position of the next line in the mapped view of the file.
+  size_t view_pos_;
+
+  // Size of the views mapped when the end of the current view is reached.
+  size_t view_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(LineReader);
+};
+
+}  // namespace etw_insights
@@ -0,0 +1,39 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string_view>
+
+namespace etw_insights {
+
+// A source of lines of text.
+class LineSource {
+ public:
+  virtual ~LineSource() {}
+
+  // Reads the next line, without its end of line characters. The line is
+  // valid until the next call to ReadLine().
+  // @param line the line, output.
+  // @returns true if a line was read, false at the end of the source.
+  virtual bool ReadLine(std::string_view* line) = 0;
+
+  // @returns the offset of the next line in the source.
+  virtual uint64_t offset() const = 0;
+};
+
+}  // namespace etw_insights
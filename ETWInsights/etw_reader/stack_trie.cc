@@ -0,0 +1,102 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "etw_reader/stack_trie.h"
+
+#include "base/logging.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Maximum number of entries of the table of the children of the nodes that
+// are allocated at once, and size of the largest block that is pooled, which
+// fits an entry but not a bucket array.
+const size_t kMaxChildrenPerChunk = 64 * 1024;
+const size_t kLargestPooledBlock = 64;
+
+}  // namespace
+
+StackTrie::StackTrie()
+    : children_pool_(std::pmr::pool_options{kMaxChildrenPerChunk,
+                                            kLargestPooledBlock}),
+      children_(&children_pool_),
+      view_nodes_(nullptr),
+      view_size_(0),
+      is_view_(false) {
+  // The root of the trie is the empty stack.
+  nodes_.push_back({0, kEmptyStackId});
+}
+
+void StackTrie::SetView(const Node* nodes,
+                        size_t num_nodes,
+                        const uint64_t* frame_offsets,
+                        const char* frame_data,
+                        size_t num_frames) {
+  DCHECK_GT(num_nodes, 0U);
+  frames_.SetView(frame_offsets, frame_data, num_frames);
+  nodes_.clear();
+  children_.clear();
+  view_nodes_ = nodes;
+  view_size_ = num_nodes;
+  is_view_ = true;
+}
+
+StackId StackTrie::PushFrame(StackId stack_id, FrameId frame_id) {
+  DCHECK(!is_view_);
+  DCHECK_LT(stack_id, nodes_.size());
+  auto inserted = children_.insert(
+      {ChildKey(stack_id, frame_id), static_cast<StackId>(nodes_.size())});
+  if (inserted.second)
+    nodes_.push_back({frame_id, stack_id});
+  return inserted.first->second;
+}
+
+StackId StackTrie::PushFrame(StackId stack_id, std::string_view frame) {
+  return PushFrame(stack_id, frames_.GetFrameId(frame));
+}
+
+StackId StackTrie::Insert(const Stack& stack) {
+  StackId stack_id = kEmptyStackId;
+  for (auto it = stack.rbegin(); it != stack.rend(); ++it)
+    stack_id = PushFrame(stack_id, *it);
+  return stack_id;
+}
+
+StackId StackTrie::Concatenate(StackId top, StackId bottom) {
+  if (top == kEmptyStackId)
+    return bottom;
+
+  // Collect the frames of |top|, from the top of the stack.
+  top_frames_.clear();
+  for (StackId id = top; id != kEmptyStackId; id = nodes_[id].parent)
+    top_frames_.push_back(nodes_[id].frame);
+
+  StackId stack_id = bottom;
+  for (auto it = top_frames_.rbegin(); it != top_frames_.rend(); ++it)
+    stack_id = PushFrame(stack_id, *it);
+  return stack_id;
+}
+
+Stack StackTrie::GetStack(StackId stack_id) const {
+  DCHECK_LT(stack_id, size());
+  Stack stack;
+  for (StackId id = stack_id; id != kEmptyStackId; id = parent(id))
+    stack.emplace_back(frames_.GetFrame(frame(id)));
+  return stack;
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,155 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <memory_resource>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "base/base.h"
+#include "etw_reader/frame_table.h"
+#include "etw_reader/stack.h"
+
+namespace etw_insights {
+
+// Identifies a call stack in a StackTrie.
+typedef uint32_t StackId;
+
+// Id of the empty call stack.
+const StackId kEmptyStackId = 0;
+
+// Stores the call stacks of a trace in a prefix tree, rooted at the bottom of
+// the stacks. Each node is a call stack: the frame at the top of the stack and
+// the node of the stack below that frame. Stacks that share their bottom
+// frames share nodes, and each distinct stack is identified by a single
+// 32-bit id, so two stacks are equal if their ids are equal. Nodes are never
+// removed: they are allocated in arenas that grow with the number of distinct
+// stacks and are released with the trie. A trie can also be a read-only view
+// of nodes and frames stored elsewhere, e.g. in a memory-mapped file.
+class StackTrie {
+ public:
+  // A call stack: the frame at its top and the stack below that frame.
+  struct Node {
+    FrameId frame;
+    StackId parent;
+  };
+
+  StackTrie();
+
+  // Makes the trie a read-only view of nodes and frames stored elsewhere. No
+  // stack can be added to a view.
+  // @param nodes nodes indexed by stack id, starting with the empty stack.
+  //     The parent of each node must have a smaller id than the node. Must
+  //     outlive the trie.
+  // @param num_nodes number of nodes.
+  // @param frame_offsets offsets of the frames in |frame_data|. See
+  //     FrameTable::SetView().
+  // @param frame_data characters of the frames.
+  // @param num_frames number of frames. Frames of the nodes are smaller than
+  //     this number.
+  void SetView(const Node* nodes,
+               size_t num_nodes,
+               const uint64_t* frame_offsets,
+               const char* frame_data,
+               size_t num_frames);
+
+  // @param frame a stack frame.
+  // @returns the id of the frame.
+  FrameId GetFrameId(std::string_view frame) {
+    return frames_.GetFrameId(frame);
+  }
+
+  // Adds a frame at the top of a stack.
+  // @param stack_id the stack on which the frame is pushed.
+  // @param frame_id the frame to push.
+  // @returns the id of the resulting stack.
+  StackId PushFrame(StackId stack_id, FrameId frame_id);
+
+  // Adds a frame at the top of a stack.
+  // @param stack_id the stack on which the frame is pushed.
+  // @param frame the frame to push.
+  // @returns the id of the resulting stack.
+  StackId PushFrame(StackId stack_id, std::string_view frame);
+
+  // @param stack a call stack, from the top of the stack.
+  // @returns the id of the stack.
+  StackId Insert(const Stack& stack);
+
+  // Builds a stack whose top frames are those of |top| and whose bottom frames
+  // are those of |bottom|.
+  // @param top the top of the resulting stack.
+  // @param bottom the bottom of the resulting stack.
+  // @returns the id of the resulting stack.
+  StackId Concatenate(StackId top, StackId bottom);
+
+  // @param stack_id a stack id.
+  // @returns the frames of the stack, from the top of the stack.
+  Stack GetStack(StackId stack_id) const;
+
+  // @param stack_id a stack id, other than kEmptyStackId.
+  // @returns the frame at the top of the stack.
+  FrameId frame(StackId stack_id) const { return nodes()[stack_id].frame; }
+
+  // @param stack_id a stack id, other than kEmptyStackId.
+  // @returns the stack below the top frame of the stack.
+  StackId parent(StackId stack_id) const { return nodes()[stack_id].parent; }
+
+  // @returns the frames of the stacks.
+  const FrameTable& frames() const { return frames_; }
+
+  // @returns the number of stacks, including the empty stack. Stack ids are
+  //     smaller than this number.
+  size_t size() const { return is_view_ ? view_size_ : nodes_.size(); }
+
+ private:
+  // @returns the nodes, indexed by stack id.
+  const Node* nodes() const { return is_view_ ? view_nodes_ : nodes_.data(); }
+
+  // @returns the key of a node in |children_|.
+  static uint64_t ChildKey(StackId parent, FrameId frame) {
+    return (static_cast<uint64_t>(parent) << 32) | frame;
+  }
+
+  // Frames of the stacks.
+  FrameTable frames_;
+
+  // Nodes, indexed by stack id.
+  std::vector<Node> nodes_;
+
+  // Pool in which the entries of |children_| are allocated. Only blocks as
+  // small as an entry are pooled: the bucket arrays, which are replaced each
+  // time the table grows, go back to the heap when they are released.
+  std::pmr::unsynchronized_pool_resource children_pool_;
+
+  // (Parent stack id, frame id) -> Stack id.
+  std::pmr::unordered_map<uint64_t, StackId> children_;
+
+  // Frames of the top of a stack being concatenated. Kept between calls to
+  // Concatenate() to avoid allocations.
+  std::vector<FrameId> top_frames_;
+
+  // Nodes of a view, stored outside of the trie.
+  const Node* view_nodes_;
+  size_t view_size_;
+  bool is_view_;
+
+  DISALLOW_COPY_AND_ASSIGN(StackTrie);
+};
+
+}  // namespace etw_insights
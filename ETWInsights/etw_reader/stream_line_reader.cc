@@ -0,0 +1,109 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "etw_reader/stream_line_reader.h"
+
+#include <string.h>
+
+#include "base/logging.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Initial size of the buffer. Large enough to read many lines per call to the
+// stream.
+const size_t kBufferSize = 1024 * 1024;
+
+}  // namespace
+
+StreamLineReader::StreamLineReader(std::unique_ptr<ByteStream> stream)
+    : stream_(std::move(stream)),
+      buffer_(kBufferSize),
+      begin_(0),
+      end_(0),
+      offset_(0),
+      at_end_(false) {
+  DCHECK(stream_);
+}
+
+StreamLineReader::~StreamLineReader() {}
+
+bool StreamLineReader::ReadLine(std::string_view* line) {
+  DCHECK(line != nullptr);
+
+  size_t search_begin = begin_;
+  for (;;) {
+    const char* begin = buffer_.data() + begin_;
+    const char* end = nullptr;
+    if (search_begin != end_) {
+      end = static_cast<const char*>(memchr(buffer_.data() + search_begin,
+                                            '\n', end_ - search_begin));
+    }
+
+    size_t line_length = 0;
+    if (end != nullptr) {
+      line_length = end - begin;
+      begin_ += line_length + 1;
+      offset_ += line_length + 1;
+    } else if (at_end_) {
+      // This is the last line of the stream. It has no end of line character.
+      if (begin_ == end_)
+        return false;
+      end = buffer_.data() + end_;
+      line_length = end_ - begin_;
+      begin_ = end_;
+      offset_ += line_length;
+    } else {
+      // The line isn't complete. Don't search again the bytes that have
+      // already been searched.
+      search_begin = end_ - begin_;
+      if (!Fill())
+        at_end_ = true;
+      search_begin += begin_;
+      continue;
+    }
+
+    if (end != begin && *(end - 1) == '\r')
+      --end;
+    *line = std::string_view(begin, end - begin);
+    return true;
+  }
+}
+
+bool StreamLineReader::Fill() {
+  // Move the unread bytes to the beginning of the buffer. If they fill the
+  // buffer, make it bigger.
+  const size_t num_unread = end_ - begin_;
+  if (begin_ != 0) {
+    memmove(buffer_.data(), buffer_.data() + begin_, num_unread);
+    begin_ = 0;
+    end_ = num_unread;
+  }
+  if (end_ == buffer_.size())
+    buffer_.resize(buffer_.size() * 2);
+
+  size_t bytes_read = 0;
+  if (!stream_->Read(buffer_.data() + end_, buffer_.size() - end_,
+                     &bytes_read) ||
+      bytes_read == 0) {
+    return false;
+  }
+  end_ += bytes_read;
+  return true;
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,86 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "base/base.h"
+#include "etw_reader/line_source.h"
+
+namespace etw_insights {
+
+// A stream of bytes, such as the output of a child process.
+class ByteStream {
+ public:
+  virtual ~ByteStream() {}
+
+  // Reads the next bytes of the stream. Blocks until some bytes are available.
+  // @param buffer buffer that receives the bytes.
+  // @param size size of |buffer|.
+  // @param bytes_read number of bytes read, output.
+  // @returns false at the end of the stream or on error.
+  virtual bool Read(char* buffer, size_t size, size_t* bytes_read) = 0;
+
+  // @returns true if the stream ended with an error, for example if the
+  //     process that produces it failed. Valid once Read() has returned false.
+  virtual bool failed() const { return false; }
+};
+
+// Reads the lines of a ByteStream as its bytes arrive. The bytes are read in a
+// buffer of bounded size, which only grows to hold a line longer than itself.
+// Lines point into the buffer and are valid until the next call to
+// ReadLine().
+class StreamLineReader : public LineSource {
+ public:
+  // @param stream the stream to read.
+  explicit StreamLineReader(std::unique_ptr<ByteStream> stream);
+  ~StreamLineReader() override;
+
+  // LineSource implementation.
+  bool ReadLine(std::string_view* line) override;
+  uint64_t offset() const override { return offset_; }
+
+  // @returns true if the stream ended with an error.
+  bool failed() const { return stream_->failed(); }
+
+ private:
+  // Moves the unread bytes to the beginning of the buffer and reads more bytes
+  // after them.
+  // @returns false at the end of the stream.
+  bool Fill();
+
+  // The stream to read.
+  std::unique_ptr<ByteStream> stream_;
+
+  // Buffer, and the range of bytes that haven't been returned yet.
+  std::vector<char> buffer_;
+  size_t begin_;
+  size_t end_;
+
+  // Offset of |buffer_[begin_]| in the stream.
+  uint64_t offset_;
+
+  // Whether the end of the stream has been reached.
+  bool at_end_;
+
+  DISALLOW_COPY_AND_ASSIGN(StreamLineReader);
+};
+
+}  // namespace etw_insights
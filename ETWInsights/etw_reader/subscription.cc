@@ -0,0 +1,150 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "etw_reader/subscription.h"
+
+#include "base/logging.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Lines that hold the call stack of the event that precedes them.
+const char kStackType[] = "Stack";
+
+}  // namespace
+
+Subscription::Subscription()
+    : start_ts(0), end_ts(base::kInvalidTimestamp) {}
+
+bool Subscription::SelectsAll() const {
+  return event_types.empty() && !HasWindow();
+}
+
+bool Subscription::HasWindow() const {
+  return start_ts != 0 || end_ts != base::kInvalidTimestamp;
+}
+
+bool Subscription::IsWithinWindow() const {
+  for (const auto& event_type : event_types) {
+    if (event_type.second == kSubscribedInWholeTrace)
+      return false;
+  }
+  return true;
+}
+
+Subscription MergeSubscriptions(
+    const std::vector<Subscription>& subscriptions) {
+  DCHECK(!subscriptions.empty());
+
+  Subscription merged;
+  merged.start_ts = base::kInvalidTimestamp;
+  merged.end_ts = 0;
+  bool selects_all_types = false;
+  bool is_within_window = true;
+  for (const auto& subscription : subscriptions) {
+    if (subscription.SelectsAll())
+      return Subscription();
+
+    if (subscription.start_ts < merged.start_ts)
+      merged.start_ts = subscription.start_ts;
+    if (subscription.end_ts > merged.end_ts)
+      merged.end_ts = subscription.end_ts;
+
+    if (subscription.event_types.empty())
+      selects_all_types = true;
+    if (!subscription.IsWithinWindow())
+      is_within_window = false;
+
+    // An event type is read in the largest of its scopes.
+    for (const auto& event_type : subscription.event_types) {
+      SubscriptionScope& scope = merged.event_types[event_type.first];
+      if (event_type.second > scope)
+        scope = event_type.second;
+    }
+  }
+
+  // All the event types are read within the window. Unless some event types
+  // are read in the whole trace, in which case the whole trace is read.
+  if (selects_all_types) {
+    if (!is_within_window)
+      return Subscription();
+    merged.event_types.clear();
+  }
+
+  return merged;
+}
+
+SubscriptionFilter::SubscriptionFilter(const Subscription& subscription,
+                                       const EventSchema& schema)
+    : scopes_(schema.num_types(),
+              subscription.event_types.empty() ? kSubscribedInWindow
+                                               : kNotSubscribed),
+      stack_type_id_(schema.GetTypeId(kStackType)),
+      start_ts_(subscription.start_ts),
+      end_ts_(subscription.end_ts),
+      has_window_(subscription.HasWindow()),
+      outside_window_(false),
+      skipping_stack_(false) {
+  for (const auto& event_type : subscription.event_types) {
+    EventTypeId type_id = schema.GetTypeId(event_type.first);
+    if (type_id != kUnknownEventTypeId)
+      scopes_[type_id] = event_type.second;
+  }
+
+  // Empty lines end Stack events. They carry no information and are never
+  // skipped.
+  scopes_[kEmptyEventTypeId] = kSubscribedInWholeTrace;
+}
+
+SubscriptionFilter::TypeSelection SubscriptionFilter::SelectType(
+    EventTypeId type_id) {
+  DCHECK_LT(type_id, scopes_.size());
+
+  if (type_id == kEmptyEventTypeId)
+    return kSelected;
+
+  // The lines of a Stack event follow the fate of the event they belong to.
+  if (type_id == stack_type_id_) {
+    if (skipping_stack_)
+      return kSkipped;
+  } else {
+    skipping_stack_ = false;
+  }
+
+  switch (scopes_[type_id]) {
+    case kNotSubscribed:
+      skipping_stack_ = true;
+      return kSkipped;
+    case kSubscribedInWindow:
+      if (outside_window_) {
+        skipping_stack_ = true;
+        return kSkipped;
+      }
+      return has_window_ ? kNeedsTimestamp : kSelected;
+    default:
+      return kSelected;
+  }
+}
+
+bool SubscriptionFilter::SelectTimestamp(base::Timestamp ts) {
+  if (ts >= start_ts_ && ts <= end_ts_)
+    return true;
+  skipping_stack_ = true;
+  return false;
+}
+
+}  // namespace etw_insights
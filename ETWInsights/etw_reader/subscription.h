@@ -0,0 +1,125 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/types.h"
+#include "etw_reader/event_schema.h"
+
+namespace etw_insights {
+
+// Where the events of a type are read.
+enum SubscriptionScope {
+  // The events aren't read.
+  kNotSubscribed,
+  // The events are only read within the timestamp window of the
+  // subscription.
+  kSubscribedInWindow,
+  // The events are read in the whole trace, e.g. because they describe
+  // processes and threads that exist in the window.
+  kSubscribedInWholeTrace,
+};
+
+// Selects the events read from a trace: a set of event types and a window of
+// timestamps. By default, all events are selected.
+struct Subscription {
+  Subscription();
+
+  // @returns true if all the events of a trace are selected.
+  bool SelectsAll() const;
+
+  // @returns true if the subscription has a window of timestamps.
+  bool HasWindow() const;
+
+  // @returns true if all the selected events are in the window.
+  bool IsWithinWindow() const;
+
+  // Event types to read. All event types are read within the window when
+  // empty.
+  std::map<std::string, SubscriptionScope> event_types;
+
+  // Window of timestamps, inclusive.
+  base::Timestamp start_ts;
+  base::Timestamp end_ts;
+};
+
+// Merges subscriptions.
+// @param subscriptions the subscriptions to merge. Can't be empty.
+// @returns a subscription that selects all the events selected by any of
+//     |subscriptions|, and possibly more: its window covers all their
+//     windows.
+Subscription MergeSubscriptions(const std::vector<Subscription>& subscriptions);
+
+// Applies a subscription to the lines of a trace, or to its decoded events,
+// in the order of the trace. The lines of a Stack event belong to the event
+// that precedes them: they are skipped when that event is skipped.
+class SubscriptionFilter {
+ public:
+  // Result of the selection of a line from its type.
+  enum TypeSelection {
+    kSelected,
+    kSkipped,
+    // The line is selected if its timestamp is in the window.
+    kNeedsTimestamp,
+  };
+
+  // @param subscription the subscription to apply.
+  // @param schema the event types of the trace.
+  SubscriptionFilter(const Subscription& subscription,
+                     const EventSchema& schema);
+
+  // Selects the next line from its type.
+  // @param type_id the type of the line.
+  // @returns whether the line is selected, or if its timestamp must be read.
+  TypeSelection SelectType(EventTypeId type_id);
+
+  // Selects the next line from its timestamp, after SelectType() returned
+  // kNeedsTimestamp.
+  // @param ts the timestamp of the line.
+  // @returns true if the line is selected.
+  bool SelectTimestamp(base::Timestamp ts);
+
+  // Tells whether the next lines are known to be outside of the window, e.g.
+  // from a timestamp index. Lines of types subscribed in the window are then
+  // skipped without reading their timestamp.
+  void set_outside_window(bool outside_window) {
+    outside_window_ = outside_window;
+  }
+
+ private:
+  // Scope of each event type, indexed by type id.
+  std::vector<SubscriptionScope> scopes_;
+
+  // Id of the Stack event type.
+  EventTypeId stack_type_id_;
+
+  // Window of timestamps, and whether it covers the whole trace.
+  base::Timestamp start_ts_;
+  base::Timestamp end_ts_;
+  bool has_window_;
+
+  // Whether the next lines are known to be outside of the window.
+  bool outside_window_;
+
+  // Whether the last event that isn't a Stack event was skipped.
+  bool skipping_stack_;
+};
+
+}  // namespace etw_insights
@@ -16,10 +16,15 @@ limitations under the License.
 
 #pragma once
 
+#include <memory>
+#include <string>
 #include <unordered_map>
+#include <utility>
 
 #include "base/base.h"
+#include "base/memory_mapped_file.h"
 #include "base/types.h"
+#include "etw_reader/stack_trie.h"
 #include "etw_reader/thread_history.h"
 
 namespace etw_insights {
@@ -28,6 +33,7 @@ namespace etw_insights {
 class SystemHistory {
  public:
   typedef std::unordered_map<base::Tid, ThreadHistory> ThreadHistoryMap;
+  typedef std::unordered_map<base::Pid, std::string> ProcessNameMap;
 
   SystemHistory();
 
@@ -49,6 +55,10 @@ class SystemHistory {
   void SetProcessName(base::Pid process_id, const std::string& process_name);
   const std::string& GetProcessName(base::Pid process_id) const;
 
+  // Call stacks referenced by the stack histories of the threads.
+  StackTrie& stack_trie() { return stack_trie_; }
+  const StackTrie& stack_trie() const { return stack_trie_; }
+
   ThreadHistoryMap::const_iterator threads_begin() const {
     return threads_.begin();
   }
@@ -56,6 +66,20 @@ class SystemHistory {
     return threads_.end();
   }
 
+  ProcessNameMap::const_iterator processes_begin() const {
+    return process_names_.begin();
+  }
+  ProcessNameMap::const_iterator processes_end() const {
+    return process_names_.end();
+  }
+
+  // Keeps a memory-mapped file alive as long as the history. Used when the
+  // stack histories and the stack trie are views of a mapped snapshot.
+  // @param file the mapped file.
+  void set_mapped_file(std::unique_ptr<base::MemoryMappedFile> file) {
+    mapped_file_ = std::move(file);
+  }
+
  private:
   // Empty string.
   std::string empty_string_;
@@ -72,8 +96,15 @@ class SystemHistory {
   // History of each thread.
   ThreadHistoryMap threads_;
 
+  // Call stacks of all threads.
+  StackTrie stack_trie_;
+
   // Process names (Process ID -> Process Name).
-  std::unordered_map<base::Pid, std::string> process_names_;
+  ProcessNameMap process_names_;
+
+  // File in which the stack histories and the stack trie are stored, if the
+  // history was read from a snapshot.
+  std::unique_ptr<base::MemoryMappedFile> mapped_file_;
 
   DISALLOW_COPY_AND_ASSIGN(SystemHistory);
 };
@@ -0,0 +1,377 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "etw_reader/system_history_snapshot.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "base/file.h"
+#include "base/logging.h"
+#include "base/string_utils.h"
+#include "etw_reader/array_io.h"
+#include "etw_reader/etw_reader.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Extension of a snapshot file, appended to the path of the .etl file.
+const wchar_t kSnapshotFileExtension[] = L".etwhist";
+
+// Identifies a snapshot file.
+const char kSnapshotMagic[8] = {'E', 'T', 'W', 'H', 'I', 'S', 'T', '\0'};
+
+// Version of the snapshot format. Must be incremented whenever the format or
+// the way histories are generated changes.
+const uint32_t kSnapshotVersion = 2;
+
+// First bytes of a snapshot file.
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+
+  // Size and last write time of the file from which the history was built.
+  uint64_t source_size;
+  uint64_t source_last_write_time;
+
+  // Size of the snapshot file.
+  uint64_t file_size;
+
+  uint64_t first_event_ts;
+  uint64_t last_event_ts;
+  uint64_t first_non_empty_paint_ts;
+
+  uint64_t num_threads;
+  uint64_t num_stack_elements;
+  uint64_t num_processes;
+  uint64_t num_stacks;
+  uint64_t num_frames;
+};
+
+// Describes a thread in a snapshot file. The stack history of the thread is
+// the range [first_element, first_element + num_elements[ of the arrays of
+// stack timestamps and stack ids.
+struct ThreadRecord {
+  uint64_t tid;
+  uint64_t start_ts;
+  uint64_t end_ts;
+  uint64_t parent_process_id;
+  uint64_t first_element;
+  uint64_t num_elements;
+};
+
+// Writes a table of strings: the offset of each string, followed by the
+// characters of the strings.
+template <typename GetString>
+void WriteStrings(size_t num_strings,
+                  const GetString& get_string,
+                  ArrayWriter* writer) {
+  std::vector<uint64_t> offsets(1, 0);
+  offsets.reserve(num_strings + 1);
+  std::string data;
+  for (size_t i = 0; i < num_strings; ++i) {
+    data.append(get_string(i));
+    offsets.push_back(data.size());
+  }
+  writer->WriteArray(offsets.data(), offsets.size());
+  writer->WriteArray(data.data(), data.size());
+}
+
+// Reads a table of strings written by WriteStrings().
+// @returns true if the table is valid, false otherwise.
+bool ReadStrings(uint64_t num_strings,
+                 ArrayReader* reader,
+                 const uint64_t** offsets,
+                 const char** data) {
+  if (!reader->ReadArray(num_strings + 1, offsets) ||
+      !IsSorted(*offsets, num_strings + 1)) {
+    return false;
+  }
+  return reader->ReadArray((*offsets)[num_strings], data);
+}
+
+// Checks that the stack histories of the threads are within the bounds of the
+// arrays of stack timestamps and ids, sorted, and refer to existing stacks.
+bool ValidateThreads(const ThreadRecord* threads,
+                     uint64_t num_threads,
+                     const base::Timestamp* timestamps,
+                     const StackId* stack_ids,
+                     uint64_t num_elements,
+                     uint64_t num_stacks) {
+  for (uint64_t i = 0; i < num_threads; ++i) {
+    const ThreadRecord& thread = threads[i];
+    if (thread.first_element > num_elements ||
+        thread.num_elements > num_elements - thread.first_element) {
+      return false;
+    }
+    const uint64_t end = thread.first_element + thread.num_elements;
+    for (uint64_t j = thread.first_element; j < end; ++j) {
+      if (stack_ids[j] >= num_stacks ||
+          (j != thread.first_element && timestamps[j] <= timestamps[j - 1])) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Checks that the nodes of the stack trie form a tree rooted at the empty
+// stack and refer to existing frames.
+bool ValidateStacks(const StackTrie::Node* nodes,
+                    uint64_t num_stacks,
+                    uint64_t num_frames) {
+  if (num_stacks == 0 || num_stacks - 1 > UINT32_MAX ||
+      num_frames > UINT32_MAX) {
+    return false;
+  }
+  for (uint64_t i = 1; i < num_stacks; ++i) {
+    if (nodes[i].parent >= i || nodes[i].frame >= num_frames)
+      return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+bool WriteSystemHistorySnapshot(const SystemHistory& system_history,
+                                const std::wstring& trace_path) {
+  const StackTrie& stack_trie = system_history.stack_trie();
+
+  SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+  header.version = kSnapshotVersion;
+  if (!ETWReader::GetSourceSizeAndLastWriteTime(
+          trace_path, &header.source_size, &header.source_last_write_time)) {
+    LOG(ERROR) << "Unable to read the attributes of the trace.";
+    return false;
+  }
+  header.first_event_ts = system_history.first_event_ts();
+  header.last_event_ts = system_history.last_event_ts();
+  header.first_non_empty_paint_ts = system_history.first_non_empty_paint_ts();
+  header.num_stacks = stack_trie.size();
+  header.num_frames = stack_trie.frames().size();
+
+  // Threads, sorted by id so that the snapshot doesn't depend on the order of
+  // a hash map.
+  std::vector<const ThreadHistory*> threads;
+  for (auto it = system_history.threads_begin();
+       it != system_history.threads_end(); ++it) {
+    threads.push_back(&it->second);
+  }
+  std::sort(threads.begin(), threads.end(),
+            [](const ThreadHistory* a, const ThreadHistory* b) {
+              return a->tid() < b->tid();
+            });
+  std::vector<ThreadRecord> thread_records;
+  thread_records.reserve(threads.size());
+  for (const ThreadHistory* thread : threads) {
+    ThreadRecord record;
+    record.tid = thread->tid();
+    record.start_ts = thread->start_ts();
+    record.end_ts = thread->end_ts();
+    record.parent_process_id = thread->parent_process_id();
+    record.first_element = header.num_stack_elements;
+    record.num_elements = thread->Stacks().size();
+    header.num_stack_elements += record.num_elements;
+    thread_records.push_back(record);
+  }
+  header.num_threads = thread_records.size();
+
+  // Process names, sorted by process id.
+  std::vector<std::pair<uint64_t, const std::string*>> processes;
+  for (auto it = system_history.processes_begin();
+       it != system_history.processes_end(); ++it) {
+    processes.emplace_back(it->first, &it->second);
+  }
+  std::sort(processes.begin(), processes.end());
+  header.num_processes = processes.size();
+
+  std::wstring snapshot_path = SnapshotPathForTrace(trace_path);
+  std::ofstream out(snapshot_path, std::ios::out | std::ios::binary);
+  ArrayWriter writer(&out);
+
+  // The header is written again when the size of the file is known.
+  writer.WriteArray(&header, 1);
+
+  writer.WriteArray(thread_records.data(), thread_records.size());
+
+  // Stack histories, one thread after the other: the timestamps of all the
+  // threads, then their stack ids.
+  std::vector<base::Timestamp> stack_timestamps;
+  std::vector<StackId> stack_ids;
+  stack_timestamps.reserve(static_cast<size_t>(header.num_stack_elements));
+  stack_ids.reserve(static_cast<size_t>(header.num_stack_elements));
+  for (const ThreadHistory* thread : threads) {
+    for (auto it = thread->Stacks().IteratorBegin();
+         it != thread->Stacks().IteratorEnd(); ++it) {
+      stack_timestamps.push_back(it->start_ts);
+      stack_ids.push_back(it->value);
+    }
+  }
+  writer.WriteArray(stack_timestamps.data(), stack_timestamps.size());
+  writer.WriteArray(stack_ids.data(), stack_ids.size());
+
+  std::vector<uint64_t> process_ids;
+  for (const auto& process : processes)
+    process_ids.push_back(process.first);
+  writer.WriteArray(process_ids.data(), process_ids.size());
+  WriteStrings(processes.size(),
+               [&processes](size_t i) -> const std::string& {
+                 return *processes[i].second;
+               },
+               &writer);
+
+  // Stack trie. The first node is the empty stack.
+  std::vector<StackTrie::Node> nodes;
+  nodes.reserve(stack_trie.size());
+  nodes.push_back({0, kEmptyStackId});
+  for (StackId stack_id = 1; stack_id < stack_trie.size(); ++stack_id)
+    nodes.push_back({stack_trie.frame(stack_id), stack_trie.parent(stack_id)});
+  writer.WriteArray(nodes.data(), nodes.size());
+  WriteStrings(stack_trie.frames().size(),
+               [&stack_trie](size_t i) {
+                 return stack_trie.frames().GetFrame(static_cast<FrameId>(i));
+               },
+               &writer);
+
+  header.file_size = writer.offset();
+  out.seekp(0);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.close();
+
+  if (out.fail()) {
+    LOG(ERROR) << "Error while writing the snapshot of the history ("
+               << base::WStringToString(snapshot_path) << ").";
+    return false;
+  }
+  return true;
+}
+
+bool OpenSystemHistorySnapshot(const std::wstring& trace_path,
+                               SystemHistory* system_history) {
+  DCHECK(system_history != nullptr);
+  DCHECK(system_history->threads_begin() == system_history->threads_end());
+
+  uint64_t source_size = 0;
+  uint64_t source_last_write_time = 0;
+  if (!ETWReader::GetSourceSizeAndLastWriteTime(trace_path, &source_size,
+                                                &source_last_write_time)) {
+    return false;
+  }
+
+  std::wstring snapshot_path = SnapshotPathForTrace(trace_path);
+  std::unique_ptr<base::MemoryMappedFile> file(new base::MemoryMappedFile);
+  if (!base::FilePathExists(snapshot_path) || !file->Open(snapshot_path))
+    return false;
+
+  if (file->size() < sizeof(SnapshotHeader) || file->size() > SIZE_MAX ||
+      !file->Map(0, static_cast<size_t>(file->size()))) {
+    LOG(ERROR) << "Unable to map the snapshot of the history ("
+               << base::WStringToString(snapshot_path) << ").";
+    return false;
+  }
+
+  ArrayReader reader(file->data(), file->length());
+  const SnapshotHeader* header = nullptr;
+  reader.ReadArray(1, &header);
+  if (memcmp(header->magic, kSnapshotMagic, sizeof(header->magic)) != 0 ||
+      header->version != kSnapshotVersion) {
+    LOG(INFO) << "Ignoring history snapshot with an unsupported format."
+              << std::endl;
+    return false;
+  }
+  if (header->source_size != source_size ||
+      header->source_last_write_time != source_last_write_time) {
+    LOG(INFO) << "Ignoring history snapshot that doesn't match the trace."
+              << std::endl;
+    return false;
+  }
+  if (header->file_size != file->size()) {
+    LOG(ERROR) << "Ignoring truncated history snapshot.";
+    return false;
+  }
+
+  const ThreadRecord* threads = nullptr;
+  const base::Timestamp* stack_timestamps = nullptr;
+  const StackId* stack_ids = nullptr;
+  const uint64_t* process_ids = nullptr;
+  const uint64_t* process_name_offsets = nullptr;
+  const char* process_name_data = nullptr;
+  const StackTrie::Node* nodes = nullptr;
+  const uint64_t* frame_offsets = nullptr;
+  const char* frame_data = nullptr;
+  if (!reader.ReadArray(header->num_threads, &threads) ||
+      !reader.ReadArray(header->num_stack_elements, &stack_timestamps) ||
+      !reader.ReadArray(header->num_stack_elements, &stack_ids) ||
+      !reader.ReadArray(header->num_processes, &process_ids) ||
+      !ReadStrings(header->num_processes, &reader, &process_name_offsets,
+                   &process_name_data) ||
+      !reader.ReadArray(header->num_stacks, &nodes) ||
+      !ReadStrings(header->num_frames, &reader, &frame_offsets,
+                   &frame_data) ||
+      !ValidateStacks(nodes, header->num_stacks, header->num_frames) ||
+      !ValidateThreads(threads, header->num_threads, stack_timestamps,
+                       stack_ids, header->num_stack_elements,
+                       header->num_stacks)) {
+    LOG(ERROR) << "Ignoring invalid history snapshot.";
+    return false;
+  }
+
+  system_history->set_first_event_ts(header->first_event_ts);
+  system_history->set_last_event_ts(header->last_event_ts);
+  system_history->set_first_non_empty_paint_ts(
+      header->first_non_empty_paint_ts);
+
+  // The stack histories are views of the mapped arrays.
+  for (uint64_t i = 0; i < header->num_threads; ++i) {
+    const ThreadRecord& record = threads[i];
+    ThreadHistory& thread = system_history->GetThread(record.tid);
+    thread.set_start_ts(record.start_ts);
+    thread.set_end_ts(record.end_ts);
+    thread.set_parent_process_id(record.parent_process_id);
+    thread.Stacks().SetView(stack_timestamps + record.first_element,
+                            stack_ids + record.first_element,
+                            static_cast<size_t>(record.num_elements));
+  }
+
+  for (uint64_t i = 0; i < header->num_processes; ++i) {
+    system_history->SetProcessName(
+        process_ids[i],
+        std::string(process_name_data + process_name_offsets[i],
+                    static_cast<size_t>(process_name_offsets[i + 1] -
+                                        process_name_offsets[i])));
+  }
+
+  system_history->stack_trie().SetView(
+      nodes, static_cast<size_t>(header->num_stacks), frame_offsets,
+      frame_data, static_cast<size_t>(header->num_frames));
+  system_history->set_mapped_file(std::move(file));
+  return true;
+}
+
+std::wstring SnapshotPathForTrace(const std::wstring& trace_path) {
+  return trace_path + kSnapshotFileExtension;
+}
+
+}  // namespace etw_insights
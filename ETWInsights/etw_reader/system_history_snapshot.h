@@ -0,0 +1,56 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+
+#include "etw_reader/system_history.h"
+
+namespace etw_insights {
+
+// The system history of a whole trace is saved in a <trace>.etl.etwhist
+// snapshot, next to the trace, so that later analyses of the trace with other
+// filters don't have to read its events again.
+//
+// A snapshot is used in place once mapped in memory: the stack histories of
+// the threads, the nodes of the stack trie and the frames are stored as
+// arrays with the layout that they have in memory, and the stack histories
+// and the stack trie of a history read from a snapshot are read-only views of
+// these arrays. Only the table of threads and the process names are copied.
+// Like the cache of the events, the snapshot records the size and last write
+// time of the file it was built from, and is ignored when they change.
+
+// Writes the snapshot of the system history of a trace.
+// @param system_history the history of all the events of the trace.
+// @param trace_path Path to the .etl file of the trace.
+// @returns true if the snapshot was written successfully, false otherwise.
+bool WriteSystemHistorySnapshot(const SystemHistory& system_history,
+                                const std::wstring& trace_path);
+
+// Reads the snapshot of the system history of a trace.
+// @param trace_path Path to the .etl file of the trace.
+// @param system_history an empty system history, filled with views of the
+//     mapped snapshot on success. Nothing can be added to it afterwards.
+// @returns true if the snapshot exists and is up to date, false otherwise.
+bool OpenSystemHistorySnapshot(const std::wstring& trace_path,
+                               SystemHistory* system_history);
+
+// @param trace_path Path to the .etl file of a trace.
+// @returns the path of the snapshot of the system history of the trace.
+std::wstring SnapshotPathForTrace(const std::wstring& trace_path);
+
+}  // namespace etw_insights
@@ -18,7 +18,7 @@ limitations under the License.
 
 #include "base/history.h"
 #include "base/types.h"
-#include "etw_reader/stack.h"
+#include "etw_reader/stack_trie.h"
 
 namespace etw_insights {
 
@@ -49,7 +49,9 @@ class ThreadHistory {
   }
   base::Timestamp parent_process_id() const { return parent_process_id_; }
 
-  typedef base::History<Stack> StackHistory;
+  // History of the call stacks of the thread. Stack ids refer to the
+  // StackTrie of the SystemHistory that contains the thread.
+  typedef base::History<StackId> StackHistory;
   StackHistory& Stacks() { return stacks_; }
   const StackHistory& Stacks() const { return stacks_; }
 
@@ -0,0 +1,311 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "etw_reader/timestamp_index.h"
+
+#include <string.h>
+
+#include <fstream>
+
+#include "base/file.h"
+#include "base/logging.h"
+#include "base/numeric_conversions.h"
+#include "base/string_utils.h"
+#include "etw_reader/csv_tokenizer.h"
+#include "etw_reader/etw_reader.h"
+#include "etw_reader/line_reader.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Extension of an index file, appended to the path of the .etl file.
+const wchar_t kIndexFileExtension[] = L".etwidx";
+
+// Identifies an index file.
+const char kIndexMagic[8] = {'E', 'T', 'W', 'I', 'D', 'X', '\0', '\0'};
+
+// Version of the index format.
+const uint32_t kIndexVersion = 2;
+
+// Number of bits in a word of a set of event types, and maximum number of
+// words in a set, beyond which an index is considered corrupted.
+const size_t kBitsPerTypeWord = 64;
+const uint32_t kMaxTypeWords = 1024;
+
+// Lines that hold the call stack of the event that precedes them.
+const char kStackType[] = "Stack";
+
+// Column that holds the timestamp of events.
+const char kTimestampColumn[] = "TimeStamp";
+
+// First bytes of an index file.
+struct IndexHeader {
+  char magic[8];
+  uint32_t version;
+
+  // Number of 64-bit words in the set of event types of a block.
+  uint32_t num_type_words;
+
+  // Size and last write time of the CSV dump from which the index was built.
+  uint64_t csv_size;
+  uint64_t csv_last_write_time;
+
+  uint64_t num_blocks;
+};
+
+}  // namespace
+
+TimestampIndex::TimestampIndex() : num_type_words_(0) {}
+
+TimestampIndex::~TimestampIndex() {}
+
+bool TimestampIndex::Load(const std::wstring& trace_path,
+                          const EventSchema& schema,
+                          uint64_t first_event_offset) {
+  std::wstring csv_path = ETWReader::CsvPathForTrace(trace_path);
+  uint64_t csv_size = 0;
+  uint64_t csv_last_write_time = 0;
+  if (!base::GetFileSizeAndLastWriteTime(csv_path, &csv_size,
+                                         &csv_last_write_time)) {
+    return false;
+  }
+
+  std::wstring index_path = IndexPathForTrace(trace_path);
+  if (Read(index_path, csv_size, csv_last_write_time))
+    return true;
+
+  LOG(INFO) << "Indexing the timestamps of the trace." << std::endl;
+  if (!Build(csv_path, schema, first_event_offset))
+    return false;
+  Write(index_path, csv_size, csv_last_write_time);
+  return true;
+}
+
+void TimestampIndex::GetRanges(const Subscription& subscription,
+                               const EventSchema& schema,
+                               std::vector<Range>* ranges) const {
+  DCHECK(subscription.HasWindow());
+  DCHECK(ranges != nullptr);
+  ranges->clear();
+
+  // Event types read in the whole trace.
+  std::vector<uint64_t> whole_trace_types(num_type_words_, 0);
+  for (const auto& event_type : subscription.event_types) {
+    if (event_type.second != kSubscribedInWholeTrace)
+      continue;
+    EventTypeId type_id = schema.GetTypeId(event_type.first);
+    if (type_id != kUnknownEventTypeId &&
+        type_id / kBitsPerTypeWord < num_type_words_) {
+      whole_trace_types[type_id / kBitsPerTypeWord] |=
+          static_cast<uint64_t>(1) << (type_id % kBitsPerTypeWord);
+    }
+  }
+
+  for (size_t i = 0; i < blocks_.size(); ++i) {
+    const Block& block = blocks_[i];
+
+    // A block without any timestamp is read as if it was in the window.
+    bool in_window = block.min_ts > block.max_ts ||
+                     (block.max_ts >= subscription.start_ts &&
+                      block.min_ts <= subscription.end_ts);
+    if (!in_window && !HasTypes(i, whole_trace_types))
+      continue;
+
+    uint64_t end_offset =
+        i + 1 < blocks_.size() ? blocks_[i + 1].offset : UINT64_MAX;
+    if (!ranges->empty() && ranges->back().end_offset == block.offset &&
+        ranges->back().in_window == in_window) {
+      ranges->back().end_offset = end_offset;
+    } else {
+      ranges->push_back({block.offset, end_offset, in_window});
+    }
+  }
+}
+
+std::wstring TimestampIndex::IndexPathForTrace(
+    const std::wstring& trace_path) {
+  return trace_path + kIndexFileExtension;
+}
+
+bool TimestampIndex::Read(const std::wstring& index_path,
+                          uint64_t csv_size,
+                          uint64_t csv_last_write_time) {
+  if (!base::FilePathExists(index_path))
+    return false;
+
+  std::ifstream in(index_path, std::ios::in | std::ios::binary);
+  IndexHeader header;
+  if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      memcmp(header.magic, kIndexMagic, sizeof(header.magic)) != 0 ||
+      header.version != kIndexVersion) {
+    LOG(INFO) << "Ignoring timestamp index with an unsupported format."
+              << std::endl;
+    return false;
+  }
+  if (header.csv_size != csv_size ||
+      header.csv_last_write_time != csv_last_write_time) {
+    LOG(INFO) << "Ignoring timestamp index older than the CSV dump of the "
+                 "trace."
+              << std::endl;
+    return false;
+  }
+  if (header.num_blocks > csv_size ||
+      header.num_type_words > kMaxTypeWords) {
+    LOG(ERROR) << "Ignoring corrupted timestamp index.";
+    return false;
+  }
+
+  blocks_.resize(static_cast<size_t>(header.num_blocks));
+  num_type_words_ = header.num_type_words;
+  type_sets_.resize(blocks_.size() * num_type_words_);
+  if (!in.read(reinterpret_cast<char*>(blocks_.data()),
+               blocks_.size() * sizeof(Block)) ||
+      !in.read(reinterpret_cast<char*>(type_sets_.data()),
+               type_sets_.size() * sizeof(uint64_t))) {
+    LOG(ERROR) << "Ignoring truncated timestamp index.";
+    blocks_.clear();
+    type_sets_.clear();
+    return false;
+  }
+  for (size_t i = 1; i < blocks_.size(); ++i) {
+    if (blocks_[i].offset <= blocks_[i - 1].offset) {
+      LOG(ERROR) << "Ignoring corrupted timestamp index.";
+      blocks_.clear();
+      type_sets_.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+bool TimestampIndex::Build(const std::wstring& csv_path,
+                           const EventSchema& schema,
+                           uint64_t first_event_offset) {
+  blocks_.clear();
+  num_type_words_ =
+      (schema.num_types() + kBitsPerTypeWord - 1) / kBitsPerTypeWord;
+  type_sets_.clear();
+
+  LineReader line_reader;
+  if (!line_reader.Open(csv_path) || !line_reader.Seek(first_event_offset))
+    return false;
+
+  const EventTypeId stack_type_id = schema.GetTypeId(kStackType);
+  const AnyTypeColumnRef timestamp_column =
+      schema.ColumnForAllTypes(kTimestampColumn);
+
+  uint64_t num_lines_in_block = 0;
+  for (;;) {
+    uint64_t offset = line_reader.offset();
+    std::string_view line;
+    if (!line_reader.ReadLine(&line))
+      break;
+
+    // Read the type of the line.
+    CsvTokenizer tokenizer(line);
+    const char* field_begin = nullptr;
+    const char* field_end = nullptr;
+    tokenizer.NextField(&field_begin, &field_end);
+    EventTypeId type_id = kEmptyEventTypeId;
+    if (field_begin != field_end || !tokenizer.AtEnd()) {
+      type_id = schema.GetTypeId(
+          std::string_view(field_begin, field_end - field_begin));
+    }
+
+    // Start a new block at a line that can start an event.
+    if (blocks_.empty() ||
+        (num_lines_in_block >= kLinesPerBlock &&
+         type_id != kEmptyEventTypeId && type_id != stack_type_id)) {
+      Block block;
+      block.offset = blocks_.empty() ? first_event_offset : offset;
+      block.min_ts = base::kInvalidTimestamp;
+      block.max_ts = 0;
+      blocks_.push_back(block);
+      type_sets_.resize(type_sets_.size() + num_type_words_, 0);
+      num_lines_in_block = 0;
+    }
+    ++num_lines_in_block;
+
+    // Add the type of the line to the types of the block.
+    if (type_id != kUnknownEventTypeId) {
+      type_sets_[type_sets_.size() - num_type_words_ +
+                 type_id / kBitsPerTypeWord] |=
+          static_cast<uint64_t>(1) << (type_id % kBitsPerTypeWord);
+    }
+
+    // Read the timestamp of the line.
+    size_t timestamp_index = timestamp_column.IndexForType(type_id);
+    if (timestamp_index == kInvalidColumnIndex)
+      continue;
+    bool has_field = true;
+    for (size_t i = 0; i <= timestamp_index && has_field; ++i)
+      has_field = tokenizer.NextField(&field_begin, &field_end);
+    uint64_t ts = 0;
+    if (!has_field ||
+        base::ParseULong(std::string_view(field_begin, field_end - field_begin),
+                         &ts) != base::kParseOk) {
+      continue;
+    }
+    Block& block = blocks_.back();
+    if (ts < block.min_ts)
+      block.min_ts = ts;
+    if (ts > block.max_ts)
+      block.max_ts = ts;
+  }
+  return true;
+}
+
+bool TimestampIndex::HasTypes(size_t block_index,
+                              const std::vector<uint64_t>& type_set) const {
+  DCHECK_EQ(type_set.size(), num_type_words_);
+  const uint64_t* block_types = &type_sets_[block_index * num_type_words_];
+  for (size_t i = 0; i < num_type_words_; ++i) {
+    if ((block_types[i] & type_set[i]) != 0)
+      return true;
+  }
+  return false;
+}
+
+bool TimestampIndex::Write(const std::wstring& index_path,
+                           uint64_t csv_size,
+                           uint64_t csv_last_write_time) const {
+  IndexHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kIndexMagic, sizeof(header.magic));
+  header.version = kIndexVersion;
+  header.csv_size = csv_size;
+  header.csv_last_write_time = csv_last_write_time;
+  header.num_type_words = static_cast<uint32_t>(num_type_words_);
+  header.num_blocks = blocks_.size();
+
+  std::ofstream out(index_path, std::ios::out | std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(blocks_.data()),
+            blocks_.size() * sizeof(Block));
+  out.write(reinterpret_cast<const char*>(type_sets_.data()),
+            type_sets_.size() * sizeof(uint64_t));
+  out.close();
+
+  if (out.fail()) {
+    LOG(ERROR) << "Error while writing the timestamp index of the trace ("
+               << base::WStringToString(index_path) << ").";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,129 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "base/base.h"
+#include "base/types.h"
+#include "etw_reader/event_schema.h"
+#include "etw_reader/subscription.h"
+
+namespace etw_insights {
+
+// Sparse index of the timestamps of the CSV dump of a trace, persisted in a
+// <trace>.etl.etwidx file next to the trace. The events of the CSV dump are
+// divided in blocks of about kLinesPerBlock lines. Blocks start at lines that
+// can start an event: never in the middle of the lines of a Stack event. The
+// index stores the offset of each block, the range of the timestamps of its
+// lines, which don't have to be sorted, and the set of the event types of its
+// lines.
+class TimestampIndex {
+ public:
+  // Minimum number of lines in a block.
+  static const uint64_t kLinesPerBlock = 64 * 1024;
+
+  // A range of the CSV dump to read.
+  struct Range {
+    uint64_t begin_offset;
+
+    // UINT64_MAX for the end of the CSV dump.
+    uint64_t end_offset;
+
+    // Whether some lines of the range may have a timestamp in the window.
+    // Otherwise, only the lines of the types read in the whole trace are
+    // selected.
+    bool in_window;
+  };
+
+  TimestampIndex();
+  ~TimestampIndex();
+
+  // Loads the index of a trace. Builds it and writes it if it doesn't exist
+  // or if it is older than the CSV dump of the trace.
+  // @param trace_path Path to the .etl file of the trace.
+  // @param schema the event types of the trace.
+  // @param first_event_offset offset of the first event in the CSV dump.
+  // @returns true if the index was loaded or built successfully.
+  bool Load(const std::wstring& trace_path,
+            const EventSchema& schema,
+            uint64_t first_event_offset);
+
+  // Finds the ranges of the CSV dump that contain the lines selected by a
+  // subscription: the blocks that have a timestamp in its window and, outside
+  // of the window, the blocks that have lines of the types that are read in
+  // the whole trace. The other blocks don't have to be read.
+  // @param subscription the lines to read. Must have a window.
+  // @param schema the event types of the trace.
+  // @param ranges the ranges to read, in the order of the CSV dump, output.
+  void GetRanges(const Subscription& subscription,
+                 const EventSchema& schema,
+                 std::vector<Range>* ranges) const;
+
+  // @param trace_path Path to the .etl file of a trace.
+  // @returns the path of the index of the trace.
+  static std::wstring IndexPathForTrace(const std::wstring& trace_path);
+
+ private:
+  // A block of lines of the CSV dump.
+  struct Block {
+    // Offset of the first line of the block.
+    uint64_t offset;
+
+    // Range of the timestamps of the lines of the block. |min_ts| is greater
+    // than |max_ts| if no line of the block has a timestamp.
+    base::Timestamp min_ts;
+    base::Timestamp max_ts;
+  };
+
+  // Reads the index of a trace.
+  // @returns true if the index exists and matches the CSV dump.
+  bool Read(const std::wstring& index_path,
+            uint64_t csv_size,
+            uint64_t csv_last_write_time);
+
+  // Builds the index of a CSV dump.
+  // @returns true if successful.
+  bool Build(const std::wstring& csv_path,
+             const EventSchema& schema,
+             uint64_t first_event_offset);
+
+  // Writes the index of a trace.
+  // @returns true if successful.
+  bool Write(const std::wstring& index_path,
+             uint64_t csv_size,
+             uint64_t csv_last_write_time) const;
+
+  // @returns true if block |block_index| has a line of a type of |type_set|,
+  //     a bit set indexed by type id.
+  bool HasTypes(size_t block_index,
+                const std::vector<uint64_t>& type_set) const;
+
+  // Blocks, in the order of the CSV dump.
+  std::vector<Block> blocks_;
+
+  // Event types of the lines of each block, as bit sets of |num_type_words_|
+  // 64-bit words per block, indexed by type id.
+  size_t num_type_words_;
+  std::vector<uint64_t> type_sets_;
+
+  DISALLOW_COPY_AND_ASSIGN(TimestampIndex);
+};
+
+}  // namespace etw_insights
@@ -0,0 +1,178 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "etw_reader/trace_analyzer.h"
+
+#include <memory>
+
+#include "base/base.h"
+#include "base/logging.h"
+#include "etw_reader/etw_reader.h"
+#include "etw_reader/trace_event_cache.h"
+#include "etw_reader/trace_event_decoder.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Feeds the events of a trace to analyzers, according to their
+// subscriptions.
+class AnalyzerSet {
+ public:
+  AnalyzerSet(const std::vector<TraceAnalyzer*>& analyzers,
+              const std::vector<Subscription>& subscriptions,
+              const EventSchema& schema)
+      : num_active_analyzers_(analyzers.size()) {
+    DCHECK_EQ(analyzers.size(), subscriptions.size());
+    for (size_t i = 0; i < analyzers.size(); ++i) {
+      entries_.emplace_back();
+      Entry& entry = entries_.back();
+      entry.analyzer = analyzers[i];
+      if (!subscriptions[i].SelectsAll())
+        entry.filter.reset(new SubscriptionFilter(subscriptions[i], schema));
+      entry.active = true;
+      entry.analyzer->OnBeginTrace(schema);
+    }
+  }
+
+  ~AnalyzerSet() {
+    for (auto& entry : entries_)
+      entry.analyzer->OnEndTrace();
+  }
+
+  // Gives an event to the analyzers that subscribed to it.
+  // @param event the event.
+  // @returns false if no analyzer needs more events.
+  bool Dispatch(const TraceEvent& event) {
+    for (auto& entry : entries_) {
+      if (!entry.active || !Selects(&entry, event))
+        continue;
+      if (!entry.analyzer->OnEvent(event)) {
+        entry.active = false;
+        --num_active_analyzers_;
+      }
+    }
+    return num_active_analyzers_ != 0;
+  }
+
+ private:
+  struct Entry {
+    TraceAnalyzer* analyzer;
+
+    // Applies the subscription of the analyzer. Null if the analyzer
+    // subscribed to all events.
+    std::unique_ptr<SubscriptionFilter> filter;
+
+    // Whether the analyzer needs more events.
+    bool active;
+  };
+
+  // @returns true if the subscription of an analyzer selects an event.
+  static bool Selects(Entry* entry, const TraceEvent& event) {
+    if (!entry->filter)
+      return true;
+    switch (entry->filter->SelectType(event.type_id)) {
+      case SubscriptionFilter::kSelected:
+        return true;
+      case SubscriptionFilter::kNeedsTimestamp:
+        return entry->filter->SelectTimestamp(event.ts);
+      default:
+        return false;
+    }
+  }
+
+  std::vector<Entry> entries_;
+
+  size_t num_active_analyzers_;
+
+  DISALLOW_COPY_AND_ASSIGN(AnalyzerSet);
+};
+
+}  // namespace
+
+bool AnalyzeTrace(const std::wstring& trace_path,
+                  base::ThreadPool* thread_pool,
+                  const std::vector<TraceAnalyzer*>& analyzers) {
+  DCHECK(!analyzers.empty());
+
+  std::vector<Subscription> subscriptions;
+  for (const TraceAnalyzer* analyzer : analyzers)
+    subscriptions.push_back(analyzer->GetSubscription());
+  Subscription subscription = MergeSubscriptions(subscriptions);
+
+  // Read the events from the cache of the trace, if it is up to date.
+  TraceEventCache cache;
+  if (cache.Open(trace_path)) {
+    LOG(INFO) << "Reading trace events from cache." << std::endl;
+    AnalyzerSet analyzer_set(analyzers, subscriptions, cache.schema());
+    cache.ReadEvents(subscription, [&analyzer_set](TraceEvent* event) {
+      return analyzer_set.Dispatch(*event);
+    });
+    return true;
+  }
+
+  // Open the CSV trace.
+  ETWReader etw_reader;
+  if (!etw_reader.Open(trace_path, subscription))
+    return false;
+  AnalyzerSet analyzer_set(analyzers, subscriptions, etw_reader.schema());
+
+  // The events are decoded in parallel but dispatched in the order of the
+  // trace. When only some events are read, the cache can't be written.
+  if (!subscription.SelectsAll()) {
+    LOG(INFO) << "Reading subscribed trace events." << std::endl;
+    DecodeTraceEvents(etw_reader, thread_pool,
+                      [&analyzer_set](TraceEvent* event) {
+                        return analyzer_set.Dispatch(*event);
+                      });
+    return !etw_reader.stream_failed();
+  }
+
+  // The cache is written while the events are read, one block at a time.
+  TraceEventCacheWriter cache_writer(etw_reader.schema());
+  bool writing_cache = cache_writer.Open(trace_path);
+
+  // Tell the user what we are doing.
+  LOG(INFO) << "Reading trace events." << std::endl;
+
+  // Traverse all the events of the CSV trace. The cache must contain all the
+  // events, so the traversal continues after the analyzers are done.
+  bool dispatching = true;
+  DecodeTraceEvents(etw_reader, thread_pool,
+                    [&analyzer_set, &cache_writer,
+                     &dispatching](TraceEvent* event) {
+                      cache_writer.AddEvent(*event);
+                      if (dispatching)
+                        dispatching = analyzer_set.Dispatch(*event);
+                      return true;
+                    });
+
+  // The events are incomplete if xperf failed. The cache is then left
+  // incomplete, and ignored.
+  if (etw_reader.stream_failed())
+    return false;
+
+  // Finish the cache of the decoded events, for the next analysis of the
+  // trace.
+  if (writing_cache) {
+    LOG(INFO) << "Writing trace cache." << std::endl;
+    cache_writer.Close();
+  }
+
+  return true;
+}
+
+}  // namespace etw_insights
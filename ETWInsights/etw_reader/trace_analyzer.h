@@ -0,0 +1,66 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "base/thread_pool.h"
+#include "etw_reader/event_schema.h"
+#include "etw_reader/subscription.h"
+#include "etw_reader/trace_event.h"
+
+namespace etw_insights {
+
+// An analysis of the events of a trace. Any number of analyzers can be fed
+// by AnalyzeTrace() from a single parse of the trace.
+class TraceAnalyzer {
+ public:
+  virtual ~TraceAnalyzer() {}
+
+  // @returns the events consumed by the analyzer. The analyzer only receives
+  //     the events selected by this subscription.
+  virtual Subscription GetSubscription() const = 0;
+
+  // Called before the first event of the trace.
+  // @param schema the event types of the trace.
+  virtual void OnBeginTrace(const EventSchema& /* schema */) {}
+
+  // Receives a decoded event, in the order of the trace.
+  // @param event the event.
+  // @returns false if the analyzer doesn't need more events.
+  virtual bool OnEvent(const TraceEvent& event) = 0;
+
+  // Called after the last event received by the analyzer.
+  virtual void OnEndTrace() {}
+};
+
+// Parses a trace once and feeds its events to analyzers. The trace is read
+// from its cache if it is up to date. Otherwise, the CSV dump of the trace is
+// parsed with the merged subscriptions of the analyzers, and the cache is
+// written if they select all the events of the trace. The traversal stops
+// early once no analyzer needs more events, unless the cache is written.
+// @param trace_path Path to a .etl trace file.
+// @param thread_pool Threads used to parse the trace, or nullptr to parse it
+//     on the calling thread.
+// @param analyzers the analyzers to feed.
+// @returns true if the trace was read successfully, false otherwise.
+bool AnalyzeTrace(const std::wstring& trace_path,
+                  base::ThreadPool* thread_pool,
+                  const std::vector<TraceAnalyzer*>& analyzers);
+
+}  // namespace etw_insights
@@ -0,0 +1,100 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+
+#include "base/types.h"
+#include "etw_reader/event_schema.h"
+#include "etw_reader/stack.h"
+
+namespace etw_insights {
+
+// Kind of a decoded event. Determines which fields of TraceEvent are set.
+enum TraceEventKind {
+  // An event that is only used for its timestamp and thread id.
+  kOtherEventKind,
+  // A call stack, decoded from a sequence of Stack lines.
+  kStackEventKind,
+  // A context switch.
+  kCSwitchEventKind,
+  // A process start.
+  kProcessStartEventKind,
+  // A thread start.
+  kThreadStartEventKind,
+  // A thread end.
+  kThreadEndEventKind,
+  // The beginning of a file operation.
+  kFileIoEventKind,
+  // The end of a file operation.
+  kFileIoOpEndEventKind,
+  // A Chrome event.
+  kChromeEventKind,
+
+  kNumEventKinds
+};
+
+// An event of a trace, decoded from one or more lines of its CSV dump. Unlike
+// ETWReader::Line, a decoded event doesn't point into the CSV file.
+struct TraceEvent {
+  TraceEvent()
+      : kind(kOtherEventKind),
+        type_id(kUnknownEventTypeId),
+        ts(0),
+        tid(base::kInvalidTid),
+        new_tid(base::kInvalidTid),
+        old_tid(base::kInvalidTid),
+        time_since_last(0),
+        logging_tid(base::kInvalidTid),
+        pid(base::kInvalidPid),
+        is_first_non_empty_paint(false) {}
+
+  TraceEventKind kind;
+  EventTypeId type_id;
+
+  // Timestamp. 0 if the event doesn't have one.
+  base::Timestamp ts;
+
+  // Thread on which the event occurred: the ThreadID column if the event has
+  // one, the New TID column otherwise. kInvalidTid if the event has none of
+  // these columns.
+  base::Tid tid;
+
+  // CSwitch: the threads that were switched in and out, and the time since the
+  // new thread was switched out.
+  base::Tid new_tid;
+  base::Tid old_tid;
+  base::Timestamp time_since_last;
+
+  // FileIo, FileIoOpEnd: the thread that performs the file operation.
+  base::Tid logging_tid;
+
+  // Process start, thread start: the process id.
+  base::Pid pid;
+
+  // Process start: the process name.
+  // FileIo: a description of the file operation.
+  std::string text;
+
+  // Stack: the frames of the stack, from the top of the stack.
+  Stack stack;
+
+  // Chrome: true if the event marks the first non empty paint.
+  bool is_first_non_empty_paint;
+};
+
+}  // namespace etw_insights
@@ -0,0 +1,706 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "etw_reader/trace_event_cache.h"
+
+#include <string.h>
+
+#include "base/file.h"
+#include "base/logging.h"
+#include "base/string_utils.h"
+#include "etw_reader/etw_reader.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Extension of a cache file, appended to the path of the .etl file.
+const wchar_t kCacheFileExtension[] = L".etwbin";
+
+// Identifies a cache file.
+const char kCacheMagic[8] = {'E', 'T', 'W', 'B', 'I', 'N', '\0', '\0'};
+
+// Version of the cache format. Must be incremented whenever the format or
+// the way events are decoded changes.
+const uint32_t kCacheVersion = 4;
+
+// Maximum number of events and stack frames in a block. Blocks are small
+// enough to be mapped in the address space of a 32-bit process, and a block
+// never has more streams than events, so stream indexes fit in 16 bits.
+const size_t kMaxEventsPerBlock = 1 << 15;
+const size_t kMaxFramesPerBlock = 1 << 22;
+
+// First bytes of a cache file.
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+
+  // Number of event types, including the empty and unknown types.
+  uint32_t num_types;
+
+  // Size and last write time of the file from which the cache was built.
+  uint64_t source_size;
+  uint64_t source_last_write_time;
+
+  // Size of the cache file.
+  uint64_t file_size;
+
+  uint64_t num_events;
+
+  // Offset of the tables that follow the blocks.
+  uint64_t tables_offset;
+
+  uint32_t num_blocks;
+  uint32_t num_strings;
+};
+
+// First bytes of a block of events.
+struct BlockHeader {
+  uint64_t num_events;
+  uint32_t num_streams;
+  uint32_t reserved;
+};
+
+// Describes a stream of events in a block.
+struct StreamHeader {
+  uint32_t type_id;
+  uint32_t kind;
+  uint64_t num_events;
+  uint64_t num_frames;
+};
+
+// Calls |visitor| for each column of a stream of events, in the order in
+// which the columns are stored in a cache file, with the number of elements
+// of the column.
+template <typename Stream, typename Visitor>
+void VisitColumns(TraceEventKind kind,
+                  uint64_t num_events,
+                  uint64_t num_frames,
+                  Stream* stream,
+                  Visitor* visitor) {
+  (*visitor)(&stream->ts, num_events);
+  (*visitor)(&stream->tid, num_events);
+  switch (kind) {
+    case kStackEventKind:
+      (*visitor)(&stream->frames_begin, num_events + 1);
+      (*visitor)(&stream->frames, num_frames);
+      break;
+    case kCSwitchEventKind:
+      (*visitor)(&stream->new_tid, num_events);
+      (*visitor)(&stream->old_tid, num_events);
+      (*visitor)(&stream->time_since_last, num_events);
+      break;
+    case kProcessStartEventKind:
+      (*visitor)(&stream->pid, num_events);
+      (*visitor)(&stream->text, num_events);
+      break;
+    case kThreadStartEventKind:
+      (*visitor)(&stream->pid, num_events);
+      break;
+    case kFileIoEventKind:
+      (*visitor)(&stream->logging_tid, num_events);
+      (*visitor)(&stream->text, num_events);
+      break;
+    case kFileIoOpEndEventKind:
+      (*visitor)(&stream->logging_tid, num_events);
+      break;
+    case kChromeEventKind:
+      (*visitor)(&stream->is_first_non_empty_paint, num_events);
+      break;
+    default:
+      break;
+  }
+}
+
+uint64_t StreamKey(EventTypeId type_id, TraceEventKind kind) {
+  return (static_cast<uint64_t>(type_id) << 8) | kind;
+}
+
+}  // namespace
+
+// Columns of a stream of events of the current block, before they are
+// written.
+struct TraceEventCacheWriter::Stream {
+  Stream(EventTypeId type_id, TraceEventKind kind)
+      : type_id(type_id), kind(kind), frames_begin(1, 0) {}
+
+  EventTypeId type_id;
+  TraceEventKind kind;
+
+  std::vector<uint64_t> ts;
+  std::vector<uint64_t> tid;
+  std::vector<uint64_t> new_tid;
+  std::vector<uint64_t> old_tid;
+  std::vector<uint64_t> time_since_last;
+  std::vector<uint64_t> logging_tid;
+  std::vector<uint64_t> pid;
+  std::vector<uint32_t> text;
+  std::vector<uint8_t> is_first_non_empty_paint;
+
+  // The frames of event i are frames[frames_begin[i], frames_begin[i + 1]).
+  std::vector<uint64_t> frames_begin;
+  std::vector<uint32_t> frames;
+};
+
+// Columns of a stream of events, in the mapped block.
+struct TraceEventCache::Stream {
+  Stream()
+      : type_id(kUnknownEventTypeId),
+        kind(kOtherEventKind),
+        num_events(0),
+        num_frames(0),
+        ts(nullptr),
+        tid(nullptr),
+        new_tid(nullptr),
+        old_tid(nullptr),
+        time_since_last(nullptr),
+        logging_tid(nullptr),
+        pid(nullptr),
+        text(nullptr),
+        is_first_non_empty_paint(nullptr),
+        frames_begin(nullptr),
+        frames(nullptr) {}
+
+  EventTypeId type_id;
+  TraceEventKind kind;
+  uint64_t num_events;
+  uint64_t num_frames;
+
+  const uint64_t* ts;
+  const uint64_t* tid;
+  const uint64_t* new_tid;
+  const uint64_t* old_tid;
+  const uint64_t* time_since_last;
+  const uint64_t* logging_tid;
+  const uint64_t* pid;
+  const uint32_t* text;
+  const uint8_t* is_first_non_empty_paint;
+  const uint64_t* frames_begin;
+  const uint32_t* frames;
+};
+
+// Arrays of the mapped block.
+struct TraceEventCache::Block {
+  Block() : num_events(0), event_streams(nullptr) {}
+
+  uint64_t num_events;
+  const uint16_t* event_streams;
+  std::vector<Stream> streams;
+};
+
+TraceEventCacheWriter::TraceEventCacheWriter(const EventSchema& schema)
+    : writer_(&out_),
+      block_offsets_(1, 0),
+      num_events_(0),
+      num_frames_(0),
+      overflow_(false) {
+  for (EventTypeId type_id = 0; type_id < schema.num_types(); ++type_id)
+    type_names_.push_back(schema.GetTypeName(type_id));
+}
+
+TraceEventCacheWriter::~TraceEventCacheWriter() {}
+
+bool TraceEventCacheWriter::Open(const std::wstring& trace_path) {
+  DCHECK(!out_.is_open());
+
+  trace_path_ = trace_path;
+  cache_path_ = TraceEventCache::CachePathForTrace(trace_path);
+  out_.open(cache_path_, std::ios::out | std::ios::binary);
+  if (!out_.is_open()) {
+    LOG(ERROR) << "Unable to create the cache of the trace ("
+               << base::WStringToString(cache_path_) << ").";
+    return false;
+  }
+
+  // The header is written when the cache is closed. Until then, the size of
+  // the file in the header doesn't match, and the cache is ignored.
+  CacheHeader header;
+  memset(&header, 0, sizeof(header));
+  writer_.WriteArray(&header, 1);
+  return true;
+}
+
+void TraceEventCacheWriter::AddEvent(const TraceEvent& event) {
+  if (overflow_ || !out_.is_open())
+    return;
+
+  if (event_streams_.size() == kMaxEventsPerBlock ||
+      num_frames_ + event.stack.size() > kMaxFramesPerBlock) {
+    WriteBlock();
+  }
+
+  // Find the stream of the event.
+  uint64_t stream_key = StreamKey(event.type_id, event.kind);
+  auto look_stream = stream_indexes_.find(stream_key);
+  if (look_stream == stream_indexes_.end()) {
+    uint16_t stream_index = static_cast<uint16_t>(streams_.size());
+    streams_.emplace_back(new Stream(event.type_id, event.kind));
+    look_stream = stream_indexes_.insert({stream_key, stream_index}).first;
+  }
+  event_streams_.push_back(look_stream->second);
+  ++num_events_;
+
+  // Append the fields of the event to the columns of the stream.
+  Stream& stream = *streams_[look_stream->second];
+  stream.ts.push_back(event.ts);
+  stream.tid.push_back(event.tid);
+  switch (event.kind) {
+    case kStackEventKind:
+      for (const auto& frame : event.stack)
+        stream.frames.push_back(GetStringIndex(frame));
+      stream.frames_begin.push_back(stream.frames.size());
+      num_frames_ += event.stack.size();
+      break;
+    case kCSwitchEventKind:
+      stream.new_tid.push_back(event.new_tid);
+      stream.old_tid.push_back(event.old_tid);
+      stream.time_since_last.push_back(event.time_since_last);
+      break;
+    case kProcessStartEventKind:
+      stream.pid.push_back(event.pid);
+      stream.text.push_back(GetStringIndex(event.text));
+      break;
+    case kThreadStartEventKind:
+      stream.pid.push_back(event.pid);
+      break;
+    case kFileIoEventKind:
+      stream.logging_tid.push_back(event.logging_tid);
+      stream.text.push_back(GetStringIndex(event.text));
+      break;
+    case kFileIoOpEndEventKind:
+      stream.logging_tid.push_back(event.logging_tid);
+      break;
+    case kChromeEventKind:
+      stream.is_first_non_empty_paint.push_back(
+          event.is_first_non_empty_paint ? 1 : 0);
+      break;
+    default:
+      break;
+  }
+}
+
+bool TraceEventCacheWriter::Close() {
+  if (!out_.is_open())
+    return false;
+
+  if (overflow_) {
+    LOG(ERROR) << "Too many distinct strings to cache the trace.";
+    out_.close();
+    return false;
+  }
+  if (!event_streams_.empty())
+    WriteBlock();
+
+  // The file from which the events are decoded is known once they have all
+  // been read: the CSV dump of the trace is written as xperf runs.
+  CacheHeader header;
+  memset(&header, 0, sizeof(header));
+  if (!ETWReader::GetSourceSizeAndLastWriteTime(
+          trace_path_, &header.source_size, &header.source_last_write_time)) {
+    LOG(ERROR) << "Unable to read the attributes of the trace.";
+    out_.close();
+    return false;
+  }
+  memcpy(header.magic, kCacheMagic, sizeof(header.magic));
+  header.version = kCacheVersion;
+  header.num_types = static_cast<uint32_t>(type_names_.size());
+  header.num_events = num_events_;
+  header.tables_offset = writer_.offset();
+  header.num_blocks = static_cast<uint32_t>(block_offsets_.size() - 1);
+  header.num_strings = static_cast<uint32_t>(strings_.size());
+
+  // Table of strings.
+  std::vector<uint64_t> string_offsets(1, 0);
+  std::string string_data;
+  for (const std::string* str : strings_) {
+    string_data.append(*str);
+    string_offsets.push_back(string_data.size());
+  }
+  writer_.WriteArray(string_offsets.data(), string_offsets.size());
+  writer_.WriteArray(string_data.data(), string_data.size());
+
+  // Names of the event types.
+  std::vector<uint64_t> type_name_offsets(1, 0);
+  std::string type_name_data;
+  for (const std::string& type_name : type_names_) {
+    type_name_data.append(type_name);
+    type_name_offsets.push_back(type_name_data.size());
+  }
+  writer_.WriteArray(type_name_offsets.data(), type_name_offsets.size());
+  writer_.WriteArray(type_name_data.data(), type_name_data.size());
+
+  // Offsets of the blocks.
+  writer_.WriteArray(block_offsets_.data(), block_offsets_.size());
+
+  header.file_size = writer_.offset();
+  out_.seekp(0);
+  out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out_.close();
+
+  if (out_.fail()) {
+    LOG(ERROR) << "Error while writing the cache of the trace ("
+               << base::WStringToString(cache_path_) << ").";
+    return false;
+  }
+  return true;
+}
+
+void TraceEventCacheWriter::WriteBlock() {
+  uint64_t block_begin = writer_.offset();
+
+  BlockHeader block_header;
+  memset(&block_header, 0, sizeof(block_header));
+  block_header.num_events = event_streams_.size();
+  block_header.num_streams = static_cast<uint32_t>(streams_.size());
+  writer_.WriteArray(&block_header, 1);
+
+  std::vector<StreamHeader> stream_headers;
+  for (const auto& stream : streams_) {
+    StreamHeader stream_header;
+    stream_header.type_id = stream->type_id;
+    stream_header.kind = stream->kind;
+    stream_header.num_events = stream->ts.size();
+    stream_header.num_frames = stream->frames.size();
+    stream_headers.push_back(stream_header);
+  }
+  writer_.WriteArray(stream_headers.data(), stream_headers.size());
+  writer_.WriteArray(event_streams_.data(), event_streams_.size());
+  for (const auto& stream : streams_) {
+    VisitColumns(stream->kind, stream->ts.size(), stream->frames.size(),
+                 stream.get(), &writer_);
+  }
+
+  block_offsets_.push_back(block_offsets_.back() + writer_.offset() -
+                           block_begin);
+
+  streams_.clear();
+  stream_indexes_.clear();
+  event_streams_.clear();
+  num_frames_ = 0;
+}
+
+uint32_t TraceEventCacheWriter::GetStringIndex(const std::string& str) {
+  auto look_string = string_indexes_.find(str);
+  if (look_string != string_indexes_.end())
+    return look_string->second;
+
+  if (strings_.size() == UINT32_MAX) {
+    overflow_ = true;
+    return 0;
+  }
+  uint32_t index = static_cast<uint32_t>(strings_.size());
+  look_string = string_indexes_.insert({str, index}).first;
+  strings_.push_back(&look_string->first);
+  return index;
+}
+
+TraceEventCache::TraceEventCache()
+    : num_blocks_(0),
+      block_offsets_(nullptr),
+      num_strings_(0),
+      string_offsets_(nullptr),
+      string_data_(nullptr) {}
+
+TraceEventCache::~TraceEventCache() {}
+
+bool TraceEventCache::Open(const std::wstring& trace_path) {
+  uint64_t source_size = 0;
+  uint64_t source_last_write_time = 0;
+  if (!ETWReader::GetSourceSizeAndLastWriteTime(trace_path, &source_size,
+                                     &source_last_write_time)) {
+    return false;
+  }
+
+  std::wstring cache_path = CachePathForTrace(trace_path);
+  if (!base::FilePathExists(cache_path) || !file_.Open(cache_path))
+    return false;
+
+  if (!tables_.OpenShared(file_) ||
+      !ParseCache(source_size, source_last_write_time)) {
+    tables_.Close();
+    file_.Close();
+    return false;
+  }
+
+  // Validate all the blocks before any event is read, so that an invalid
+  // cache can be ignored.
+  Block block;
+  for (size_t i = 0; i < num_blocks_; ++i) {
+    if (!MapBlock(i, &block) || !ValidateBlock(block)) {
+      LOG(ERROR) << "Ignoring invalid trace cache.";
+      tables_.Close();
+      file_.Close();
+      return false;
+    }
+  }
+  return true;
+}
+
+void TraceEventCache::ReadEvents(const Subscription& subscription,
+                                 const TraceEventCallback& callback) {
+  std::unique_ptr<SubscriptionFilter> filter;
+  if (!subscription.SelectsAll())
+    filter.reset(new SubscriptionFilter(subscription, schema_));
+
+  Block block;
+  std::vector<uint64_t> stream_positions;
+
+  TraceEvent event;
+  for (size_t block_index = 0; block_index < num_blocks_; ++block_index) {
+    if (!MapBlock(block_index, &block)) {
+      LOG(ERROR) << "Unable to map a block of the trace cache.";
+      return;
+    }
+    stream_positions.assign(block.streams.size(), 0);
+
+    for (uint64_t i = 0; i < block.num_events; ++i) {
+      const Stream& stream = block.streams[block.event_streams[i]];
+      uint64_t pos = stream_positions[block.event_streams[i]]++;
+
+      if (filter) {
+        SubscriptionFilter::TypeSelection selection =
+            filter->SelectType(stream.type_id);
+        if (selection == SubscriptionFilter::kSkipped ||
+            (selection == SubscriptionFilter::kNeedsTimestamp &&
+             !filter->SelectTimestamp(stream.ts[pos]))) {
+          continue;
+        }
+      }
+
+      event = TraceEvent();
+      event.kind = stream.kind;
+      event.type_id = stream.type_id;
+      event.ts = stream.ts[pos];
+      event.tid = stream.tid[pos];
+      switch (stream.kind) {
+        case kStackEventKind:
+          for (uint64_t j = stream.frames_begin[pos];
+               j < stream.frames_begin[pos + 1]; ++j) {
+            event.stack.push_back(GetString(stream.frames[j]));
+          }
+          break;
+        case kCSwitchEventKind:
+          event.new_tid = stream.new_tid[pos];
+          event.old_tid = stream.old_tid[pos];
+          event.time_since_last = stream.time_since_last[pos];
+          break;
+        case kProcessStartEventKind:
+          event.pid = stream.pid[pos];
+          event.text = GetString(stream.text[pos]);
+          break;
+        case kThreadStartEventKind:
+          event.pid = stream.pid[pos];
+          break;
+        case kFileIoEventKind:
+          event.logging_tid = stream.logging_tid[pos];
+          event.text = GetString(stream.text[pos]);
+          break;
+        case kFileIoOpEndEventKind:
+          event.logging_tid = stream.logging_tid[pos];
+          break;
+        case kChromeEventKind:
+          event.is_first_non_empty_paint =
+              stream.is_first_non_empty_paint[pos] != 0;
+          break;
+        default:
+          break;
+      }
+
+      if (!callback(&event))
+        return;
+    }
+  }
+}
+
+std::wstring TraceEventCache::CachePathForTrace(
+    const std::wstring& trace_path) {
+  return trace_path + kCacheFileExtension;
+}
+
+bool TraceEventCache::ParseCache(uint64_t source_size,
+                                 uint64_t source_last_write_time) {
+  if (!file_.Map(0, sizeof(CacheHeader)) ||
+      file_.length() < sizeof(CacheHeader)) {
+    LOG(ERROR) << "Ignoring truncated trace cache.";
+    return false;
+  }
+  CacheHeader header;
+  memcpy(&header, file_.data(), sizeof(header));
+
+  if (memcmp(header.magic, kCacheMagic, sizeof(header.magic)) != 0 ||
+      header.version != kCacheVersion) {
+    LOG(INFO) << "Ignoring trace cache with an unsupported format."
+              << std::endl;
+    return false;
+  }
+  if (header.source_size != source_size ||
+      header.source_last_write_time != source_last_write_time) {
+    LOG(INFO) << "Ignoring trace cache that doesn't match the trace."
+              << std::endl;
+    return false;
+  }
+  if (header.file_size != file_.size() ||
+      header.tables_offset < sizeof(CacheHeader) ||
+      header.tables_offset > header.file_size ||
+      header.file_size - header.tables_offset > SIZE_MAX) {
+    LOG(ERROR) << "Ignoring truncated trace cache.";
+    return false;
+  }
+
+  // The tables stay mapped as long as the cache is open.
+  size_t tables_size =
+      static_cast<size_t>(header.file_size - header.tables_offset);
+  if (!tables_.Map(header.tables_offset, tables_size))
+    return false;
+  ArrayReader reader(tables_.data(), tables_.length());
+
+  // Table of strings.
+  num_strings_ = header.num_strings;
+  reader.ReadArray(num_strings_ + static_cast<uint64_t>(1), &string_offsets_);
+  if (string_offsets_ != nullptr)
+    reader.ReadArray(string_offsets_[num_strings_], &string_data_);
+
+  // Event types.
+  const uint64_t* type_name_offsets = nullptr;
+  const char* type_name_data = nullptr;
+  reader.ReadArray(header.num_types + static_cast<uint64_t>(1),
+                   &type_name_offsets);
+  if (type_name_offsets != nullptr) {
+    reader.ReadArray(type_name_offsets[header.num_types], &type_name_data);
+  }
+
+  // Offsets of the blocks, which must end where the tables begin.
+  num_blocks_ = header.num_blocks;
+  reader.ReadArray(num_blocks_ + static_cast<uint64_t>(1), &block_offsets_);
+
+  if (!reader.valid() || !IsSorted(string_offsets_, num_strings_ + 1) ||
+      !IsSorted(type_name_offsets, header.num_types + 1) ||
+      !IsSorted(block_offsets_, num_blocks_ + 1) ||
+      sizeof(CacheHeader) + block_offsets_[num_blocks_] !=
+          header.tables_offset) {
+    return false;
+  }
+  for (uint32_t i = 0; i < num_blocks_; ++i) {
+    if (block_offsets_[i + 1] - block_offsets_[i] > SIZE_MAX)
+      return false;
+  }
+  for (EventTypeId type_id = schema_.num_types(); type_id < header.num_types;
+       ++type_id) {
+    std::string_view type_name(
+        type_name_data + type_name_offsets[type_id],
+        static_cast<size_t>(type_name_offsets[type_id + 1] -
+                            type_name_offsets[type_id]));
+    if (schema_.AddType(type_name, std::vector<std::string_view>()) !=
+        type_id) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool TraceEventCache::MapBlock(size_t index, Block* block) {
+  DCHECK_LT(index, num_blocks_);
+  block->num_events = 0;
+  block->event_streams = nullptr;
+  block->streams.clear();
+
+  uint64_t block_size = block_offsets_[index + 1] - block_offsets_[index];
+  if (!file_.Map(sizeof(CacheHeader) + block_offsets_[index],
+                 static_cast<size_t>(block_size))) {
+    return false;
+  }
+  ArrayReader reader(file_.data(), file_.length());
+
+  const BlockHeader* block_header = nullptr;
+  const StreamHeader* stream_headers = nullptr;
+  if (!reader.ReadArray(1, &block_header) ||
+      !reader.ReadArray(block_header->num_streams, &stream_headers) ||
+      !reader.ReadArray(block_header->num_events, &block->event_streams)) {
+    return false;
+  }
+  block->num_events = block_header->num_events;
+
+  for (uint32_t i = 0; i < block_header->num_streams; ++i) {
+    const StreamHeader& stream_header = stream_headers[i];
+    if (stream_header.type_id >= schema_.num_types() ||
+        stream_header.kind >= kNumEventKinds) {
+      return false;
+    }
+    block->streams.emplace_back();
+    Stream& stream = block->streams.back();
+    stream.type_id = stream_header.type_id;
+    stream.kind = static_cast<TraceEventKind>(stream_header.kind);
+    stream.num_events = stream_header.num_events;
+    stream.num_frames = stream_header.num_frames;
+    VisitColumns(stream.kind, stream.num_events, stream.num_frames, &stream,
+                 &reader);
+    if (!reader.valid())
+      return false;
+  }
+  return true;
+}
+
+bool TraceEventCache::ValidateBlock(const Block& block) const {
+  for (const Stream& stream : block.streams) {
+    if (!ValidateStream(stream, stream.num_events, stream.num_frames))
+      return false;
+  }
+
+  // Check that each stream has as many events as the events that refer to it.
+  std::vector<uint64_t> num_events_per_stream(block.streams.size(), 0);
+  for (uint64_t i = 0; i < block.num_events; ++i) {
+    if (block.event_streams[i] >= block.streams.size())
+      return false;
+    ++num_events_per_stream[block.event_streams[i]];
+  }
+  for (size_t i = 0; i < block.streams.size(); ++i) {
+    if (num_events_per_stream[i] != block.streams[i].num_events)
+      return false;
+  }
+  return true;
+}
+
+bool TraceEventCache::ValidateStream(const Stream& stream,
+                                     uint64_t num_events,
+                                     uint64_t num_frames) const {
+  if (stream.text != nullptr) {
+    for (uint64_t i = 0; i < num_events; ++i) {
+      if (stream.text[i] >= num_strings_)
+        return false;
+    }
+  }
+  if (stream.frames_begin != nullptr) {
+    if (!IsSorted(stream.frames_begin, num_events + 1) ||
+        stream.frames_begin[num_events] != num_frames) {
+      return false;
+    }
+    for (uint64_t i = 0; i < num_frames; ++i) {
+      if (stream.frames[i] >= num_strings_)
+        return false;
+    }
+  }
+  return true;
+}
+
+std::string TraceEventCache::GetString(uint32_t index) const {
+  DCHECK_LT(index, num_strings_);
+  return std::string(
+      string_data_ + string_offsets_[index],
+      static_cast<size_t>(string_offsets_[index + 1] - string_offsets_[index]));
+}
+
+}  // namespace etw_insights
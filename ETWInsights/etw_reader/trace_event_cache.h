@@ -0,0 +1,201 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "base/base.h"
+#include "base/memory_mapped_file.h"
+#include "etw_reader/array_io.h"
+#include "etw_reader/event_schema.h"
+#include "etw_reader/subscription.h"
+#include "etw_reader/trace_event.h"
+#include "etw_reader/trace_event_decoder.h"
+
+namespace etw_insights {
+
+// The decoded events of a trace are cached in a <trace>.etl.etwbin file, next
+// to the trace, so that later analyses of the same trace don't have to parse
+// its CSV dump again.
+//
+// The cache is a columnar binary file. Events are stored in blocks of
+// consecutive events, so that the cache is written and read one block at a
+// time: neither the writer nor the reader holds more than one block in memory,
+// and the reader never maps more than one block in its address space. In a
+// block, events are grouped in streams, one per event type and decoded event
+// kind. Each stream stores one array per field of its events (timestamps,
+// thread ids, other numeric fields, and indexes in a table of strings for
+// stack frames, process names and file operations). An array of stream
+// indexes records the order of the events. The table of strings, the names of
+// the event types and the offsets of the blocks follow the last block. The
+// cache also stores the size and last write time of the file it was built
+// from (the CSV dump of the trace, or the .etl file when its xperf output was
+// parsed directly), and is ignored when they change.
+
+// Writes the decoded events of a trace to a cache, one block at a time.
+class TraceEventCacheWriter {
+ public:
+  // @param schema the event types of the trace.
+  explicit TraceEventCacheWriter(const EventSchema& schema);
+  ~TraceEventCacheWriter();
+
+  // Creates the cache of a trace.
+  // @param trace_path Path to the .etl file of the trace.
+  // @returns true if the cache was created successfully, false otherwise.
+  bool Open(const std::wstring& trace_path);
+
+  // Adds an event to the cache. Events must be added in the order of the
+  // trace. Does nothing if the cache isn't open.
+  void AddEvent(const TraceEvent& event);
+
+  // Writes the events that haven't been written yet and the tables that
+  // follow them, and closes the cache. The cache is left invalid if this
+  // isn't called.
+  // @returns true if the cache was written successfully, false otherwise.
+  bool Close();
+
+ private:
+  struct Stream;
+
+  // Writes the events added since the last block, and starts a new block.
+  void WriteBlock();
+
+  // @returns the index of |str| in the table of strings.
+  uint32_t GetStringIndex(const std::string& str);
+
+  // Event types of the trace.
+  std::vector<std::string> type_names_;
+
+  // The cache file, its path and the path of the trace.
+  std::ofstream out_;
+  ArrayWriter writer_;
+  std::wstring cache_path_;
+  std::wstring trace_path_;
+
+  // Offsets of the blocks already written, relative to the first block,
+  // followed by the offset of the end of the last block.
+  std::vector<uint64_t> block_offsets_;
+  uint64_t num_events_;
+
+  // Streams of events of the current block, and their index for each
+  // (type id, kind) pair.
+  std::vector<std::unique_ptr<Stream>> streams_;
+  std::unordered_map<uint64_t, uint16_t> stream_indexes_;
+
+  // Stream index of each event of the current block, in the order of the
+  // trace, and number of stack frames of the current block.
+  std::vector<uint16_t> event_streams_;
+  uint64_t num_frames_;
+
+  // Table of strings, which is shared by all the blocks and therefore kept
+  // until the cache is closed.
+  std::unordered_map<std::string, uint32_t> string_indexes_;
+  std::vector<const std::string*> strings_;
+
+  // Set when the events can't be represented in a cache.
+  bool overflow_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceEventCacheWriter);
+};
+
+// Reads the decoded events of a trace from its cache. The tables that follow
+// the blocks are mapped as long as the cache is open, and the blocks are
+// mapped one at a time.
+class TraceEventCache {
+ public:
+  TraceEventCache();
+  ~TraceEventCache();
+
+  // Opens the cache of a trace, and validates all its blocks.
+  // @param trace_path Path to the .etl file of the trace.
+  // @returns true if the cache exists and is up to date, false otherwise.
+  bool Open(const std::wstring& trace_path);
+
+  // @returns the event types of the trace. The event types don't have any
+  //     column. Valid after Open().
+  const EventSchema& schema() const { return schema_; }
+
+  // Reads the events of the trace selected by a subscription, in order. The
+  // events that aren't selected are skipped from their type and timestamp,
+  // which are stored apart from their other fields: their stacks and strings
+  // aren't read.
+  // @param subscription the events to read.
+  // @param callback receives the events.
+  void ReadEvents(const Subscription& subscription,
+                  const TraceEventCallback& callback);
+
+  // @param trace_path Path to the .etl file of a trace.
+  // @returns the path of the cache of the trace.
+  static std::wstring CachePathForTrace(const std::wstring& trace_path);
+
+ private:
+  struct Stream;
+  struct Block;
+
+  // Reads the header of the cache and the tables that follow the blocks.
+  // @returns true if the cache is valid, false otherwise.
+  bool ParseCache(uint64_t source_size, uint64_t source_last_write_time);
+
+  // Maps a block and reads the location of its arrays.
+  // @param index index of the block.
+  // @param block receives the arrays of the block, which are valid until
+  //     another block is mapped.
+  // @returns true if the arrays are within the bounds of the block, false
+  //     otherwise.
+  bool MapBlock(size_t index, Block* block);
+
+  // @returns true if the indexes stored in a block are within bounds.
+  bool ValidateBlock(const Block& block) const;
+
+  // @returns true if the indexes stored in a stream are within bounds.
+  bool ValidateStream(const Stream& stream,
+                      uint64_t num_events,
+                      uint64_t num_frames) const;
+
+  // @returns the string at |index| in the table of strings.
+  std::string GetString(uint32_t index) const;
+
+  // The cache, with a view of the current block.
+  base::MemoryMappedFile file_;
+
+  // A view of the tables that follow the blocks, which shares the file
+  // mapping of |file_|.
+  base::MemoryMappedFile tables_;
+
+  // Event types of the trace.
+  EventSchema schema_;
+
+  // Offsets of the blocks, relative to the first block, followed by the
+  // offset of the end of the last block.
+  uint32_t num_blocks_;
+  const uint64_t* block_offsets_;
+
+  // Table of strings: offsets of the strings in |string_data_|. The string at
+  // index i ends where string i + 1 begins.
+  uint32_t num_strings_;
+  const uint64_t* string_offsets_;
+  const char* string_data_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceEventCache);
+};
+
+}  // namespace etw_insights
@@ -0,0 +1,464 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "etw_reader/trace_event_decoder.h"
+
+#include <atomic>
+#include <deque>
+#include <future>
+
+#include "base/logging.h"
+#include "base/numeric_conversions.h"
+#include "base/string_utils.h"
+#include "base/thread_pool.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Generic event fields.
+const char kTimestampField[] = "TimeStamp";
+const char kThreadIDField[] = "ThreadID";
+const char kProcessNameField[] = "Process Name ( PID)";
+
+// Stack event.
+const char kStackType[] = "Stack";
+const char kStackSymbolField[] = "Image!Function";
+
+// CSwitch event.
+const char kCSwitchType[] = "CSwitch";
+const char kCSwitchNewTidField[] = "New TID";
+const char kCSwitchOldTidField[] = "Old TID";
+const char kCSwitchTimeSinceLastField[] = "TmSinceLast";
+
+// Process start event.
+const char kProcessStartType[] = "P-Start";
+const char kProcessDCStartType[] = "P-DCStart";
+
+// Thread start event.
+const char kThreadStartType[] = "T-Start";
+const char kThreadDCStartType[] = "T-DCStart";
+
+// Thread end event.
+const char kThreadEndType[] = "T-End";
+const char kThreadDCEndType[] = "T-DCEnd";
+
+// FileIo events.
+const char kFileIoCreateType[] = "FileIoCreate";
+const char kFileIoCleanupType[] = "FileIoCleanup";
+const char kFileIoCloseType[] = "FileIoClose";
+const char kFileIoFlushType[] = "FileIoFlush";
+const char kFileIoReadType[] = "FileIoRead";
+const char kFileIoWriteType[] = "FileIoWrite";
+const char kFileIoSetInfoType[] = "FileIoSetInfo";
+const char kFileIoQueryInfoType[] = "FileIoQueryInfo";
+const char kFileIoFSCTLType[] = "FileIoFSCTL";
+const char kFileIoDeleteType[] = "FileIoDelete";
+const char kFileIoRenameType[] = "FileIoRename";
+const char kFileIoDirEnumType[] = "FileIoDirEnum";
+const char kFileIoDirNotifyType[] = "FileIoDirNotify";
+const char kFileIoOpEnd[] = "FileIoOpEnd";
+const char kFileIoFileNameField[] = "FileName";
+const char kFileIoLoggingThreadIdField[] = "LoggingThreadID";
+
+// Chrome events.
+const char kChromeType[] = "Chrome//win:Info";
+const char kChromeNameField[] = "Name";
+const char kChromePhaseField[] = "Phase";
+const char kChromeNonEmptyPaint[] =
+    "\"Startup.FirstWebContents.NonEmptyPaint\"";
+const char kChromePhaseAsyncBegin[] = "\"Async End\"";
+
+// Kind of the decoded event for each event type.
+const struct {
+  const char* type;
+  TraceEventKind kind;
+} kEventKinds[] = {
+    {kStackType, kStackEventKind},
+    {kCSwitchType, kCSwitchEventKind},
+    {kProcessStartType, kProcessStartEventKind},
+    {kProcessDCStartType, kProcessStartEventKind},
+    {kThreadStartType, kThreadStartEventKind},
+    {kThreadDCStartType, kThreadStartEventKind},
+    {kThreadEndType, kThreadEndEventKind},
+    {kThreadDCEndType, kThreadEndEventKind},
+    {kFileIoCreateType, kFileIoEventKind},
+    {kFileIoCleanupType, kFileIoEventKind},
+    {kFileIoCloseType, kFileIoEventKind},
+    {kFileIoFlushType, kFileIoEventKind},
+    {kFileIoReadType, kFileIoEventKind},
+    {kFileIoWriteType, kFileIoEventKind},
+    {kFileIoSetInfoType, kFileIoEventKind},
+    {kFileIoQueryInfoType, kFileIoEventKind},
+    {kFileIoFSCTLType, kFileIoEventKind},
+    {kFileIoDeleteType, kFileIoEventKind},
+    {kFileIoRenameType, kFileIoEventKind},
+    {kFileIoDirEnumType, kFileIoEventKind},
+    {kFileIoDirNotifyType, kFileIoEventKind},
+    {kFileIoOpEnd, kFileIoOpEndEventKind},
+    {kChromeType, kChromeEventKind},
+};
+
+// Number of chunks that can be decoded ahead of the chunk whose events are
+// delivered, per thread. Bounds the memory used by decoded events.
+const size_t kChunksInFlightPerThread = 2;
+
+// Offset that indicates the end of the CSV file.
+const uint64_t kEndOfFileOffset = static_cast<uint64_t>(-1);
+
+void SplitProcessNameField(std::string_view value_view,
+                           std::string* process_name,
+                           base::Pid* pid) {
+  std::string value(value_view);
+  auto tokens = base::SplitString(value, " ");
+  *process_name = tokens[0];
+
+  size_t start_pos = 0;
+  if (tokens.back()[0] == '(')
+    start_pos = 1;
+
+  if (!base::StrToULong(
+          tokens.back().substr(start_pos, tokens.back().size() - 1 - start_pos),
+          pid)) {
+    LOG(ERROR) << "Unable to extract process id from process name field ("
+               << value << ").";
+  }
+}
+
+// @returns the offset of the first line at or after |offset| that can start
+//     a chunk, or kEndOfFileOffset if there is none.
+uint64_t FindChunkBoundary(const ETWReader& reader,
+                           const TraceEventDecoder& decoder,
+                           uint64_t offset) {
+  auto end = reader.end();
+  auto it = reader.IteratorFrom(offset);
+  while (it != end && !decoder.IsChunkBoundary(*it))
+    ++it;
+  if (it == end)
+    return kEndOfFileOffset;
+  return it.offset();
+}
+
+// Decodes the events that start in [begin_offset, end_offset).
+std::vector<TraceEvent> DecodeChunk(const ETWReader& reader,
+                                    const TraceEventDecoder& decoder,
+                                    uint64_t begin_offset,
+                                    uint64_t end_offset,
+                                    const std::atomic<bool>& cancelled) {
+  std::vector<TraceEvent> events;
+  auto end = reader.end();
+  auto it = reader.IteratorFrom(begin_offset);
+  while (it != end && it.offset() < end_offset && !cancelled) {
+    events.emplace_back();
+    if (!decoder.Decode(it, &events.back()))
+      events.pop_back();
+  }
+  return events;
+}
+
+void DecodeTraceEventsInParallel(const ETWReader& reader,
+                                 const TraceEventDecoder& decoder,
+                                 base::ThreadPool* thread_pool,
+                                 uint64_t chunk_size,
+                                 const TraceEventCallback& callback) {
+  std::atomic<bool> cancelled(false);
+  size_t num_threads = thread_pool->num_threads();
+
+  // Chunks that are being decoded, in the order of the trace.
+  std::deque<std::future<std::vector<TraceEvent>>> pending_chunks;
+  uint64_t next_chunk_offset = reader.begin_offset();
+
+  for (;;) {
+    // Keep the workers busy.
+    while (next_chunk_offset != kEndOfFileOffset &&
+           pending_chunks.size() < num_threads * kChunksInFlightPerThread) {
+      uint64_t begin_offset = next_chunk_offset;
+      uint64_t end_offset =
+          FindChunkBoundary(reader, decoder, begin_offset + chunk_size);
+      pending_chunks.push_back(thread_pool->Post(
+          [&reader, &decoder, &cancelled, begin_offset, end_offset]() {
+            return DecodeChunk(reader, decoder, begin_offset, end_offset,
+                               cancelled);
+          }));
+      next_chunk_offset = end_offset;
+    }
+
+    if (pending_chunks.empty())
+      break;
+
+    // Deliver the events of the oldest chunk.
+    std::vector<TraceEvent> events = pending_chunks.front().get();
+    pending_chunks.pop_front();
+    for (auto& event : events) {
+      if (!callback(&event)) {
+        // The chunks that are still pending hold references to the locals
+        // of this function. Make them return early, and wait for them.
+        cancelled = true;
+        for (auto& pending_chunk : pending_chunks)
+          pending_chunk.wait();
+        return;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+TraceEventDecoder::Columns::Columns(const ETWReader& reader)
+    : timestamp(reader.ColumnForAllTypes(kTimestampField)),
+      thread_id(reader.ColumnForAllTypes(kThreadIDField)),
+      process_name(reader.ColumnForAllTypes(kProcessNameField)),
+      stack_thread_id(reader.Column(kStackType, kThreadIDField)),
+      stack_symbol(reader.Column(kStackType, kStackSymbolField)),
+      cswitch_new_tid(reader.ColumnForAllTypes(kCSwitchNewTidField)),
+      cswitch_old_tid(reader.Column(kCSwitchType, kCSwitchOldTidField)),
+      cswitch_time_since_last(
+          reader.Column(kCSwitchType, kCSwitchTimeSinceLastField)),
+      file_io_file_name(reader.ColumnForAllTypes(kFileIoFileNameField)),
+      file_io_logging_thread_id(
+          reader.ColumnForAllTypes(kFileIoLoggingThreadIdField)),
+      chrome_name(reader.Column(kChromeType, kChromeNameField)),
+      chrome_phase(reader.Column(kChromeType, kChromePhaseField)) {}
+
+TraceEventDecoder::TraceEventDecoder(const ETWReader& reader)
+    : columns_(reader),
+      stack_type_id_(reader.schema().GetTypeId(kStackType)),
+      kinds_(reader.schema().num_types(), kOtherEventKind) {
+  for (const auto& entry : kEventKinds) {
+    EventTypeId type_id = reader.schema().GetTypeId(entry.type);
+    if (type_id != kUnknownEventTypeId)
+      kinds_[type_id] = entry.kind;
+  }
+}
+
+bool TraceEventDecoder::Decode(ETWReader::Iterator& it,
+                               TraceEvent* event) const {
+  DCHECK(event != nullptr);
+  const ETWReader::Line& line = *it;
+  EventTypeId type_id = line.type_id();
+
+  // Empty lines and lines of unknown types don't have any field.
+  if (type_id == kEmptyEventTypeId || type_id == kUnknownEventTypeId) {
+    ++it;
+    return false;
+  }
+
+  event->type_id = type_id;
+  event->kind = kinds_[type_id];
+
+  // Get the event timestamp and thread.
+  line.GetFieldAsULong(columns_.timestamp, &event->ts);
+  if (!line.GetFieldAsULong(columns_.thread_id, &event->tid) &&
+      !line.GetFieldAsULong(columns_.cswitch_new_tid, &event->tid)) {
+    event->tid = base::kInvalidTid;
+  }
+
+  // Decode the fields specific to each kind of event. Events with missing
+  // fields are only used for their timestamp and thread.
+  bool success = true;
+  switch (event->kind) {
+    case kStackEventKind:
+      // Stack events span multiple lines.
+      return DecodeStackEvent(it, event);
+    case kCSwitchEventKind:
+      success = DecodeCSwitchEvent(line, event);
+      break;
+    case kProcessStartEventKind:
+      success = DecodeProcessStartEvent(line, event);
+      break;
+    case kThreadStartEventKind:
+      success = DecodeThreadStartEvent(line, event);
+      break;
+    case kThreadEndEventKind:
+      success = DecodeThreadEndEvent(line, event);
+      break;
+    case kFileIoEventKind:
+    case kFileIoOpEndEventKind:
+      success = DecodeFileIoEvent(line, event);
+      break;
+    case kChromeEventKind:
+      success = DecodeChromeEvent(line, event);
+      break;
+    default:
+      break;
+  }
+  if (!success)
+    event->kind = kOtherEventKind;
+
+  ++it;
+  return true;
+}
+
+bool TraceEventDecoder::IsChunkBoundary(const ETWReader::Line& line) const {
+  return line.type_id() != stack_type_id_ &&
+         line.type_id() != kEmptyEventTypeId;
+}
+
+bool TraceEventDecoder::DecodeStackEvent(ETWReader::Iterator& it,
+                                         TraceEvent* event) const {
+  // Get the event tid.
+  event->tid = 0;
+  if (!it->GetFieldAsULong(columns_.stack_thread_id, &event->tid))
+    LOG(ERROR) << "Unable to read column ThreadID of Stack event.";
+
+  // Get the event stack.
+  ETWReader::Iterator end;
+  while (it != end && it->type_id() == stack_type_id_) {
+    std::string_view symbol;
+    if (it->GetField(columns_.stack_symbol, &symbol))
+      event->stack.push_back(std::string(symbol));
+    ++it;
+  }
+
+  // Skip the empty line that ends the stack.
+  if (it != end && it->type_id() == kEmptyEventTypeId)
+    ++it;
+
+  return true;
+}
+
+bool TraceEventDecoder::DecodeCSwitchEvent(const ETWReader::Line& line,
+                                           TraceEvent* event) const {
+  if (!line.GetFieldAsULong(columns_.cswitch_old_tid, &event->old_tid) ||
+      !line.GetFieldAsULong(columns_.cswitch_time_since_last,
+                            &event->time_since_last) ||
+      !line.GetFieldAsULong(columns_.cswitch_new_tid, &event->new_tid)) {
+    LOG(ERROR) << "Missing some fields in CSwitch event at ts=" << event->ts
+               << ".";
+    return false;
+  }
+  return true;
+}
+
+bool TraceEventDecoder::DecodeProcessStartEvent(const ETWReader::Line& line,
+                                                TraceEvent* event) const {
+  std::string_view process_name_field;
+  if (!line.GetField(columns_.process_name, &process_name_field)) {
+    LOG(ERROR) << "Missing some fields in Process Start event at ts="
+               << event->ts << ".";
+    return false;
+  }
+
+  SplitProcessNameField(process_name_field, &event->text, &event->pid);
+  return true;
+}
+
+bool TraceEventDecoder::DecodeThreadStartEvent(const ETWReader::Line& line,
+                                               TraceEvent* event) const {
+  std::string_view process_name_field;
+  if (!line.GetFieldAsULong(columns_.thread_id, &event->tid) ||
+      !line.GetField(columns_.process_name, &process_name_field)) {
+    LOG(ERROR) << "Missing some fields in Thread Start event at ts="
+               << event->ts << ".";
+    return false;
+  }
+
+  std::string process_name;
+  SplitProcessNameField(process_name_field, &process_name, &event->pid);
+  return true;
+}
+
+bool TraceEventDecoder::DecodeThreadEndEvent(const ETWReader::Line& line,
+                                             TraceEvent* event) const {
+  if (!line.GetFieldAsULong(columns_.thread_id, &event->tid)) {
+    LOG(ERROR) << "Missing some fields in Thread End event at ts=" << event->ts
+               << ".";
+    return false;
+  }
+  return true;
+}
+
+bool TraceEventDecoder::DecodeFileIoEvent(const ETWReader::Line& line,
+                                          TraceEvent* event) const {
+  std::string_view file_name;
+  if (!line.GetFieldAsULong(columns_.file_io_logging_thread_id,
+                            &event->logging_tid) ||
+      !line.GetField(columns_.file_io_file_name, &file_name)) {
+    if (event->kind == kFileIoOpEndEventKind) {
+      LOG(ERROR) << "Missing some fields in FileIoOpEnd event at ts="
+                 << event->ts << ".";
+    } else {
+      LOG(ERROR) << "Missing some fields in FileIo event at ts=" << event->ts
+                 << ".";
+    }
+    return false;
+  }
+
+  if (event->kind == kFileIoEventKind) {
+    event->text = "[";
+    event->text.append(line.type());
+    event->text.append(": ");
+    event->text.append(file_name);
+    event->text.append("]");
+  }
+  return true;
+}
+
+bool TraceEventDecoder::DecodeChromeEvent(const ETWReader::Line& line,
+                                          TraceEvent* event) const {
+  std::string_view name;
+  std::string_view phase;
+  if (!line.GetField(columns_.chrome_name, &name) ||
+      !line.GetField(columns_.chrome_phase, &phase)) {
+    LOG(ERROR) << "Missing some fields in Chrome event at ts=" << event->ts
+               << ".";
+    return false;
+  }
+
+  event->is_first_non_empty_paint =
+      name == kChromeNonEmptyPaint && phase == kChromePhaseAsyncBegin;
+  return true;
+}
+
+std::vector<std::string> GetEventTypesOfKind(TraceEventKind kind) {
+  std::vector<std::string> types;
+  for (const auto& entry : kEventKinds) {
+    if (entry.kind == kind)
+      types.push_back(entry.type);
+  }
+  return types;
+}
+
+void DecodeTraceEvents(const ETWReader& reader,
+                       base::ThreadPool* thread_pool,
+                       const TraceEventCallback& callback) {
+  DecodeTraceEvents(reader, thread_pool, kDefaultChunkSize, callback);
+}
+
+void DecodeTraceEvents(const ETWReader& reader,
+                       base::ThreadPool* thread_pool,
+                       uint64_t chunk_size,
+                       const TraceEventCallback& callback) {
+  DCHECK(chunk_size != 0);
+  TraceEventDecoder decoder(reader);
+
+  // The lines of a stream can only be read in order.
+  if (thread_pool != nullptr && !reader.is_stream()) {
+    DecodeTraceEventsInParallel(reader, decoder, thread_pool, chunk_size,
+                                callback);
+    return;
+  }
+
+  TraceEvent event;
+  auto end = reader.end();
+  for (auto it = reader.begin(); it != end;) {
+    event = TraceEvent();
+    if (decoder.Decode(it, &event) && !callback(&event))
+      return;
+  }
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,136 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "base/base.h"
+#include "base/thread_pool.h"
+#include "etw_reader/etw_reader.h"
+#include "etw_reader/trace_event.h"
+
+namespace etw_insights {
+
+// Decodes the lines of the CSV dump of a trace into TraceEvents. Decode() can
+// be called concurrently from multiple threads.
+class TraceEventDecoder {
+ public:
+  explicit TraceEventDecoder(const ETWReader& reader);
+
+  // Decodes the event that starts at |it| and moves |it| to the line that
+  // follows the event. A Stack event spans all the consecutive Stack lines
+  // and the empty line that ends them.
+  // @param it iterator on the first line of an event.
+  // @param event the decoded event, output.
+  // @returns true if an event was decoded, false if the line doesn't hold any
+  //     information (e.g. an empty line or a line of an unknown type).
+  bool Decode(ETWReader::Iterator& it, TraceEvent* event) const;
+
+  // @param line a line of the CSV dump.
+  // @returns true if a chunk of the CSV dump can start at |line|. Lines that
+  //     continue a Stack event can't start a chunk.
+  bool IsChunkBoundary(const ETWReader::Line& line) const;
+
+ private:
+  // Columns read by the decoder, bound once when the trace is opened.
+  struct Columns {
+    explicit Columns(const ETWReader& reader);
+
+    // Generic event fields.
+    AnyTypeColumnRef timestamp;
+    AnyTypeColumnRef thread_id;
+    AnyTypeColumnRef process_name;
+
+    // Stack event.
+    ColumnRef stack_thread_id;
+    ColumnRef stack_symbol;
+
+    // CSwitch event.
+    AnyTypeColumnRef cswitch_new_tid;
+    ColumnRef cswitch_old_tid;
+    ColumnRef cswitch_time_since_last;
+
+    // FileIo events.
+    AnyTypeColumnRef file_io_file_name;
+    AnyTypeColumnRef file_io_logging_thread_id;
+
+    // Chrome events.
+    ColumnRef chrome_name;
+    ColumnRef chrome_phase;
+  };
+
+  // Decodes the fields specific to each kind of event.
+  // @returns false if some fields are missing.
+  bool DecodeStackEvent(ETWReader::Iterator& it, TraceEvent* event) const;
+  bool DecodeCSwitchEvent(const ETWReader::Line& line,
+                          TraceEvent* event) const;
+  bool DecodeProcessStartEvent(const ETWReader::Line& line,
+                               TraceEvent* event) const;
+  bool DecodeThreadStartEvent(const ETWReader::Line& line,
+                              TraceEvent* event) const;
+  bool DecodeThreadEndEvent(const ETWReader::Line& line,
+                            TraceEvent* event) const;
+  bool DecodeFileIoEvent(const ETWReader::Line& line, TraceEvent* event) const;
+  bool DecodeChromeEvent(const ETWReader::Line& line, TraceEvent* event) const;
+
+  const Columns columns_;
+
+  // Id of the Stack event type.
+  const EventTypeId stack_type_id_;
+
+  // Event type id -> Kind of the decoded event.
+  std::vector<TraceEventKind> kinds_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceEventDecoder);
+};
+
+// Approximate size of the chunks of the CSV dump decoded in parallel.
+const uint64_t kDefaultChunkSize = 4 * 1024 * 1024;
+
+// Receives the decoded events of a trace. The callback may move data out of
+// the event. It returns false to stop the decoding.
+typedef std::function<bool(TraceEvent* event)> TraceEventCallback;
+
+// @param kind a kind of event.
+// @returns the names of the event types decoded into events of |kind|.
+std::vector<std::string> GetEventTypesOfKind(TraceEventKind kind);
+
+// Decodes all the events of a trace.
+// @param reader an opened trace.
+// @param thread_pool threads that decode the trace, or nullptr to decode it
+//     on the calling thread. With a thread pool, the CSV dump is split in
+//     chunks at line boundaries and the chunks are decoded in parallel. A
+//     trace read from a stream is always decoded on the calling thread.
+// @param callback receives the decoded events, in the order in which they
+//     appear in the trace, on the calling thread.
+void DecodeTraceEvents(const ETWReader& reader,
+                       base::ThreadPool* thread_pool,
+                       const TraceEventCallback& callback);
+
+// Same as above, with chunks of about |chunk_size| bytes instead of
+// kDefaultChunkSize. Chunks of a few bytes put a chunk boundary next to every
+// line, which checks that the events decoded in parallel are the same as the
+// events decoded serially.
+void DecodeTraceEvents(const ETWReader& reader,
+                       base::ThreadPool* thread_pool,
+                       uint64_t chunk_size,
+                       const TraceEventCallback& callback);
+
+}  // namespace etw_insights
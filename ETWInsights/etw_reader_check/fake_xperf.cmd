@@ -0,0 +1,3 @@
+@echo off
+rem Stand-in for xperf: writes fixture.csv to its output, whatever the trace.
+type "%~dp0fixture.csv"
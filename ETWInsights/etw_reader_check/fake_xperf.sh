@@ -0,0 +1,3 @@
+#!/bin/sh
+# Stand-in for xperf: writes fixture.csv to its output, whatever the trace.
+cat "$(dirname "$0")/fixture.csv"
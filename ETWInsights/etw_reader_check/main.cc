@@ -0,0 +1,358 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Checks that the events decoded from the CSV dump of a trace in parallel
+// chunks are the same as the events decoded serially, with chunk boundaries
+// next to every line of the dump, and that the events decoded from the dump
+// read as a stream, like the output of xperf, are the same as the events
+// decoded from the mapped file.
+
+#include <stdio.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/base.h"
+#include "base/command_line.h"
+#include "base/file.h"
+#include "base/numeric_conversions.h"
+#include "base/string_utils.h"
+#include "base/thread_pool.h"
+#include "etw_reader/etw_reader.h"
+#include "etw_reader/subscription.h"
+#include "etw_reader/trace_event.h"
+#include "etw_reader/trace_event_decoder.h"
+
+using namespace etw_insights;
+
+namespace {
+
+// Default CSV dump.
+const wchar_t kDefaultCsvPath[] = L"fixture.csv";
+
+// Default number of threads that decode the chunks.
+const uint64_t kDefaultNumThreads = 4;
+
+// Chunk sizes up to this one are all checked. Above it, chunk sizes grow
+// geometrically up to the size of the CSV dump.
+const uint64_t kMaxConsecutiveChunkSize = 64;
+
+// Maximum numbers of bytes returned by each read of a stream. The small ones
+// split lines across reads.
+const size_t kStreamReadSizes[] = {1, 7, 64, 4096, 1024 * 1024};
+
+void ShowUsage() {
+  std::cout << "Usage: etw_reader_check.exe [options]" << std::endl
+            << std::endl
+            << "Options:" << std::endl
+            << "  --csv: CSV dump of a trace. Default: fixture.csv" << std::endl
+            << "  --threads: Number of threads that decode the chunks. "
+               "Default: "
+            << kDefaultNumThreads << std::endl
+            << "  --stand_in: Command that writes the CSV dump to its output, "
+               "such as fake_xperf.cmd, also read as a stream."
+            << std::endl;
+}
+
+// A stream that reads a file, a few bytes at a time.
+class FileStream : public ByteStream {
+ public:
+  // @param path path of the file.
+  // @param max_read_size maximum number of bytes returned by each read.
+  FileStream(const std::wstring& path, size_t max_read_size)
+      : file_(path, std::ios::in | std::ios::binary),
+        max_read_size_(max_read_size) {}
+
+  // ByteStream implementation.
+  bool Read(char* buffer, size_t size, size_t* bytes_read) override {
+    file_.read(buffer, static_cast<std::streamsize>(
+                           size < max_read_size_ ? size : max_read_size_));
+    *bytes_read = static_cast<size_t>(file_.gcount());
+    return *bytes_read != 0;
+  }
+
+  bool failed() const override { return file_.bad(); }
+
+ private:
+  std::ifstream file_;
+  size_t max_read_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileStream);
+};
+
+// A stream that reads the output of a command, like the output of xperf is
+// read when a trace is opened, a few bytes at a time.
+class CommandOutputStream : public ByteStream {
+ public:
+  // @param command the command to run.
+  // @param max_read_size maximum number of bytes returned by each read.
+  CommandOutputStream(const std::wstring& command, size_t max_read_size)
+      : max_read_size_(max_read_size), failed_(false) {
+#if defined(_WIN32)
+    output_ = _wpopen(command.c_str(), L"rb");
+#else
+    output_ = popen(base::WStringToString(command).c_str(), "r");
+#endif
+    failed_ = output_ == nullptr;
+  }
+
+  ~CommandOutputStream() override { Close(); }
+
+  // ByteStream implementation.
+  bool Read(char* buffer, size_t size, size_t* bytes_read) override {
+    *bytes_read = 0;
+    if (output_ == nullptr)
+      return false;
+    *bytes_read = fread(buffer, 1,
+                        size < max_read_size_ ? size : max_read_size_, output_);
+    if (*bytes_read == 0) {
+      Close();
+      return false;
+    }
+    return true;
+  }
+
+  bool failed() const override { return failed_; }
+
+ private:
+  // Waits for the command to exit, and checks its exit code.
+  void Close() {
+    if (output_ == nullptr)
+      return;
+#if defined(_WIN32)
+    int exit_code = _pclose(output_);
+#else
+    int exit_code = pclose(output_);
+#endif
+    output_ = nullptr;
+    if (exit_code != 0)
+      failed_ = true;
+  }
+
+  FILE* output_;
+  size_t max_read_size_;
+  bool failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(CommandOutputStream);
+};
+
+// Decodes the events of a trace.
+// @param reader an opened trace.
+// @param thread_pool threads that decode the chunks, or nullptr.
+// @param chunk_size size of the chunks.
+// @returns the events.
+std::vector<TraceEvent> DecodeEvents(const ETWReader& reader,
+                                     base::ThreadPool* thread_pool,
+                                     uint64_t chunk_size) {
+  std::vector<TraceEvent> events;
+  DecodeTraceEvents(reader, thread_pool, chunk_size,
+                    [&events](TraceEvent* event) {
+                      events.push_back(std::move(*event));
+                      return true;
+                    });
+  return events;
+}
+
+// @returns true if two events have the same fields.
+bool EventsAreEqual(const TraceEvent& expected_event, const TraceEvent& event) {
+  return expected_event.kind == event.kind &&
+         expected_event.type_id == event.type_id &&
+         expected_event.ts == event.ts && expected_event.tid == event.tid &&
+         expected_event.new_tid == event.new_tid &&
+         expected_event.old_tid == event.old_tid &&
+         expected_event.time_since_last == event.time_since_last &&
+         expected_event.logging_tid == event.logging_tid &&
+         expected_event.pid == event.pid &&
+         expected_event.text == event.text &&
+         expected_event.stack == event.stack &&
+         expected_event.is_first_non_empty_paint ==
+             event.is_first_non_empty_paint;
+}
+
+// Compares two sequences of events.
+// @param description what produced |events|, for the error message.
+// @returns true if they are the same.
+bool EventSequencesAreEqual(const std::vector<TraceEvent>& expected_events,
+                            const std::vector<TraceEvent>& events,
+                            const std::string& description) {
+  for (size_t i = 0; i < expected_events.size() && i < events.size(); ++i) {
+    if (!EventsAreEqual(expected_events[i], events[i])) {
+      std::cout << "Event " << i << " at ts=" << expected_events[i].ts
+                << " differs " << description << "." << std::endl;
+      return false;
+    }
+  }
+  if (expected_events.size() != events.size()) {
+    std::cout << "Decoded " << events.size() << " events instead of "
+              << expected_events.size() << " " << description << "."
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Checks that the chunks of a CSV dump decoded in parallel give the same events
+// as a serial decoding, for chunk sizes that put chunk boundaries in the middle
+// of the runs of Stack lines.
+// @param reader an opened CSV dump.
+// @param csv_size size of the CSV dump.
+// @param expected_events the events of the dump, decoded serially.
+// @param thread_pool threads that decode the chunks.
+// @returns true if the events are the same for all chunk sizes.
+bool CheckParallelDecoding(const ETWReader& reader,
+                           uint64_t csv_size,
+                           const std::vector<TraceEvent>& expected_events,
+                           base::ThreadPool* thread_pool) {
+  std::vector<uint64_t> chunk_sizes;
+  for (uint64_t chunk_size = 1; chunk_size <= kMaxConsecutiveChunkSize;
+       ++chunk_size) {
+    chunk_sizes.push_back(chunk_size);
+  }
+  for (uint64_t chunk_size = kMaxConsecutiveChunkSize * 3 / 2;
+       chunk_size < csv_size; chunk_size = chunk_size * 3 / 2) {
+    chunk_sizes.push_back(chunk_size);
+  }
+  chunk_sizes.push_back(kDefaultChunkSize);
+
+  bool equal = true;
+  for (uint64_t chunk_size : chunk_sizes) {
+    std::vector<TraceEvent> events =
+        DecodeEvents(reader, thread_pool, chunk_size);
+    if (!EventSequencesAreEqual(
+            expected_events, events,
+            "with chunks of " + std::to_string(chunk_size) + " bytes")) {
+      equal = false;
+    }
+  }
+  return equal;
+}
+
+// Checks that a CSV dump read from a stream gives the same events as the
+// mapped file.
+// @param stream the CSV dump.
+// @param expected_events the events of the mapped file.
+// @param thread_pool threads that would decode the chunks of a file, which
+//     aren't used for a stream.
+// @param description the stream, for the error messages.
+// @returns true if the events are the same.
+bool CheckStreamDecoding(std::unique_ptr<ByteStream> stream,
+                         const std::vector<TraceEvent>& expected_events,
+                         base::ThreadPool* thread_pool,
+                         const std::string& description) {
+  ETWReader reader;
+  if (!reader.OpenStream(std::move(stream), Subscription())) {
+    std::cout << "Unable to open " << description << "." << std::endl;
+    return false;
+  }
+  std::vector<TraceEvent> events =
+      DecodeEvents(reader, thread_pool, kDefaultChunkSize);
+  if (reader.stream_failed()) {
+    std::cout << "Error while reading " << description << "." << std::endl;
+    return false;
+  }
+  return EventSequencesAreEqual(expected_events, events, "in " + description);
+}
+
+}  // namespace
+
+int wmain(int argc, wchar_t* argv[], wchar_t* /*envp */ []) {
+  base::CommandLine command_line(argc, argv);
+
+  if (command_line.HasSwitch(L"help")) {
+    ShowUsage();
+    return 1;
+  }
+
+  std::wstring csv_path = command_line.GetSwitchValue(L"csv");
+  if (csv_path.empty())
+    csv_path = kDefaultCsvPath;
+
+  uint64_t num_threads = kDefaultNumThreads;
+  if (command_line.HasSwitch(L"threads") &&
+      (!base::StrToULong(command_line.GetSwitchValue(L"threads"),
+                         &num_threads) ||
+       num_threads == 0)) {
+    ShowUsage();
+    return 1;
+  }
+
+  ETWReader reader;
+  uint64_t csv_size = 0;
+  uint64_t csv_last_write_time = 0;
+  if (!base::GetFileSizeAndLastWriteTime(csv_path, &csv_size,
+                                         &csv_last_write_time) ||
+      !reader.OpenCsv(csv_path, Subscription())) {
+    std::cout << "Unable to open " << base::WStringToString(csv_path) << "."
+              << std::endl;
+    return 1;
+  }
+
+  std::vector<TraceEvent> expected_events =
+      DecodeEvents(reader, nullptr, kDefaultChunkSize);
+  if (expected_events.empty()) {
+    std::cout << "No events in " << base::WStringToString(csv_path) << "."
+              << std::endl;
+    return 1;
+  }
+  base::ThreadPool thread_pool(static_cast<size_t>(num_threads));
+
+  if (!CheckParallelDecoding(reader, csv_size, expected_events,
+                             &thread_pool)) {
+    std::cout << "The events decoded in parallel differ from the events "
+                 "decoded serially."
+              << std::endl;
+    return 1;
+  }
+
+  bool streams_equal = true;
+  for (size_t read_size : kStreamReadSizes) {
+    if (!CheckStreamDecoding(
+            std::unique_ptr<ByteStream>(new FileStream(csv_path, read_size)),
+            expected_events, &thread_pool,
+            "the stream of the file read " + std::to_string(read_size) +
+                " bytes at a time")) {
+      streams_equal = false;
+    }
+  }
+  std::wstring stand_in = command_line.GetSwitchValue(L"stand_in");
+  if (!stand_in.empty()) {
+    for (size_t read_size : kStreamReadSizes) {
+      if (!CheckStreamDecoding(std::unique_ptr<ByteStream>(
+                                   new CommandOutputStream(stand_in, read_size)),
+                               expected_events, &thread_pool,
+                               "the output of " +
+                                   base::WStringToString(stand_in) + " read " +
+                                   std::to_string(read_size) +
+                                   " bytes at a time")) {
+        streams_equal = false;
+      }
+    }
+  }
+  if (!streams_equal) {
+    std::cout << "The events decoded from a stream differ from the events "
+                 "decoded from the mapped file."
+              << std::endl;
+    return 1;
+  }
+
+  std::cout << "The " << expected_events.size() << " events of "
+            << base::WStringToString(csv_path)
+            << " are the same with all chunk sizes and streams." << std::endl;
+  return 0;
+}
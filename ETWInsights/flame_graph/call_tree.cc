@@ -0,0 +1,175 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "flame_graph/call_tree.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "base/logging.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Computes the list of children of the kept stacks of a trie.
+// @param stack_trie the stacks.
+// @param kept whether each stack is kept, indexed by stack id. The stack
+//     below a kept stack must be kept.
+// @param children_offsets the children of stack i are children[
+//     children_offsets[i]] to children[children_offsets[i + 1]], output.
+// @param children the children of the stacks, in the order in which they
+//     were added to the trie, output.
+void ComputeChildrenOfStacks(const StackTrie& stack_trie,
+                             const std::vector<bool>& kept,
+                             std::vector<size_t>* children_offsets,
+                             std::vector<StackId>* children) {
+  DCHECK(children_offsets != nullptr);
+  DCHECK(children != nullptr);
+
+  const size_t num_stacks = kept.size();
+  children_offsets->assign(num_stacks + 1, 0);
+  for (size_t stack_id = 1; stack_id < num_stacks; ++stack_id) {
+    if (kept[stack_id]) {
+      StackId parent = stack_trie.parent(static_cast<StackId>(stack_id));
+      ++(*children_offsets)[parent + 1];
+    }
+  }
+  for (size_t stack_id = 0; stack_id < num_stacks; ++stack_id)
+    (*children_offsets)[stack_id + 1] += (*children_offsets)[stack_id];
+
+  children->resize(children_offsets->back());
+  std::vector<size_t> next(children_offsets->begin(),
+                           children_offsets->end() - 1);
+  for (size_t stack_id = 1; stack_id < num_stacks; ++stack_id) {
+    if (kept[stack_id]) {
+      StackId parent = stack_trie.parent(static_cast<StackId>(stack_id));
+      (*children)[next[parent]++] = static_cast<StackId>(stack_id);
+    }
+  }
+}
+
+}  // namespace
+
+void VisitStacksInOrder(const StackTrie& stack_trie,
+                        const std::vector<bool>& stacks,
+                        StackCleaner* stack_cleaner,
+                        const StackVisitor& visitor) {
+  // Keep the visited stacks and the stacks below them. A stack is always
+  // added to a trie after the stack below its top frame.
+  std::vector<bool> kept(stacks);
+  if (kept.size() > stack_trie.size())
+    kept.resize(stack_trie.size());
+  if (kept.empty())
+    return;
+  for (size_t stack_id = kept.size() - 1; stack_id > 0; --stack_id) {
+    if (kept[stack_id])
+      kept[stack_trie.parent(static_cast<StackId>(stack_id))] = true;
+  }
+
+  std::vector<size_t> children_offsets;
+  std::vector<StackId> children;
+  ComputeChildrenOfStacks(stack_trie, kept, &children_offsets, &children);
+
+  // Traverse the kept stacks depth first. |path_frames| and |path_symbols|
+  // contain the frames of the current stack, from the bottom of the stack.
+  const FrameTable& frames = stack_trie.frames();
+  std::vector<std::pair<StackId, size_t>> to_visit;
+  std::vector<FrameId> path_frames;
+  std::vector<std::string_view> path_symbols;
+  std::vector<std::string_view> cleaned_stack;
+  std::vector<StackId> sorted_children;
+  to_visit.emplace_back(kEmptyStackId, 0);
+  while (!to_visit.empty()) {
+    StackId stack_id = to_visit.back().first;
+    size_t depth = to_visit.back().second;
+    to_visit.pop_back();
+
+    path_frames.resize(depth);
+    path_symbols.resize(depth);
+    if (stack_id != kEmptyStackId) {
+      path_frames.push_back(stack_trie.frame(stack_id));
+      path_symbols.push_back(frames.GetFrame(path_frames.back()));
+    }
+
+    if (stacks[stack_id]) {
+      if (stack_cleaner == nullptr) {
+        visitor(stack_id, path_symbols);
+      } else if (!stack_cleaner->ShouldIgnoreStack(path_frames)) {
+        stack_cleaner->CleanStack(path_frames, &cleaned_stack);
+        visitor(stack_id, cleaned_stack);
+      }
+    }
+
+    // Children are pushed in reverse order, so that they are visited in
+    // order.
+    sorted_children.assign(children.begin() + children_offsets[stack_id],
+                           children.begin() + children_offsets[stack_id + 1]);
+    std::sort(sorted_children.begin(), sorted_children.end(),
+              [&stack_trie, &frames](StackId a, StackId b) {
+                return frames.GetFrame(stack_trie.frame(a)) >
+                       frames.GetFrame(stack_trie.frame(b));
+              });
+    for (StackId child : sorted_children)
+      to_visit.emplace_back(child, path_frames.size());
+  }
+}
+
+const CallTree::NodeId CallTree::kRootNodeId;
+
+CallTree::CallTree() : self_times_(1, 0), has_self_time_(1, false) {}
+
+CallTree::NodeId CallTree::GetChild(NodeId parent, std::string_view frame) {
+  DCHECK_LT(parent, size());
+  NodeId child = stacks_.PushFrame(parent, frame);
+  if (child >= self_times_.size()) {
+    self_times_.resize(size(), 0);
+    has_self_time_.resize(size(), false);
+  }
+  return child;
+}
+
+void CallTree::AddSelfTime(NodeId node_id, base::Timestamp duration) {
+  DCHECK_LT(node_id, size());
+  self_times_[node_id] += duration;
+  has_self_time_[node_id] = true;
+}
+
+void CallTree::ComputeInclusiveTimes() {
+  ComputeInclusiveTimes(self_times_, &inclusive_times_);
+}
+
+void CallTree::ComputeInclusiveTimes(
+    const std::vector<base::Timestamp>& self_times,
+    std::vector<base::Timestamp>* inclusive_times) const {
+  DCHECK(inclusive_times != nullptr);
+  DCHECK_EQ(size(), self_times.size());
+  *inclusive_times = self_times;
+
+  // Children come after their parent, so a node has received the time of all
+  // its children when it is reached.
+  for (size_t node_id = size() - 1; node_id > 0; --node_id) {
+    (*inclusive_times)[parent(static_cast<NodeId>(node_id))] +=
+        (*inclusive_times)[node_id];
+  }
+}
+
+void CallTree::ComputeChildren() {
+  ComputeChildrenOfStacks(stacks_, std::vector<bool>(size(), true),
+                          &children_offsets_, &children_);
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,162 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+#include "base/base.h"
+#include "base/types.h"
+#include "etw_reader/frame_table.h"
+#include "etw_reader/stack_trie.h"
+#include "flame_graph/clean_stack.h"
+
+namespace etw_insights {
+
+// Receives a stack of a StackTrie and its frames, from the bottom of the
+// stack. The frames are valid until the visitor returns.
+typedef std::function<void(StackId stack_id,
+                           const std::vector<std::string_view>& stack)>
+    StackVisitor;
+
+// Traverses the stacks of a trie depth first, visiting the stacks above a
+// stack in the order of their top frames, so that the result doesn't depend
+// on the order in which the stacks were added to the trie.
+// @param stack_trie the stacks.
+// @param stacks whether each stack is visited, indexed by stack id. Stacks
+//     beyond its size aren't visited.
+// @param stack_cleaner if not nullptr, the stacks that it ignores aren't
+//     visited, and the frames of the other stacks are cleaned.
+// @param visitor called for each visited stack, sorted by frames from the
+//     bottom of the stack.
+void VisitStacksInOrder(const StackTrie& stack_trie,
+                        const std::vector<bool>& stacks,
+                        StackCleaner* stack_cleaner,
+                        const StackVisitor& visitor);
+
+// A call tree of cleaned call stacks: each node is a call stack of a
+// StackTrie, rooted at the bottom of the stacks, and accumulates the time
+// spent in that stack (self time) and in that stack or the stacks above it
+// (inclusive time). The times of the call stacks of a trace are aggregated
+// by stack id on the trie of the trace; this tree only holds the stacks
+// once cleaned, whose frames differ from those of the trace.
+class CallTree {
+ public:
+  // Identifies a node of the tree: the id of its stack.
+  typedef StackId NodeId;
+
+  // The root of the tree: the empty stack.
+  static const NodeId kRootNodeId = kEmptyStackId;
+
+  CallTree();
+
+  // @param parent a node.
+  // @param frame a frame.
+  // @returns the child of |parent| for |frame|. The child is added if it
+  //     doesn't exist.
+  NodeId GetChild(NodeId parent, std::string_view frame);
+
+  // Adds time spent in the stack of a node.
+  // @param node_id a node.
+  // @param duration the time spent in the stack.
+  void AddSelfTime(NodeId node_id, base::Timestamp duration);
+
+  // Computes the inclusive time of all the nodes from their self time. Must
+  // be called after the last call to AddSelfTime() and before
+  // inclusive_time() is used.
+  void ComputeInclusiveTimes();
+
+  // Computes inclusive times from self times given for the nodes of the tree,
+  // e.g. the times of another flame graph on the same tree.
+  // @param self_times the self time of each node, indexed by node id.
+  // @param inclusive_times the inclusive time of each node, output.
+  void ComputeInclusiveTimes(
+      const std::vector<base::Timestamp>& self_times,
+      std::vector<base::Timestamp>* inclusive_times) const;
+
+  // Computes the list of children of each node, returned by children_begin()
+  // and children_end(). Must be called after the last node is added.
+  void ComputeChildren();
+
+  // @returns the children of a node, after ComputeChildren().
+  const NodeId* children_begin(NodeId node_id) const {
+    return children_.data() + children_offsets_[node_id];
+  }
+  const NodeId* children_end(NodeId node_id) const {
+    return children_.data() + children_offsets_[node_id + 1];
+  }
+
+  // @returns the frame at the top of the stack of a node, other than the
+  //     root.
+  FrameId frame(NodeId node_id) const { return stacks_.frame(node_id); }
+
+  // @returns the parent of a node, other than the root.
+  NodeId parent(NodeId node_id) const { return stacks_.parent(node_id); }
+
+  // @returns the time spent in the stack of a node.
+  base::Timestamp self_time(NodeId node_id) const {
+    return self_times_[node_id];
+  }
+
+  // @returns true if AddSelfTime() was called for a node, even with a
+  //     duration of 0.
+  bool has_self_time(NodeId node_id) const {
+    return has_self_time_[node_id];
+  }
+
+  // @returns whether AddSelfTime() was called for each node, indexed by node
+  //     id.
+  const std::vector<bool>& nodes_with_self_time() const {
+    return has_self_time_;
+  }
+
+  // @returns the time spent in the stack of a node or in the stacks above it.
+  base::Timestamp inclusive_time(NodeId node_id) const {
+    return inclusive_times_[node_id];
+  }
+
+  // @returns the stacks of the nodes.
+  const StackTrie& stacks() const { return stacks_; }
+
+  // @returns the frames of the nodes.
+  const FrameTable& frames() const { return stacks_.frames(); }
+
+  // @returns the number of nodes, including the root. Node ids are smaller
+  //     than this number.
+  size_t size() const { return stacks_.size(); }
+
+ private:
+  // Stacks of the nodes.
+  StackTrie stacks_;
+
+  // Self time, inclusive time, and whether AddSelfTime() was called, indexed
+  // by node id.
+  std::vector<base::Timestamp> self_times_;
+  std::vector<base::Timestamp> inclusive_times_;
+  std::vector<bool> has_self_time_;
+
+  // Children of each node: the children of node i are
+  // children_[children_offsets_[i]] to children_[children_offsets_[i + 1]].
+  std::vector<size_t> children_offsets_;
+  std::vector<NodeId> children_;
+
+  DISALLOW_COPY_AND_ASSIGN(CallTree);
+};
+
+}  // namespace etw_insights
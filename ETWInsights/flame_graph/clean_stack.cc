@@ -16,14 +16,77 @@ limitations under the License.
 
 #include "flame_graph/clean_stack.h"
 
+#include <iterator>
+
+#include "base/logging.h"
 #include "base/string_utils.h"
 
 namespace etw_insights {
 
 namespace {
 
+// Ignore call stacks that contain these sequences of frames.
+const char* kSequencesToIgnore[][2] = {
+    {"base::SequencedWorkerPool::Inner::ThreadLoop",
+     "base::WinVistaCondVar::TimedWait"},
+    {"base::SequencedWorkerPool::Inner::ThreadLoop",
+     "base::WinVistaCondVar::Wait"},
+    {"base::SequencedWorkerPool::Worker::Worker", "base::WaitableEvent::Wait"},
+    {"base::MessageLoop::RunHandler", "base::WaitableEvent::Wait"},
+    {"base::MessagePumpDefault::Run", "base::WaitableEvent::TimedWait"},
+    {"base::MessagePumpForIO::DoRunLoop",
+     "base::MessagePumpForIO::WaitForIOCompletion"},
+    {"base::MessagePumpForUI::DoRunLoop", "MsgWaitForMultipleObjectsEx"},
+    {"base::trace_event::TraceEventETWExport::ETWKeywordUpdateThread::"
+     "ThreadMain",
+     "base::PlatformThread::Sleep"},
+    {"cc::TaskGraphRunner::Run", "base::WinVistaCondVar::Wait"},
+    {"MojoWaitMany", "mojo::system::Core::WaitMany"},
+    {"TppWorkerThread", "ZwWaitForWorkViaWorkerFactory"},
+    {"sandbox::BrokerServicesBase::TargetEventsThread",
+     "GetQueuedCompletionStatus"},
+};
+const size_t kSequencesToIgnoreSize = std::size(kSequencesToIgnore);
+
+// Ignore call stacks that contain these frames.
+const char* kFramesToIgnore[] = {
+    "EtwpQueueStackWalkApc", "EtwpTraceStackWalk", "EtwpLogKernelEvent",
+};
+const size_t kFramesToIgnoreSize = std::size(kFramesToIgnore);
+
+// Off-CPU frame.
+const char kOffCpuFrame[] = "[Off-CPU]";
+
+// Frame that begins a page fault.
+const char kPageFaultFrame[] = "ntoskrnl.exe!KiPageFault";
+
+// Frames that replace a page fault in cleaned stacks.
+const char kCleanedPageFaultFrame[] = "[Page Fault]";
+
+// Frame added at the top of truncated stacks.
+const char kTruncatedFrame[] = "[Truncated]";
+
+// Stacks are truncated after this number of cleaned frames.
 const size_t kMaxStackSize = 60;
 
+// Remove these frames from cleaned stacks: uninteresting frames at the bottom
+// and at the top of the stacks.
+const char* kFramesToRemove[] = {
+    "ntdll.dll!_RtlUserThreadStart",
+    "ntdll.dll!__RtlUserThreadStart",
+    "kernel32.dll!BaseThreadInitThunk",
+    "chrome.exe!__tmainCRTStartup",
+    "ntoskrnl.exe!SwapContext_PatchLdMxCsr",
+    "ntoskrnl.exe!KiSwapContext",
+    "ntoskrnl.exe!KiSwapThread",
+    "ntoskrnl.exe!KiCommitThreadWait",
+    "ntoskrnl.exe!KeWaitForSingoeObject",
+};
+const size_t kFramesToRemoveSize = std::size(kFramesToRemove);
+
+static_assert(kSequencesToIgnoreSize <= 32,
+              "Matches of sequences to ignore are stored in 32-bit masks.");
+
 std::string CleanSymbol(const std::string& symbol) {
   // Don't clean special symbols.
   if (symbol.empty() || symbol.front() == '[')
@@ -43,53 +106,105 @@ std::string CleanSymbol(const std::string& symbol) {
 
 }  // namespace
 
-Stack CleanStack(const Stack& stack) {
-  Stack cleaned_stack;
+StackCleaner::StackCleaner(const FrameTable& frames)
+    : frames_(frames), frame_rules_(frames.size()) {}
+
+StackCleaner::~StackCleaner() {}
+
+bool StackCleaner::ShouldIgnoreStack(const std::vector<FrameId>& stack) {
+  if (stack.empty())
+    return true;
+
+  bool is_off_cpu = GetFrameRules(stack.back()).is_off_cpu;
+
+  uint32_t previous_sequence_first_mask = 0;
+  for (FrameId frame_id : stack) {
+    const FrameRules& rules = GetFrameRules(frame_id);
+
+    // Ignore sequences of frames: a frame that matches the first frame of a
+    // sequence, followed by a frame that matches its second frame.
+    if (is_off_cpu &&
+        (previous_sequence_first_mask & rules.sequence_second_mask) != 0) {
+      return true;
+    }
+    previous_sequence_first_mask = rules.sequence_first_mask;
+
+    // Ignore single frames.
+    if (rules.ignored)
+      return true;
+  }
+
+  return false;
+}
+
+void StackCleaner::CleanStack(const std::vector<FrameId>& stack,
+                              std::vector<std::string_view>* cleaned_stack) {
+  DCHECK(cleaned_stack != nullptr);
+  cleaned_stack->clear();
 
   bool is_in_page_fault = false;
 
-  for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+  for (FrameId frame_id : stack) {
     // Truncate tall stacks.
-    if (cleaned_stack.size() > kMaxStackSize) {
-      cleaned_stack.push_back("[Truncated]");
+    if (cleaned_stack->size() > kMaxStackSize) {
+      cleaned_stack->push_back(kTruncatedFrame);
       break;
     }
 
+    const FrameRules& rules = GetFrameRules(frame_id);
+
     // Simplify page fault call stack.
-    if (*it == "ntoskrnl.exe!KiPageFault") {
+    if (rules.is_page_fault)
       is_in_page_fault = true;
-    }
     if (is_in_page_fault) {
-      if (*it == "[Off-CPU]") {
+      if (rules.is_off_cpu) {
         is_in_page_fault = false;
-        cleaned_stack.push_back("[Page Fault]");
-        cleaned_stack.push_back("[Off-CPU]");
+        cleaned_stack->push_back(kCleanedPageFaultFrame);
+        cleaned_stack->push_back(kOffCpuFrame);
       }
       continue;
     }
 
-    // Ignore some symbols at the bottom of the stack.
-    if (*it == "ntdll.dll!_RtlUserThreadStart" ||
-        *it == "ntdll.dll!__RtlUserThreadStart" ||
-        *it == "kernel32.dll!BaseThreadInitThunk" ||
-        *it == "chrome.exe!__tmainCRTStartup") {
+    if (rules.removed)
       continue;
-    }
-
-    // Ignore some symbols at the top of the stack.
-    if (*it == "ntoskrnl.exe!SwapContext_PatchLdMxCsr" ||
-        *it == "ntoskrnl.exe!KiSwapContext" ||
-        *it == "ntoskrnl.exe!KiSwapThread" ||
-        *it == "ntoskrnl.exe!KiCommitThreadWait" ||
-        *it == "ntoskrnl.exe!KeWaitForSingoeObject") {
-      continue;
-    }
 
     // Add the symbol to the cleaned stack.
-    cleaned_stack.push_back(CleanSymbol(*it));
+    cleaned_stack->push_back(rules.cleaned);
+  }
+}
+
+const StackCleaner::FrameRules& StackCleaner::GetFrameRules(
+    FrameId frame_id) {
+  DCHECK_LT(frame_id, frame_rules_.size());
+  FrameRules& rules = frame_rules_[frame_id];
+  if (rules.computed)
+    return rules;
+
+  const std::string frame(frames_.GetFrame(frame_id));
+  rules.computed = true;
+
+  for (size_t i = 0; i < kFramesToIgnoreSize; ++i) {
+    if (base::StringEndsWith(frame, kFramesToIgnore[i]))
+      rules.ignored = true;
+  }
+
+  for (size_t i = 0; i < kSequencesToIgnoreSize; ++i) {
+    if (base::StringEndsWith(frame, kSequencesToIgnore[i][0]))
+      rules.sequence_first_mask |= 1U << i;
+    if (base::StringEndsWith(frame, kSequencesToIgnore[i][1]))
+      rules.sequence_second_mask |= 1U << i;
+  }
+
+  rules.is_off_cpu = frame == kOffCpuFrame;
+  rules.is_page_fault = frame == kPageFaultFrame;
+
+  for (size_t i = 0; i < kFramesToRemoveSize; ++i) {
+    if (frame == kFramesToRemove[i])
+      rules.removed = true;
   }
 
-  return cleaned_stack;
+  rules.cleaned = CleanSymbol(frame);
+  return rules;
 }
 
 }  // namespace etw_insights
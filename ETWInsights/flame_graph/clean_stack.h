@@ -16,16 +16,88 @@ limitations under the License.
 
 #pragma once
 
-#include "etw_reader/stack.h"
-
+#include <stdint.h>
 #include <string>
+#include <string_view>
+#include <vector>
+
+#include "base/base.h"
+#include "etw_reader/frame_table.h"
 
 namespace etw_insights {
 
-// Cleans a call stack.
+// Decides which call stacks are ignored in a flame graph, and cleans the
+// others:
+// - Stacks that contain some frames, or some sequences of frames while the
+//   thread is off-CPU, are ignored.
 // - Tall call stacks are truncated.
 // - Frames related to page faults are replaced by [Page Fault].
-// - Uninteresting frames are removed.
-Stack CleanStack(const Stack& stack);
+// - Uninteresting frames are removed, and module extensions are removed from
+//   the other frames.
+// Stacks are given as frame ids. The rules are evaluated once per distinct
+// frame, the first time it is seen, so filtering and cleaning a stack only
+// reads integers and cached strings.
+class StackCleaner {
+ public:
+  // @param frames the frames of the stacks. Must outlive the cleaner.
+  explicit StackCleaner(const FrameTable& frames);
+  ~StackCleaner();
+
+  // @param stack the frames of a stack, from the bottom of the stack.
+  // @returns true if the stack should be ignored.
+  bool ShouldIgnoreStack(const std::vector<FrameId>& stack);
+
+  // Cleans a stack.
+  // @param stack the frames of a stack, from the bottom of the stack.
+  // @param cleaned_stack the cleaned frames, from the bottom of the stack,
+  //     output. Valid as long as the cleaner.
+  void CleanStack(const std::vector<FrameId>& stack,
+                  std::vector<std::string_view>* cleaned_stack);
+
+ private:
+  // What the rules say about a frame.
+  struct FrameRules {
+    FrameRules()
+        : computed(false),
+          ignored(false),
+          sequence_first_mask(0),
+          sequence_second_mask(0),
+          is_off_cpu(false),
+          is_page_fault(false),
+          removed(false) {}
+
+    // Whether the other members were computed.
+    bool computed;
+
+    // Whether stacks that contain the frame are ignored.
+    bool ignored;
+
+    // Bit i is set if the frame matches the first (resp. second) frame of
+    // sequence i of frames to ignore.
+    uint32_t sequence_first_mask;
+    uint32_t sequence_second_mask;
+
+    // Whether the frame is [Off-CPU], or begins a page fault.
+    bool is_off_cpu;
+    bool is_page_fault;
+
+    // Whether the frame is removed from cleaned stacks.
+    bool removed;
+
+    // The frame in cleaned stacks.
+    std::string cleaned;
+  };
+
+  // @returns the rules of a frame, computed the first time.
+  const FrameRules& GetFrameRules(FrameId frame_id);
+
+  // The frames of the stacks.
+  const FrameTable& frames_;
+
+  // Rules of each frame, indexed by frame id.
+  std::vector<FrameRules> frame_rules_;
+
+  DISALLOW_COPY_AND_ASSIGN(StackCleaner);
+};
 
 }  // namespace etw_insights
@@ -0,0 +1,116 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "flame_graph/diff_flame_graph.h"
+
+#include <fstream>
+#include <string_view>
+
+#include "base/logging.h"
+
+namespace etw_insights {
+
+DiffFlameGraph::DiffFlameGraph(FlameGraph* baseline,
+                               FlameGraph* flame_graph,
+                               bool normalize) {
+  DCHECK(baseline != nullptr);
+  DCHECK(flame_graph != nullptr);
+
+  base::Timestamp total_time = 0;
+  flame_graph->VisitCleanedStacks(
+      [this, &total_time](const std::vector<std::string_view>& stack,
+                          base::Timestamp duration) {
+        tree_.AddSelfTime(GetNode(stack), duration);
+        total_time += duration;
+      });
+
+  // Stacks of the baseline are marked as having self time in |tree_|, even if
+  // none was spent in them in the compared flame graph, so that the text
+  // report lists them.
+  base::Timestamp baseline_total_time = 0;
+  baseline->VisitCleanedStacks(
+      [this, &baseline_total_time](const std::vector<std::string_view>& stack,
+                                   base::Timestamp duration) {
+        CallTree::NodeId node_id = GetNode(stack);
+        tree_.AddSelfTime(node_id, 0);
+        if (node_id >= baseline_self_times_.size())
+          baseline_self_times_.resize(tree_.size(), 0);
+        baseline_self_times_[node_id] += duration;
+        baseline_total_time += duration;
+      });
+  baseline_self_times_.resize(tree_.size(), 0);
+
+  if (normalize && baseline_total_time != 0 &&
+      baseline_total_time != total_time) {
+    const double scale = static_cast<double>(total_time) /
+                         static_cast<double>(baseline_total_time);
+    for (base::Timestamp& time : baseline_self_times_) {
+      time = static_cast<base::Timestamp>(static_cast<double>(time) * scale +
+                                          0.5);
+    }
+  }
+
+  tree_.ComputeInclusiveTimes();
+  tree_.ComputeChildren();
+  tree_.ComputeInclusiveTimes(baseline_self_times_, &baseline_inclusive_times_);
+}
+
+void DiffFlameGraph::WriteTxtReport(const std::wstring& path) {
+  std::ofstream out(path, std::ios::binary);
+  VisitStacksInOrder(
+      tree_.stacks(), tree_.nodes_with_self_time(), nullptr,
+      [this, &out](CallTree::NodeId node_id,
+                   const std::vector<std::string_view>& stack) {
+        bool first = true;
+        for (const auto& symbol : stack) {
+          if (!first)
+            out << ";";
+          first = false;
+          out << symbol;
+        }
+
+        out << " " << baseline_self_times_[node_id] << " "
+            << tree_.self_time(node_id) << "\n";
+      });
+}
+
+void DiffFlameGraph::WriteSvgReport(const std::wstring& path,
+                                    const SvgRendererOptions& options) {
+  std::ofstream out(path, std::ios::binary);
+  if (!WriteSvgDiffFlameGraph(tree_, baseline_inclusive_times_, tree_.frames(),
+                              options, &out)) {
+    LOG(ERROR) << "Error while writing the flame graph image.";
+  }
+}
+
+void DiffFlameGraph::WriteHtmlReport(const std::wstring& path,
+                                     const SvgRendererOptions& options) {
+  std::ofstream out(path, std::ios::binary);
+  if (!WriteHtmlDiffFlameGraph(tree_, baseline_inclusive_times_,
+                               tree_.frames(), options, &out)) {
+    LOG(ERROR) << "Error while writing the flame graph page.";
+  }
+}
+
+CallTree::NodeId DiffFlameGraph::GetNode(
+    const std::vector<std::string_view>& stack) {
+  CallTree::NodeId node_id = CallTree::kRootNodeId;
+  for (const auto& symbol : stack)
+    node_id = tree_.GetChild(node_id, symbol);
+  return node_id;
+}
+
+}  // namespace etw_insights
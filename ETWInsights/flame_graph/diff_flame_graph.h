@@ -0,0 +1,76 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "base/base.h"
+#include "base/types.h"
+#include "flame_graph/call_tree.h"
+#include "flame_graph/flame_graph.h"
+#include "flame_graph/svg_renderer.h"
+
+namespace etw_insights {
+
+// Compares the time spent in each cleaned call stack of a flame graph with
+// the time spent in the same call stack of a baseline flame graph, e.g. the
+// flame graph of the previous build or of another window of the same trace.
+// The call stacks of both flame graphs are merged in a single call tree, so
+// that a node has a time in each flame graph.
+class DiffFlameGraph {
+ public:
+  // @param baseline the baseline flame graph.
+  // @param flame_graph the flame graph compared to the baseline.
+  // @param normalize whether the times of the baseline are scaled so that its
+  //     total time is the total time of |flame_graph|. Otherwise, the times
+  //     are compared as they are.
+  DiffFlameGraph(FlameGraph* baseline, FlameGraph* flame_graph, bool normalize);
+
+  // Writes one line per call stack in which time was spent in either flame
+  // graph, sorted by frames from the bottom of the stack: the frames, the
+  // time spent in the baseline and the time spent in the flame graph. This is
+  // the format of difffolded.pl, which flamegraph.pl renders.
+  void WriteTxtReport(const std::wstring& path);
+
+  // Renders the differential flame graph in an SVG image, or in a standalone
+  // HTML page. The width of a frame is its time in the flame graph, and its
+  // color tells how it changed from the baseline. Call stacks that are only
+  // in the baseline aren't drawn.
+  void WriteSvgReport(const std::wstring& path,
+                      const SvgRendererOptions& options);
+  void WriteHtmlReport(const std::wstring& path,
+                       const SvgRendererOptions& options);
+
+ private:
+  // @returns the node of |tree_| of a cleaned call stack.
+  CallTree::NodeId GetNode(const std::vector<std::string_view>& stack);
+
+  // Call tree of the cleaned call stacks of both flame graphs, with the times
+  // of the compared flame graph.
+  CallTree tree_;
+
+  // Self and inclusive times of the nodes of |tree_| in the baseline, after
+  // normalization. Indexed by node id.
+  std::vector<base::Timestamp> baseline_self_times_;
+  std::vector<base::Timestamp> baseline_inclusive_times_;
+
+  DISALLOW_COPY_AND_ASSIGN(DiffFlameGraph);
+};
+
+}  // namespace etw_insights
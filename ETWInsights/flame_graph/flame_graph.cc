@@ -16,115 +16,35 @@ limitations under the License.
 
 #include "flame_graph/flame_graph.h"
 
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
-
 #include <fstream>
+#include <string_view>
+#include <vector>
 
-#include "base/child_process.h"
-#include "base/file.h"
-#include "base/string_utils.h"
+#include "base/logging.h"
 #include "flame_graph/clean_stack.h"
 
 namespace etw_insights {
 
-namespace {
-
-// Ignore call stacks that contain these sequences of frames.
-const char* kSequencesToIgnore[][2] = {
-    {"base::SequencedWorkerPool::Inner::ThreadLoop",
-     "base::WinVistaCondVar::TimedWait"},
-    {"base::SequencedWorkerPool::Inner::ThreadLoop",
-     "base::WinVistaCondVar::Wait"},
-    {"base::SequencedWorkerPool::Worker::Worker", "base::WaitableEvent::Wait"},
-    {"base::MessageLoop::RunHandler", "base::WaitableEvent::Wait"},
-    {"base::MessagePumpDefault::Run", "base::WaitableEvent::TimedWait"},
-    {"base::MessagePumpForIO::DoRunLoop",
-     "base::MessagePumpForIO::WaitForIOCompletion"},
-    {"base::MessagePumpForUI::DoRunLoop", "MsgWaitForMultipleObjectsEx"},
-    {"base::trace_event::TraceEventETWExport::ETWKeywordUpdateThread::"
-     "ThreadMain",
-     "base::PlatformThread::Sleep"},
-    {"cc::TaskGraphRunner::Run", "base::WinVistaCondVar::Wait"},
-    {"MojoWaitMany", "mojo::system::Core::WaitMany"},
-    {"TppWorkerThread", "ZwWaitForWorkViaWorkerFactory"},
-    {"sandbox::BrokerServicesBase::TargetEventsThread",
-     "GetQueuedCompletionStatus"},
-};
-const size_t kSequencesToIgnoreSize = ARRAYSIZE(kSequencesToIgnore);
-
-// Ignore call stacks that contain these frames.
-const char* kFramesToIgnore[] = {
-    "EtwpQueueStackWalkApc", "EtwpTraceStackWalk", "EtwpLogKernelEvent",
-};
-const size_t kFramesToIgnoreSize = ARRAYSIZE(kFramesToIgnore);
-
-bool ShouldIgnoreStack(const Stack& stack) {
-  if (stack.empty())
-    return true;
-
-  bool is_off_cpu = stack.front() == "[Off-CPU]";
-
-  for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
-    // Ignore sequences of frames.
-    auto next_it = it + 1;
-    if (is_off_cpu && next_it != stack.rend()) {
-      for (size_t sequence_index = 0; sequence_index < kSequencesToIgnoreSize;
-           ++sequence_index) {
-        if (base::StringEndsWith(*it, kSequencesToIgnore[sequence_index][0]) &&
-            base::StringEndsWith(*next_it,
-                                 kSequencesToIgnore[sequence_index][1])) {
-          return true;
-        }
-      }
-    }
-
-    // Ignore single frames.
-    for (size_t frame_index = 0; frame_index < kFramesToIgnoreSize;
-         ++frame_index) {
-      if (base::StringEndsWith(*it, kFramesToIgnore[frame_index]))
-        return true;
-    }
-  }
-
-  return false;
-}
-
-}  // namespace
-
-FlameGraph::FlameGraph() {}
+FlameGraph::FlameGraph(const StackTrie& stack_trie)
+    : stack_trie_(stack_trie) {}
 
 void FlameGraph::AddThreadHistory(const ThreadHistory& thread_history,
                                   base::Timestamp start_ts,
                                   base::Timestamp end_ts) {
-  auto it = thread_history.Stacks().IteratorFromTimestamp(start_ts);
-  auto end_it = thread_history.Stacks().IteratorEnd();
-
-  for (; it != end_it && it->start_ts < end_ts; ++it) {
-    base::Timestamp stack_start_ts = max(start_ts, it->start_ts);
-
-    base::Timestamp stack_end_ts = min(end_ts, thread_history.end_ts());
-    auto next_it = it + 1;
-    if (next_it != end_it && next_it->start_ts < stack_end_ts)
-      stack_end_ts = next_it->start_ts;
-
-    if (stack_end_ts < stack_start_ts) {
-      continue;
-    }
-
-    base::Timestamp stack_duration = stack_end_ts - stack_start_ts;
-    stack_time_[it->value] += stack_duration;
-  }
+  self_times_.resize(stack_trie_.size(), 0);
+  has_self_time_.resize(stack_trie_.size(), false);
+  thread_history.Stacks().Aggregate(
+      start_ts, end_ts, thread_history.end_ts(),
+      [this](StackId stack_id, base::Timestamp duration) {
+        self_times_[stack_id] += duration;
+        has_self_time_[stack_id] = true;
+      });
 }
 
 void FlameGraph::WriteTxtReport(const std::wstring& path) {
   std::ofstream out(path, std::ios::binary);
-
-  for (const auto& stack_and_time : stack_time_) {
-    if (ShouldIgnoreStack(stack_and_time.first))
-      continue;
-
-    Stack stack = CleanStack(stack_and_time.first);
+  VisitCleanedStacks([&out](const std::vector<std::string_view>& stack,
+                            base::Timestamp duration) {
     bool first = true;
     for (const auto& symbol : stack) {
       if (!first)
@@ -133,8 +53,53 @@ void FlameGraph::WriteTxtReport(const std::wstring& path) {
       out << symbol;
     }
 
-    out << " " << stack_and_time.second << "\n";
-  }
+    out << " " << duration << "\n";
+  });
+}
+
+void FlameGraph::WriteSvgReport(const std::wstring& path,
+                                const SvgRendererOptions& options) {
+  CallTree tree;
+  BuildCleanedCallTree(&tree);
+
+  std::ofstream out(path, std::ios::binary);
+  if (!WriteSvgFlameGraph(tree, tree.frames(), options, &out))
+    LOG(ERROR) << "Error while writing the flame graph image.";
+}
+
+void FlameGraph::WriteHtmlReport(const std::wstring& path,
+                                 const SvgRendererOptions& options) {
+  CallTree tree;
+  BuildCleanedCallTree(&tree);
+
+  std::ofstream out(path, std::ios::binary);
+  if (!WriteHtmlFlameGraph(tree, tree.frames(), options, &out))
+    LOG(ERROR) << "Error while writing the flame graph page.";
+}
+
+void FlameGraph::VisitCleanedStacks(const CleanedStackVisitor& visitor) {
+  StackCleaner stack_cleaner(stack_trie_.frames());
+  VisitStacksInOrder(
+      stack_trie_, has_self_time_, &stack_cleaner,
+      [this, &visitor](StackId stack_id,
+                       const std::vector<std::string_view>& stack) {
+        visitor(stack, self_times_[stack_id]);
+      });
+}
+
+void FlameGraph::BuildCleanedCallTree(CallTree* tree) {
+  DCHECK(tree != nullptr);
+
+  VisitCleanedStacks([tree](const std::vector<std::string_view>& stack,
+                            base::Timestamp duration) {
+    CallTree::NodeId node_id = CallTree::kRootNodeId;
+    for (const auto& symbol : stack)
+      node_id = tree->GetChild(node_id, symbol);
+    tree->AddSelfTime(node_id, duration);
+  });
+
+  tree->ComputeInclusiveTimes();
+  tree->ComputeChildren();
 }
 
 }  // namespace etw_insights
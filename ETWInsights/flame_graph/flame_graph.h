@@ -16,28 +16,69 @@ limitations under the License.
 
 #pragma once
 
-#include <map>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "base/base.h"
 #include "base/types.h"
+#include "etw_reader/stack_trie.h"
 #include "etw_reader/thread_history.h"
+#include "flame_graph/call_tree.h"
+#include "flame_graph/svg_renderer.h"
 
 namespace etw_insights {
 
+// Aggregates the time spent in each call stack of threads, and writes it in
+// the collapsed format of flamegraph.pl or renders it as an SVG image. Times
+// are aggregated by stack id, on the stack trie of the threads.
 class FlameGraph {
  public:
-  FlameGraph();
+  // Receives a cleaned call stack, from the bottom of the stack, and the time
+  // spent in it.
+  typedef std::function<void(const std::vector<std::string_view>& stack,
+                             base::Timestamp duration)>
+      CleanedStackVisitor;
+
+  // @param stack_trie the call stacks referenced by the thread histories
+  //     added to the flame graph.
+  explicit FlameGraph(const StackTrie& stack_trie);
 
   void AddThreadHistory(const ThreadHistory& thread_history,
                         base::Timestamp start_ts,
                         base::Timestamp end_ts);
 
+  // Writes one line per call stack in which time was spent, sorted by
+  // frames from the bottom of the stack.
   void WriteTxtReport(const std::wstring& path);
 
+  // Renders the flame graph in an SVG image, or in a standalone HTML page.
+  // Frames are cleaned like in the text report, and stacks that are the same
+  // once cleaned are merged.
+  void WriteSvgReport(const std::wstring& path,
+                      const SvgRendererOptions& options);
+  void WriteHtmlReport(const std::wstring& path,
+                       const SvgRendererOptions& options);
+
+  // Calls |visitor| for each call stack in which time was spent and which
+  // isn't ignored, sorted by frames from the bottom of the stack. The frames
+  // passed to |visitor| are valid until it returns.
+  void VisitCleanedStacks(const CleanedStackVisitor& visitor);
+
  private:
-  // Map: Stack -> Total time spent in the call stack.
-  typedef std::map<Stack, base::Timestamp> StackTimeMap;
-  StackTimeMap stack_time_;
+  // Builds a call tree of the cleaned call stacks, with its inclusive times
+  // and its children computed.
+  // @param tree the call tree, output.
+  void BuildCleanedCallTree(CallTree* tree);
+
+  // Call stacks referenced by the thread histories.
+  const StackTrie& stack_trie_;
+
+  // Time spent in each call stack of |stack_trie_|, and whether time was
+  // added to it, even 0, indexed by stack id.
+  std::vector<base::Timestamp> self_times_;
+  std::vector<bool> has_self_time_;
 
   DISALLOW_COPY_AND_ASSIGN(FlameGraph);
 };
@@ -19,22 +19,54 @@ limitations under the License.
 #undef min
 #undef max
 
+#include <stdlib.h>
+#include <future>
 #include <iostream>
+#include <memory>
 
 #include "base/command_line.h"
+#include "base/file.h"
 #include "base/logging.h"
 #include "base/numeric_conversions.h"
 #include "base/string_utils.h"
+#include "base/thread_pool.h"
 #include "etw_reader/generate_history_from_trace.h"
 #include "etw_reader/system_history.h"
+#include "flame_graph/diff_flame_graph.h"
 #include "flame_graph/flame_graph.h"
+#include "flame_graph/sliced_flame_graph.h"
 
 using namespace etw_insights;
 
 namespace {
 
-// Suffix for a flame graph file name.
-const wchar_t kFlameGraphFileNameSuffix[] = L".flamegraph.txt";
+// Suffix for a flame graph file name, followed by the output format.
+const wchar_t kFlameGraphFileNameSuffix[] = L".flamegraph.";
+
+// Suffix for a differential flame graph file name, followed by the output
+// format.
+const wchar_t kDiffFlameGraphFileNameSuffix[] = L".diff_flamegraph.";
+
+// Suffix for a sliced flame graph file name.
+const wchar_t kSlicedFlameGraphFileNameSuffix[] = L".sliced_flamegraph.json";
+
+// Output formats.
+const wchar_t kTxtFormat[] = L"txt";
+const wchar_t kSvgFormat[] = L"svg";
+const wchar_t kHtmlFormat[] = L"html";
+
+// Normalizations of a baseline.
+const wchar_t kTotalNormalization[] = L"total";
+const wchar_t kNoNormalization[] = L"none";
+
+// Filters of the threads added to a flame graph.
+struct ThreadFilter {
+  // Id of the only thread added, or base::kInvalidTid.
+  uint64_t thread_id;
+
+  // Name of the only process whose threads are added, or empty.
+  std::string process_name;
+};
 
 void ShowUsage() {
   std::cout
@@ -45,17 +77,145 @@ void ShowUsage() {
       << "  --process_name: Only include stacks from processes with the "
          "specified name."
       << std::endl
-      << "  --tid: Only include stacks from the specified thread." << std::endl
+      << "  --tid: Only include stacks from the specified thread. Can't be "
+         "combined with a --baseline trace other than the trace."
+      << std::endl
       << "  --start_ts: Only include stacks that occurred after the specified "
          "timestamp (in microseconds)."
       << std::endl
       << "  --end_ts: Only include stacks that occurred before the specified "
          "timestamp (in microseconds)."
       << std::endl
-      << "  --out: Output file path. Default: <trace_file_path>.flamegraph.txt"
+      << "  --format: Output format: txt (collapsed stacks), svg or html. "
+         "Default: txt."
+      << std::endl
+      << "  --out: Output file path. Default: "
+         "<trace_file_path>.flamegraph.<format>"
+      << std::endl
+      << "  --width: Width of the svg or html flame graph, in pixels. "
+         "Default: 1200."
+      << std::endl
+      << "  --min_width: Frames narrower than this number of pixels are "
+         "omitted from the svg or html flame graph. Default: 0.1."
+      << std::endl
+      << "  --threads: Number of threads used to parse the trace. Default: "
+         "number of processors."
+      << std::endl
+      << "  --baseline: Trace to which the trace is compared, in a "
+         "differential flame graph."
+      << std::endl
+      << "  --baseline_window: Window of the baseline trace "
+         "(<start_ts>:<end_ts>, in microseconds) to which the trace is "
+         "compared, in a differential flame graph. Default: whole trace."
+      << std::endl
+      << "  --normalize: Normalization of the baseline: total (scaled to the "
+         "total time of the trace) or none. Default: total."
+      << std::endl
+      << "  --slice_ms: Write the call stacks of each slice of this number of "
+         "milliseconds in a JSON file, instead of a single flame graph."
+      << std::endl
+      << "  --save_snapshot: Read the whole trace and save the snapshot of its "
+         "history even when --start_ts or --end_ts is specified, so that the "
+         "next analyses of the trace, with any window, start from it."
       << std::endl;
 }
 
+// Parses a window of time.
+// @param str a window of time: "<start_ts>:<end_ts>". Either timestamp can be
+//     omitted.
+// @param start_ts the beginning of the window, output. 0 if omitted.
+// @param end_ts the end of the window, output. base::kInvalidTimestamp if
+//     omitted.
+// @returns true if the window was parsed successfully, false otherwise.
+bool ParseWindow(const std::wstring& str,
+                 uint64_t* start_ts,
+                 uint64_t* end_ts) {
+  size_t separator = str.find(L':');
+  if (separator == std::wstring::npos)
+    return false;
+
+  std::wstring start_str = str.substr(0, separator);
+  std::wstring end_str = str.substr(separator + 1);
+  *start_ts = 0;
+  *end_ts = base::kInvalidTimestamp;
+  if (!start_str.empty() && !base::StrToULong(start_str, start_ts))
+    return false;
+  if (!end_str.empty() && !base::StrToULong(end_str, end_ts))
+    return false;
+  return *start_ts < *end_ts;
+}
+
+// Generates the system history of a trace.
+// @param trace_path path to the trace.
+// @param start_ts beginning of the analyzed window.
+// @param end_ts end of the analyzed window.
+// @param num_threads number of threads used to parse the trace.
+// @param save_snapshot whether the whole trace is read, so that the snapshot
+//     of its history is saved, even if a window is specified.
+// @param system_history the system history, output.
+// @returns true if the history was generated successfully, false otherwise.
+bool GenerateHistory(const std::wstring& trace_path,
+                     base::Timestamp start_ts,
+                     base::Timestamp end_ts,
+                     size_t num_threads,
+                     bool save_snapshot,
+                     SystemHistory* system_history) {
+  // Only read the call stacks of the analyzed window from the trace. The
+  // snapshot of the history is only saved when the whole trace is read.
+  Subscription subscription;
+  if (!save_snapshot && (start_ts != 0 || end_ts != base::kInvalidTimestamp))
+    subscription = GetHistorySubscription(start_ts, end_ts);
+
+  if (!GenerateHistoryFromTrace(trace_path, num_threads, subscription,
+                                system_history)) {
+    LOG(ERROR) << "Error while generating history from trace "
+               << base::WStringToString(trace_path) << ".";
+    return false;
+  }
+  return true;
+}
+
+// Adds the threads of a system history that match a filter to a flame graph.
+// @param system_history the system history.
+// @param filter the filter of the threads.
+// @param start_ts beginning of the analyzed window.
+// @param end_ts end of the analyzed window.
+// @param flame_graph the flame graph: a FlameGraph or a SlicedFlameGraph.
+template <typename Graph>
+void AddThreads(const SystemHistory& system_history,
+                const ThreadFilter& filter,
+                base::Timestamp start_ts,
+                base::Timestamp end_ts,
+                Graph* flame_graph) {
+  // Determine the end time of the analysis.
+  base::Timestamp analysis_end_ts =
+      std::min(std::min(end_ts, system_history.last_event_ts()),
+               system_history.first_non_empty_paint_ts());
+
+  // Traverse all threads and add those that match the filter to the history.
+  for (auto threads_it = system_history.threads_begin();
+       threads_it != system_history.threads_end(); ++threads_it) {
+    // Thread id filter.
+    if (filter.thread_id != base::kInvalidTid &&
+        filter.thread_id != threads_it->first)
+      continue;
+
+    // Process name filter.
+    if (!filter.process_name.empty()) {
+      std::string process_name =
+          system_history.GetProcessName(threads_it->second.parent_process_id());
+      if (filter.process_name != process_name)
+        continue;
+    }
+
+    // The current thread matches the filter. Add it to the flame graph.
+    flame_graph->AddThreadHistory(
+        threads_it->second,
+        std::max(start_ts, system_history.first_event_ts()),
+        analysis_end_ts);
+  }
+}
+
 }  // namespace
 
 int wmain(int argc, wchar_t* argv[], wchar_t* /*envp */ []) {
@@ -75,17 +235,18 @@ int wmain(int argc, wchar_t* argv[], wchar_t* /*envp */ []) {
     return 1;
   }
 
+  ThreadFilter filter;
   std::wstring thread_id_filter_str = command_line.GetSwitchValue(L"tid");
-  uint64_t thread_id_filter = base::kInvalidTid;
+  filter.thread_id = base::kInvalidTid;
   if (!thread_id_filter_str.empty() &&
-      !base::StrToULong(thread_id_filter_str, &thread_id_filter)) {
+      !base::StrToULong(thread_id_filter_str, &filter.thread_id)) {
     std::cout << "Thread id must be numeric (--tid)." << std::endl << std::endl;
     ShowUsage();
     return 1;
   }
 
-  std::string process_name_filter(
-      base::WStringToString(command_line.GetSwitchValue(L"process_name")));
+  filter.process_name =
+      base::WStringToString(command_line.GetSwitchValue(L"process_name"));
 
   uint64_t start_ts = 0;
   base::StrToULong(command_line.GetSwitchValue(L"start_ts"), &start_ts);
@@ -95,51 +256,226 @@ int wmain(int argc, wchar_t* argv[], wchar_t* /*envp */ []) {
 
   std::wstring output_path(command_line.GetSwitchValue(L"out"));
 
-  // Generate a system history from the trace.
-  SystemHistory system_history;
-  if (!GenerateHistoryFromTrace(trace_path, &system_history)) {
-    LOG(ERROR) << "Error while generating history from trace.";
+  std::wstring format = command_line.GetSwitchValue(L"format");
+  const bool has_format = !format.empty();
+  if (format.empty())
+    format = kTxtFormat;
+  if (format != kTxtFormat && format != kSvgFormat && format != kHtmlFormat) {
+    std::cout << "Output format must be txt, svg or html (--format)."
+              << std::endl
+              << std::endl;
+    ShowUsage();
     return 1;
   }
 
-  // Determine the end time of the analysis.
-  base::Timestamp analysis_end_ts =
-      std::min(std::min(end_ts, system_history.last_event_ts()),
-               system_history.first_non_empty_paint_ts());
+  SvgRendererOptions svg_options;
+  svg_options.title =
+      "Flame Graph: " + base::WStringToString(base::BaseName(trace_path));
 
-  // Tell the user what we are doing.
-  LOG(INFO) << "Generating flame graph." << std::endl;
+  std::wstring width_str = command_line.GetSwitchValue(L"width");
+  uint64_t width = svg_options.width;
+  if (!width_str.empty() &&
+      (!base::StrToULong(width_str, &width) || width == 0)) {
+    std::cout << "Width must be a positive number (--width)." << std::endl
+              << std::endl;
+    ShowUsage();
+    return 1;
+  }
+  svg_options.width = static_cast<size_t>(width);
 
-  // Create a flame graph.
-  FlameGraph flame_graph;
+  std::wstring min_width_str = command_line.GetSwitchValue(L"min_width");
+  if (!min_width_str.empty()) {
+    wchar_t* min_width_end = nullptr;
+    svg_options.min_frame_width = wcstod(min_width_str.c_str(), &min_width_end);
+    if (*min_width_end != L'\0' || !(svg_options.min_frame_width >= 0)) {
+      std::cout << "Minimum width must be a non-negative number (--min_width)."
+                << std::endl
+                << std::endl;
+      ShowUsage();
+      return 1;
+    }
+  }
 
-  // Traverse all threads and add those that match the filter to the history.
-  for (auto threads_it = system_history.threads_begin();
-       threads_it != system_history.threads_end(); ++threads_it) {
-    // Thread id filter.
-    if (thread_id_filter != base::kInvalidTid &&
-        thread_id_filter != threads_it->first)
-      continue;
+  std::wstring num_threads_str = command_line.GetSwitchValue(L"threads");
+  uint64_t num_threads = base::ThreadPool::DefaultNumThreads();
+  if (!num_threads_str.empty() &&
+      (!base::StrToULong(num_threads_str, &num_threads) || num_threads == 0)) {
+    std::cout << "Number of threads must be a positive number (--threads)."
+              << std::endl
+              << std::endl;
+    ShowUsage();
+    return 1;
+  }
 
-    // Process name filter.
-    if (!process_name_filter.empty()) {
-      std::string process_name =
-          system_history.GetProcessName(threads_it->second.parent_process_id());
-      if (process_name_filter != process_name)
-        continue;
+  // The baseline of a differential flame graph is another trace, or another
+  // window of the same trace.
+  std::wstring baseline_path = command_line.GetSwitchValue(L"baseline");
+  std::wstring baseline_window_str =
+      command_line.GetSwitchValue(L"baseline_window");
+  const bool is_diff = !baseline_path.empty() || !baseline_window_str.empty();
+  if (baseline_path.empty())
+    baseline_path = trace_path;
+
+  // Thread ids aren't the same in different traces.
+  if (filter.thread_id != base::kInvalidTid && baseline_path != trace_path) {
+    std::cout << "--tid can't be combined with a --baseline trace other than "
+                 "the trace."
+              << std::endl
+              << std::endl;
+    ShowUsage();
+    return 1;
+  }
+
+  uint64_t baseline_start_ts = 0;
+  uint64_t baseline_end_ts = base::kInvalidTimestamp;
+  if (!baseline_window_str.empty() &&
+      !ParseWindow(baseline_window_str, &baseline_start_ts,
+                   &baseline_end_ts)) {
+    std::cout << "Baseline window must be <start_ts>:<end_ts> "
+                 "(--baseline_window)."
+              << std::endl
+              << std::endl;
+    ShowUsage();
+    return 1;
+  }
+
+  std::wstring normalization = command_line.GetSwitchValue(L"normalize");
+  if (normalization.empty())
+    normalization = kTotalNormalization;
+  if (normalization != kTotalNormalization &&
+      normalization != kNoNormalization) {
+    std::cout << "Normalization must be total or none (--normalize)."
+              << std::endl
+              << std::endl;
+    ShowUsage();
+    return 1;
+  }
+
+  std::wstring slice_ms_str = command_line.GetSwitchValue(L"slice_ms");
+  uint64_t slice_ms = 0;
+  if (!slice_ms_str.empty() &&
+      (!base::StrToULong(slice_ms_str, &slice_ms) || slice_ms == 0)) {
+    std::cout << "Slice duration must be a positive number (--slice_ms)."
+              << std::endl
+              << std::endl;
+    ShowUsage();
+    return 1;
+  }
+  if (slice_ms != 0 && (is_diff || has_format)) {
+    std::cout << "--slice_ms can't be combined with --baseline, "
+                 "--baseline_window or --format."
+              << std::endl
+              << std::endl;
+    ShowUsage();
+    return 1;
+  }
+
+  const bool save_snapshot = command_line.HasSwitch(L"save_snapshot");
+
+  if (is_diff) {
+    svg_options.title += " vs. " +
+                         base::WStringToString(base::BaseName(baseline_path));
+    if (!baseline_window_str.empty())
+      svg_options.title += " [" + base::WStringToString(baseline_window_str) +
+                           "]";
+  }
+
+  // Generate a system history from the trace. When the baseline is another
+  // trace, its history is generated at the same time on another thread. When
+  // it is another window of the same trace, the history covers both windows.
+  std::unique_ptr<base::ThreadPool> pool;
+  if (is_diff)
+    pool.reset(new base::ThreadPool(1));
+  SystemHistory system_history;
+  SystemHistory other_system_history;
+  SystemHistory* baseline_system_history = &system_history;
+  if (is_diff && baseline_path != trace_path) {
+    baseline_system_history = &other_system_history;
+    std::future<bool> baseline_generated = pool->Post([&]() {
+      return GenerateHistory(baseline_path, baseline_start_ts,
+                             baseline_end_ts, static_cast<size_t>(num_threads),
+                             save_snapshot, &other_system_history);
+    });
+    bool generated = GenerateHistory(trace_path, start_ts, end_ts,
+                                     static_cast<size_t>(num_threads),
+                                     save_snapshot, &system_history);
+    if (!baseline_generated.get() || !generated)
+      return 1;
+  } else {
+    uint64_t history_start_ts = start_ts;
+    uint64_t history_end_ts = end_ts;
+    if (is_diff) {
+      history_start_ts = std::min(start_ts, baseline_start_ts);
+      history_end_ts = std::max(end_ts, baseline_end_ts);
     }
+    if (!GenerateHistory(trace_path, history_start_ts, history_end_ts,
+                         static_cast<size_t>(num_threads), save_snapshot,
+                         &system_history)) {
+      return 1;
+    }
+  }
 
-    // The current thread matches the filter. Add it to the flame graph.
-    flame_graph.AddThreadHistory(
-        threads_it->second,
+  // Tell the user what we are doing.
+  LOG(INFO) << "Generating flame graph." << std::endl;
+
+  // Write the call stacks of each slice of the analyzed window, from a single
+  // scan of the history of each thread.
+  if (slice_ms != 0) {
+    const base::Timestamp kMicrosecondsPerMillisecond = 1000;
+    SlicedFlameGraph sliced_flame_graph(
+        system_history.stack_trie(),
         std::max(start_ts, system_history.first_event_ts()),
-        analysis_end_ts);
+        slice_ms * kMicrosecondsPerMillisecond);
+    AddThreads(system_history, filter, start_ts, end_ts, &sliced_flame_graph);
+
+    if (output_path.empty())
+      output_path = trace_path + kSlicedFlameGraphFileNameSuffix;
+    sliced_flame_graph.WriteReport(output_path);
+
+    LOG(INFO) << "Wrote sliced flame graph data in file "
+              << base::WStringToString(output_path);
+    return 0;
   }
 
-  // Write the flame graph in a text file.
-  if (output_path.empty())
-    output_path = trace_path + kFlameGraphFileNameSuffix;
-  flame_graph.WriteTxtReport(output_path);
+  // Create a flame graph. The flame graph of the baseline is created at the
+  // same time on another thread.
+  FlameGraph flame_graph(system_history.stack_trie());
+  FlameGraph baseline_flame_graph(baseline_system_history->stack_trie());
+  std::future<void> baseline_added;
+  if (is_diff) {
+    baseline_added = pool->Post([&]() {
+      AddThreads(*baseline_system_history, filter, baseline_start_ts,
+                 baseline_end_ts, &baseline_flame_graph);
+    });
+  }
+  AddThreads(system_history, filter, start_ts, end_ts, &flame_graph);
+  if (is_diff)
+    baseline_added.get();
+
+  // Write the flame graph in the requested format.
+  if (output_path.empty()) {
+    output_path =
+        trace_path +
+        (is_diff ? kDiffFlameGraphFileNameSuffix : kFlameGraphFileNameSuffix) +
+        format;
+  }
+  if (is_diff) {
+    DiffFlameGraph diff_flame_graph(&baseline_flame_graph, &flame_graph,
+                                    normalization == kTotalNormalization);
+    if (format == kSvgFormat)
+      diff_flame_graph.WriteSvgReport(output_path, svg_options);
+    else if (format == kHtmlFormat)
+      diff_flame_graph.WriteHtmlReport(output_path, svg_options);
+    else
+      diff_flame_graph.WriteTxtReport(output_path);
+  } else {
+    if (format == kSvgFormat)
+      flame_graph.WriteSvgReport(output_path, svg_options);
+    else if (format == kHtmlFormat)
+      flame_graph.WriteHtmlReport(output_path, svg_options);
+    else
+      flame_graph.WriteTxtReport(output_path);
+  }
 
   // Tell the user that the flame graph was generated.
   LOG(INFO) << "Wrote flame graph data in file "
@@ -0,0 +1,215 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "flame_graph/sliced_flame_graph.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string_view>
+
+#include "base/logging.h"
+#include "etw_reader/frame_table.h"
+#include "flame_graph/call_tree.h"
+#include "flame_graph/clean_stack.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Number of entries a slice can have beyond twice its size after its last
+// compaction before it is compacted again.
+const size_t kMinCompactionThreshold = 1024;
+
+// Marks a stack that is ignored.
+const CallTree::NodeId kIgnoredNodeId = static_cast<CallTree::NodeId>(-1);
+
+// Writes a string in a JSON document, between quotes and with special
+// characters escaped.
+void WriteJsonString(std::string_view str, std::ostream* out) {
+  const char kHexDigits[] = "0123456789abcdef";
+  *out << '"';
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      *out << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      *out << "\\u00" << kHexDigits[(c >> 4) & 0xF] << kHexDigits[c & 0xF];
+    } else {
+      *out << c;
+    }
+  }
+  *out << '"';
+}
+
+}  // namespace
+
+SlicedFlameGraph::SlicedFlameGraph(const StackTrie& stack_trie,
+                                   base::Timestamp start_ts,
+                                   base::Timestamp slice_duration)
+    : stack_trie_(stack_trie),
+      start_ts_(start_ts),
+      slice_duration_(slice_duration),
+      end_ts_(start_ts) {
+  DCHECK_GT(slice_duration, 0U);
+}
+
+SlicedFlameGraph::~SlicedFlameGraph() {}
+
+void SlicedFlameGraph::AddThreadHistory(const ThreadHistory& thread_history,
+                                        base::Timestamp start_ts,
+                                        base::Timestamp end_ts) {
+  if (start_ts < start_ts_)
+    start_ts = start_ts_;
+  if (end_ts <= start_ts)
+    return;
+  if (end_ts > end_ts_)
+    end_ts_ = end_ts;
+
+  // Windows of the slices that overlap [start_ts, end_ts).
+  const size_t first_slice =
+      static_cast<size_t>((start_ts - start_ts_) / slice_duration_);
+  const size_t last_slice =
+      static_cast<size_t>((end_ts - 1 - start_ts_) / slice_duration_);
+  if (last_slice >= slices_.size())
+    slices_.resize(last_slice + 1);
+
+  windows_.clear();
+  for (size_t slice_index = first_slice; slice_index <= last_slice;
+       ++slice_index) {
+    base::Timestamp slice_start_ts = start_ts_ + slice_index * slice_duration_;
+    base::Timestamp slice_end_ts = slice_start_ts + slice_duration_;
+    windows_.push_back({slice_start_ts < start_ts ? start_ts : slice_start_ts,
+                        slice_end_ts > end_ts ? end_ts : slice_end_ts});
+  }
+
+  has_time_.resize(stack_trie_.size(), false);
+  thread_history.Stacks().Aggregate(
+      windows_, thread_history.end_ts(),
+      [this, first_slice](size_t window_index, StackId stack_id,
+                          base::Timestamp duration) {
+        if (duration == 0)
+          return;
+        has_time_[stack_id] = true;
+        AddTime(first_slice + window_index, stack_id, duration);
+      });
+}
+
+void SlicedFlameGraph::WriteReport(const std::wstring& path) {
+  // Map the stacks in which time was spent to the nodes of a call tree of
+  // cleaned stacks, shared by all the slices. The stacks are visited in the
+  // order of their frames, so that the report doesn't depend on the order in
+  // which the stacks were found.
+  StackCleaner stack_cleaner(stack_trie_.frames());
+  CallTree cleaned_tree;
+  std::vector<CallTree::NodeId> cleaned_nodes(stack_trie_.size(),
+                                              kIgnoredNodeId);
+  VisitStacksInOrder(
+      stack_trie_, has_time_, &stack_cleaner,
+      [&cleaned_tree, &cleaned_nodes](
+          StackId stack_id, const std::vector<std::string_view>& stack) {
+        CallTree::NodeId cleaned_node_id = CallTree::kRootNodeId;
+        for (const auto& symbol : stack)
+          cleaned_node_id = cleaned_tree.GetChild(cleaned_node_id, symbol);
+        cleaned_nodes[stack_id] = cleaned_node_id;
+      });
+
+  std::ofstream out(path, std::ios::binary);
+  base::Timestamp end_ts = start_ts_ + slices_.size() * slice_duration_;
+  if (end_ts > end_ts_)
+    end_ts = end_ts_;
+  out << "{\"start_ts\":" << start_ts_ << ",\"end_ts\":" << end_ts
+      << ",\"slice_duration\":" << slice_duration_ << ",\n\"frames\":[";
+  const FrameTable& cleaned_frames = cleaned_tree.frames();
+  for (size_t frame_id = 0; frame_id < cleaned_frames.size(); ++frame_id) {
+    if (frame_id != 0)
+      out << ",\n";
+    WriteJsonString(cleaned_frames.GetFrame(static_cast<FrameId>(frame_id)),
+                    &out);
+  }
+
+  out << "],\n\"nodes\":[";
+  for (size_t node_id = 1; node_id < cleaned_tree.size(); ++node_id) {
+    if (node_id != 1)
+      out << ",";
+    out << cleaned_tree.frame(static_cast<CallTree::NodeId>(node_id)) << ","
+        << cleaned_tree.parent(static_cast<CallTree::NodeId>(node_id));
+  }
+
+  out << "],\n\"slices\":[";
+  // Entries of a slice, with the stacks of |cleaned_tree|.
+  std::vector<SliceEntry> cleaned_entries;
+  for (size_t slice_index = 0; slice_index < slices_.size(); ++slice_index) {
+    cleaned_entries.clear();
+    for (const SliceEntry& entry : slices_[slice_index].entries) {
+      CallTree::NodeId cleaned_node_id = cleaned_nodes[entry.stack_id];
+      if (cleaned_node_id != kIgnoredNodeId)
+        cleaned_entries.push_back({cleaned_node_id, entry.duration});
+    }
+    CompactEntries(&cleaned_entries);
+
+    if (slice_index != 0)
+      out << ",\n";
+    out << "[";
+    bool first = true;
+    for (const SliceEntry& entry : cleaned_entries) {
+      if (!first)
+        out << ",";
+      first = false;
+      out << entry.stack_id << "," << entry.duration;
+    }
+    out << "]";
+  }
+  out << "]}\n";
+
+  if (!out.good())
+    LOG(ERROR) << "Error while writing the sliced flame graph.";
+}
+
+void SlicedFlameGraph::AddTime(size_t slice_index,
+                               StackId stack_id,
+                               base::Timestamp duration) {
+  DCHECK_LT(slice_index, slices_.size());
+  Slice& slice = slices_[slice_index];
+  if (!slice.entries.empty() && slice.entries.back().stack_id == stack_id) {
+    slice.entries.back().duration += duration;
+    return;
+  }
+
+  slice.entries.push_back({stack_id, duration});
+  if (slice.entries.size() >=
+      2 * slice.compacted_size + kMinCompactionThreshold) {
+    CompactEntries(&slice.entries);
+    slice.compacted_size = slice.entries.size();
+  }
+}
+
+void SlicedFlameGraph::CompactEntries(std::vector<SliceEntry>* entries) {
+  DCHECK(entries != nullptr);
+  std::sort(entries->begin(), entries->end(),
+            [](const SliceEntry& a, const SliceEntry& b) {
+              return a.stack_id < b.stack_id;
+            });
+
+  size_t size = 0;
+  for (const SliceEntry& entry : *entries) {
+    if (size != 0 && (*entries)[size - 1].stack_id == entry.stack_id)
+      (*entries)[size - 1].duration += entry.duration;
+    else
+      (*entries)[size++] = entry;
+  }
+  entries->resize(size);
+}
+
+}  // namespace etw_insights
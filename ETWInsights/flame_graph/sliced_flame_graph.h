@@ -0,0 +1,114 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "base/base.h"
+#include "base/history.h"
+#include "base/types.h"
+#include "etw_reader/stack_trie.h"
+#include "etw_reader/thread_history.h"
+
+namespace etw_insights {
+
+// Aggregates the time spent in each call stack of threads in consecutive
+// slices of time, to show how the call stacks evolve over the analyzed
+// window. All the slices share the stacks of the stack trie of the threads,
+// and a slice only stores the time of the stacks in which time was spent
+// during it, so memory is proportional to the number of distinct call stacks
+// plus the number of (slice, call stack) pairs with time.
+class SlicedFlameGraph {
+ public:
+  // @param stack_trie the call stacks referenced by the thread histories
+  //     added to the flame graph.
+  // @param start_ts beginning of the first slice.
+  // @param slice_duration duration of a slice. Must be greater than 0.
+  SlicedFlameGraph(const StackTrie& stack_trie,
+                   base::Timestamp start_ts,
+                   base::Timestamp slice_duration);
+  ~SlicedFlameGraph();
+
+  // Adds the time spent by a thread in each call stack to the slices that
+  // overlap a window, in a single scan of the history of the thread.
+  void AddThreadHistory(const ThreadHistory& thread_history,
+                        base::Timestamp start_ts,
+                        base::Timestamp end_ts);
+
+  // Writes the slices in a JSON file. Frames are cleaned like in the report
+  // of FlameGraph, and are stored once in a table shared by all the slices:
+  //   {"start_ts": <beginning of the first slice>,
+  //    "end_ts": <end of the last slice>,
+  //    "slice_duration": <duration of a slice>,
+  //    "frames": [<frame>, ...],
+  //    "nodes": [<frame index>, <parent node index>, ...],
+  //    "slices": [[<node index>, <self time>, ...], ...]}
+  // Node i + 1 is described by elements 2 * i and 2 * i + 1 of "nodes", and
+  // node 0 is the root of the call tree: the empty stack. Times are in
+  // microseconds.
+  void WriteReport(const std::wstring& path);
+
+ private:
+  // Time spent in a call stack during a slice.
+  struct SliceEntry {
+    StackId stack_id;
+    base::Timestamp duration;
+  };
+
+  // Times spent in call stacks during a slice.
+  struct Slice {
+    Slice() : compacted_size(0) {}
+
+    // A stack can have several entries, until the slice is compacted.
+    std::vector<SliceEntry> entries;
+
+    // Number of entries after the last compaction.
+    size_t compacted_size;
+  };
+
+  // Adds time spent in a call stack during a slice.
+  void AddTime(size_t slice_index, StackId stack_id, base::Timestamp duration);
+
+  // Merges the entries of a slice that have the same stack, and sorts them by
+  // stack.
+  static void CompactEntries(std::vector<SliceEntry>* entries);
+
+  // Call stacks referenced by the thread histories.
+  const StackTrie& stack_trie_;
+
+  // Whether time was spent in each stack of |stack_trie_|, in any slice,
+  // indexed by stack id.
+  std::vector<bool> has_time_;
+
+  // Beginning of the first slice, duration of a slice, and end of the last
+  // window added.
+  base::Timestamp start_ts_;
+  base::Timestamp slice_duration_;
+  base::Timestamp end_ts_;
+
+  // Slices, in chronological order.
+  std::vector<Slice> slices_;
+
+  // Windows of the slices passed to the history of a thread. Kept to avoid
+  // reallocations.
+  std::vector<base::TimeWindow> windows_;
+
+  DISALLOW_COPY_AND_ASSIGN(SlicedFlameGraph);
+};
+
+}  // namespace etw_insights
@@ -0,0 +1,422 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "flame_graph/svg_renderer.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <iomanip>
+#include <string_view>
+#include <vector>
+
+#include "base/logging.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Height of a frame, in pixels.
+const double kFrameHeight = 16.0;
+
+// Size of the font of the labels of the frames, in pixels.
+const double kFontSize = 12.0;
+
+// Average width of a character, relative to the size of the font.
+const double kFontWidth = 0.59;
+
+// Space between the frames and the left and right edges of the image.
+const double kHorizontalPadding = 10.0;
+
+// Space above the frames, for the title, and below the frames.
+const double kTopPadding = 40.0;
+const double kBottomPadding = 10.0;
+
+// Space between the left edge of a frame and its label.
+const double kLabelPadding = 3.0;
+
+// Minimum number of characters of a label. Narrower frames have no label.
+const size_t kMinLabelSize = 3;
+
+// Name of the root of the call tree.
+const char kRootName[] = "all";
+
+// Script of the HTML page. Shows the frame under the mouse in #details and
+// zooms on a frame when it is clicked: the frame and the frames above it are
+// stretched to the width of the image, the frames below it take the whole
+// width and the others are hidden. Clicking the bottom frame resets the zoom.
+const char kHtmlScript[] =
+    "(function() {\n"
+    "  var svg = document.querySelector('svg');\n"
+    "  var details = document.getElementById('details');\n"
+    "  var width = +svg.getAttribute('width');\n"
+    "  var padding = +svg.getAttribute('data-padding');\n"
+    "  var labelPadding = +svg.getAttribute('data-label-padding');\n"
+    "  var charWidth = +svg.getAttribute('data-char-width');\n"
+    "  var minLabelSize = +svg.getAttribute('data-min-label-size');\n"
+    "  var frames = Array.prototype.slice.call(\n"
+    "      svg.querySelectorAll('g.frame'));\n"
+    "  function label(name, w) {\n"
+    "    var size = Math.floor((w - 2 * labelPadding) / charWidth);\n"
+    "    if (size < minLabelSize) return '';\n"
+    "    if (name.length <= size) return name;\n"
+    "    var end = size - 2;\n"
+    "    var last = name.charCodeAt(end - 1);\n"
+    "    if (last >= 0xd800 && last <= 0xdbff) --end;\n"
+    "    return name.substring(0, end) + '..';\n"
+    "  }\n"
+    "  function zoom(target) {\n"
+    "    var scale = (width - 2 * padding) / target.w;\n"
+    "    var epsilon = 0.0001;\n"
+    "    frames.forEach(function(g) {\n"
+    "      var x, w;\n"
+    "      if (g.y > target.y) {\n"
+    "        if (g.x > target.x + epsilon ||\n"
+    "            g.x + g.w < target.x + target.w - epsilon) {\n"
+    "          g.style.display = 'none';\n"
+    "          return;\n"
+    "        }\n"
+    "        x = padding;\n"
+    "        w = width - 2 * padding;\n"
+    "      } else {\n"
+    "        if (g.x < target.x - epsilon ||\n"
+    "            g.x + g.w > target.x + target.w + epsilon) {\n"
+    "          g.style.display = 'none';\n"
+    "          return;\n"
+    "        }\n"
+    "        x = padding + (g.x - target.x) * scale;\n"
+    "        w = g.w * scale;\n"
+    "      }\n"
+    "      g.style.display = '';\n"
+    "      g.rect.setAttribute('x', x.toFixed(2));\n"
+    "      g.rect.setAttribute('width', w.toFixed(2));\n"
+    "      g.text.setAttribute('x', (x + labelPadding).toFixed(2));\n"
+    "      g.text.textContent = label(g.name, w);\n"
+    "    });\n"
+    "  }\n"
+    "  frames.forEach(function(g) {\n"
+    "    var title = g.querySelector('title').textContent;\n"
+    "    g.rect = g.querySelector('rect');\n"
+    "    g.text = g.querySelector('text');\n"
+    "    g.x = +g.rect.getAttribute('x');\n"
+    "    g.w = +g.rect.getAttribute('width');\n"
+    "    g.y = +g.rect.getAttribute('y');\n"
+    "    g.name = title.substring(0, title.lastIndexOf(' ('));\n"
+    "    g.onmouseover = function() { details.textContent = title; };\n"
+    "    g.onmouseout = function() { details.textContent = '\\u00a0'; };\n"
+    "    g.onclick = function() { zoom(g); };\n"
+    "  });\n"
+    "})();\n";
+
+// A frame drawn in the image.
+struct DrawnFrame {
+  CallTree::NodeId node_id;
+
+  // Number of frames below the frame. The root has depth 0.
+  size_t depth;
+
+  // Position and width of the frame, in pixels.
+  double x;
+  double width;
+};
+
+// @returns the name of the frame of a node.
+std::string_view GetNodeName(const CallTree& tree,
+                             const FrameTable& frames,
+                             CallTree::NodeId node_id) {
+  if (node_id == CallTree::kRootNodeId)
+    return kRootName;
+  return frames.GetFrame(tree.frame(node_id));
+}
+
+// Computes the position of the frames drawn in the image. Nodes narrower
+// than the minimum width of a frame, and the nodes above them, are pruned.
+// @param tree the call tree.
+// @param frames the frames of the call tree.
+// @param options rendering options.
+// @param drawn_frames the frames to draw, output.
+// @returns the depth of the deepest frame to draw.
+size_t LayoutFrames(const CallTree& tree,
+                    const FrameTable& frames,
+                    const SvgRendererOptions& options,
+                    std::vector<DrawnFrame>* drawn_frames) {
+  const double frames_width =
+      static_cast<double>(options.width) - 2 * kHorizontalPadding;
+  const base::Timestamp total_time = tree.inclusive_time(CallTree::kRootNodeId);
+  const double scale =
+      total_time == 0 ? 0.0 : frames_width / static_cast<double>(total_time);
+
+  size_t max_depth = 0;
+  std::vector<DrawnFrame> to_visit;
+  std::vector<CallTree::NodeId> children;
+  to_visit.push_back(
+      {CallTree::kRootNodeId, 0, kHorizontalPadding, frames_width});
+  while (!to_visit.empty()) {
+    DrawnFrame frame = to_visit.back();
+    to_visit.pop_back();
+    drawn_frames->push_back(frame);
+    if (frame.depth > max_depth)
+      max_depth = frame.depth;
+
+    children.assign(tree.children_begin(frame.node_id),
+                    tree.children_end(frame.node_id));
+    std::sort(children.begin(), children.end(),
+              [&tree, &frames](CallTree::NodeId a, CallTree::NodeId b) {
+                return frames.GetFrame(tree.frame(a)) <
+                       frames.GetFrame(tree.frame(b));
+              });
+
+    double x = frame.x;
+    for (CallTree::NodeId child : children) {
+      double width = static_cast<double>(tree.inclusive_time(child)) * scale;
+      if (width >= options.min_frame_width && width > 0)
+        to_visit.push_back({child, frame.depth + 1, x, width});
+      x += width;
+    }
+  }
+
+  return max_depth;
+}
+
+// Writes a string in an XML document, with special characters escaped.
+void WriteEscaped(std::string_view str, std::ostream* out) {
+  for (char c : str) {
+    switch (c) {
+      case '&':
+        *out << "&amp;";
+        break;
+      case '<':
+        *out << "&lt;";
+        break;
+      case '>':
+        *out << "&gt;";
+        break;
+      case '"':
+        *out << "&quot;";
+        break;
+      default:
+        *out << c;
+        break;
+    }
+  }
+}
+
+// Writes the color of a frame: a color of the "hot" palette of flamegraph.pl
+// derived from a hash of its name, so that a frame always has the same color.
+void WriteFrameColor(std::string_view name, std::ostream* out) {
+  // FNV-1a hash.
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  for (char c : name) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001B3ULL;
+  }
+  const uint64_t red = 205 + (hash & 0xFF) * 50 / 0xFF;
+  const uint64_t green = ((hash >> 8) & 0xFF) * 230 / 0xFF;
+  const uint64_t blue = ((hash >> 16) & 0xFF) * 55 / 0xFF;
+  *out << "rgb(" << red << "," << green << "," << blue << ")";
+}
+
+// Writes the color of a frame of a differential flame graph: red if more time
+// is spent in it than in the baseline, blue if less time is spent in it, and
+// more saturated as the difference gets closer to |max_delta|.
+void WriteDiffFrameColor(int64_t delta, uint64_t max_delta, std::ostream* out) {
+  if (delta == 0 || max_delta == 0) {
+    *out << "rgb(240,240,240)";
+    return;
+  }
+  const uint64_t abs_delta =
+      static_cast<uint64_t>(delta < 0 ? -delta : delta);
+  const uint64_t other = 210 - abs_delta * 210 / max_delta;
+  if (delta > 0)
+    *out << "rgb(255," << other << "," << other << ")";
+  else
+    *out << "rgb(" << other << "," << other << ",255)";
+}
+
+// Writes the label of a frame: as much of its name as fits in its width. A
+// truncated name isn't cut in the middle of a UTF-8 character.
+void WriteLabel(std::string_view name, double width, std::ostream* out) {
+  const double max_size =
+      (width - 2 * kLabelPadding) / (kFontSize * kFontWidth);
+  if (max_size < kMinLabelSize)
+    return;
+  const size_t size = static_cast<size_t>(max_size);
+  if (name.size() <= size) {
+    WriteEscaped(name, out);
+  } else {
+    // Back up over the continuation bytes (10xxxxxx) of the character at the
+    // truncation point.
+    size_t end = size - 2;
+    while (end > 0 && (static_cast<unsigned char>(name[end]) & 0xC0) == 0x80)
+      --end;
+    WriteEscaped(name.substr(0, end), out);
+    *out << "..";
+  }
+}
+
+// @returns the difference between the inclusive time of a node and its
+//     inclusive time in a baseline.
+int64_t GetDelta(const CallTree& tree,
+                 const std::vector<base::Timestamp>& baseline_times,
+                 CallTree::NodeId node_id) {
+  return static_cast<int64_t>(tree.inclusive_time(node_id)) -
+         static_cast<int64_t>(baseline_times[node_id]);
+}
+
+// Writes the SVG image of a flame graph.
+// @param baseline_times inclusive times of the nodes in a baseline, for a
+//     differential flame graph, or nullptr.
+// @param is_inline whether the image is embedded in an HTML page.
+bool WriteSvg(const CallTree& tree,
+              const std::vector<base::Timestamp>* baseline_times,
+              const FrameTable& frames,
+              const SvgRendererOptions& options,
+              bool is_inline,
+              std::ostream* out) {
+  DCHECK(baseline_times == nullptr || baseline_times->size() == tree.size());
+
+  std::vector<DrawnFrame> drawn_frames;
+  const size_t max_depth = LayoutFrames(tree, frames, options, &drawn_frames);
+
+  // The colors of a differential flame graph are relative to the largest
+  // difference among the drawn frames.
+  uint64_t max_delta = 0;
+  if (baseline_times != nullptr) {
+    for (const DrawnFrame& frame : drawn_frames) {
+      int64_t delta = GetDelta(tree, *baseline_times, frame.node_id);
+      uint64_t abs_delta = static_cast<uint64_t>(delta < 0 ? -delta : delta);
+      if (abs_delta > max_delta)
+        max_delta = abs_delta;
+    }
+  }
+
+  const double width = static_cast<double>(options.width);
+  const double height = kTopPadding +
+                        static_cast<double>(max_depth + 1) * kFrameHeight +
+                        kBottomPadding;
+  const base::Timestamp total_time = tree.inclusive_time(CallTree::kRootNodeId);
+
+  *out << std::fixed << std::setprecision(2);
+  if (!is_inline)
+    *out << "<?xml version=\"1.0\" standalone=\"no\"?>\n";
+  *out << "<svg version=\"1.1\" width=\"" << width << "\" height=\"" << height
+       << "\" viewBox=\"0 0 " << width << " " << height
+       << "\" xmlns=\"http://www.w3.org/2000/svg\" data-padding=\""
+       << kHorizontalPadding << "\" data-label-padding=\"" << kLabelPadding
+       << "\" data-char-width=\"" << kFontSize * kFontWidth
+       << "\" data-min-label-size=\"" << kMinLabelSize << "\">\n"
+       << "<style>text { font-family: Verdana, sans-serif; font-size: "
+       << kFontSize << "px; } g.frame rect { stroke: white; stroke-width: "
+          "0.5; } g.frame:hover rect { stroke: black; }</style>\n"
+       << "<rect x=\"0\" y=\"0\" width=\"" << width << "\" height=\""
+       << height << "\" fill=\"#f8f8f8\"/>\n"
+       << "<text x=\"" << width / 2 << "\" y=\"" << kTopPadding / 2 + 4
+       << "\" text-anchor=\"middle\" style=\"font-size: 17px\">";
+  WriteEscaped(options.title, out);
+  *out << "</text>\n";
+
+  for (const DrawnFrame& frame : drawn_frames) {
+    const std::string_view name = GetNodeName(tree, frames, frame.node_id);
+    const base::Timestamp time = tree.inclusive_time(frame.node_id);
+    const double y =
+        height - kBottomPadding -
+        static_cast<double>(frame.depth + 1) * kFrameHeight;
+
+    *out << "<g class=\"frame\"><title>";
+    WriteEscaped(name, out);
+    *out << " (" << time << " us, "
+         << (total_time == 0 ? 100.0
+                             : 100.0 * static_cast<double>(time) /
+                                   static_cast<double>(total_time))
+         << "%";
+    int64_t delta = 0;
+    if (baseline_times != nullptr) {
+      delta = GetDelta(tree, *baseline_times, frame.node_id);
+      *out << ", " << (delta > 0 ? "+" : "") << delta << " us";
+    }
+    *out << ")</title><rect x=\"" << frame.x << "\" y=\"" << y
+         << "\" width=\"" << frame.width << "\" height=\"" << kFrameHeight - 1
+         << "\" rx=\"2\" fill=\"";
+    if (baseline_times != nullptr)
+      WriteDiffFrameColor(delta, max_delta, out);
+    else
+      WriteFrameColor(name, out);
+    *out << "\"/><text x=\"" << frame.x + kLabelPadding << "\" y=\""
+         << y + kFrameHeight - 5 << "\">";
+    WriteLabel(name, frame.width, out);
+    *out << "</text></g>\n";
+  }
+
+  *out << "</svg>\n";
+  return out->good();
+}
+
+// Writes a standalone HTML page that embeds the SVG image of a flame graph.
+// Same parameters as WriteSvg().
+bool WriteHtml(const CallTree& tree,
+               const std::vector<base::Timestamp>* baseline_times,
+               const FrameTable& frames,
+               const SvgRendererOptions& options,
+               std::ostream* out) {
+  *out << "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n"
+       << "<title>";
+  WriteEscaped(options.title, out);
+  *out << "</title>\n<style>body { margin: 0; font-family: Verdana, "
+          "sans-serif; } #details { padding: 4px 10px; font-size: 12px; "
+          "white-space: nowrap; overflow: hidden; }</style>\n"
+       << "</head>\n<body>\n<div id=\"details\">&nbsp;</div>\n";
+  if (!WriteSvg(tree, baseline_times, frames, options, true, out))
+    return false;
+  *out << "<script>\n" << kHtmlScript << "</script>\n</body>\n</html>\n";
+  return out->good();
+}
+
+}  // namespace
+
+SvgRendererOptions::SvgRendererOptions()
+    : title("Flame Graph"), width(1200), min_frame_width(0.1) {}
+
+bool WriteSvgFlameGraph(const CallTree& tree,
+                        const FrameTable& frames,
+                        const SvgRendererOptions& options,
+                        std::ostream* out) {
+  return WriteSvg(tree, nullptr, frames, options, false, out);
+}
+
+bool WriteHtmlFlameGraph(const CallTree& tree,
+                         const FrameTable& frames,
+                         const SvgRendererOptions& options,
+                         std::ostream* out) {
+  return WriteHtml(tree, nullptr, frames, options, out);
+}
+
+bool WriteSvgDiffFlameGraph(const CallTree& tree,
+                            const std::vector<base::Timestamp>& baseline_times,
+                            const FrameTable& frames,
+                            const SvgRendererOptions& options,
+                            std::ostream* out) {
+  return WriteSvg(tree, &baseline_times, frames, options, false, out);
+}
+
+bool WriteHtmlDiffFlameGraph(
+    const CallTree& tree,
+    const std::vector<base::Timestamp>& baseline_times,
+    const FrameTable& frames,
+    const SvgRendererOptions& options,
+    std::ostream* out) {
+  return WriteHtml(tree, &baseline_times, frames, options, out);
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,97 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "base/types.h"
+#include "etw_reader/frame_table.h"
+#include "flame_graph/call_tree.h"
+
+namespace etw_insights {
+
+// Options of a flame graph rendered by WriteSvgFlameGraph() or
+// WriteHtmlFlameGraph().
+struct SvgRendererOptions {
+  SvgRendererOptions();
+
+  // Title drawn at the top of the image.
+  std::string title;
+
+  // Width of the image, in pixels.
+  size_t width;
+
+  // Frames narrower than this number of pixels are not drawn, nor the frames
+  // above them. Bounds the size of the output: at most width /
+  // min_frame_width frames are drawn on each level.
+  double min_frame_width;
+};
+
+// Renders a call tree as a flame graph in the SVG format. The bottom of the
+// stacks is at the bottom of the image, the width of a frame is proportional
+// to the inclusive time of its node, and the children of a node are sorted
+// by frame. Each frame has a tooltip with its name and its time.
+// @param tree the call tree. ComputeInclusiveTimes() and ComputeChildren()
+//     must have been called.
+// @param frames the frames of the call tree.
+// @param options rendering options.
+// @param out the stream to which the image is written.
+// @returns true if the image was written, false otherwise.
+bool WriteSvgFlameGraph(const CallTree& tree,
+                        const FrameTable& frames,
+                        const SvgRendererOptions& options,
+                        std::ostream* out);
+
+// Same as WriteSvgFlameGraph(), but the image is embedded in a standalone
+// HTML page, which shows the frame under the mouse and zooms on a frame when
+// it is clicked.
+bool WriteHtmlFlameGraph(const CallTree& tree,
+                         const FrameTable& frames,
+                         const SvgRendererOptions& options,
+                         std::ostream* out);
+
+// Renders a differential flame graph in the SVG format. Frames are laid out
+// like in WriteSvgFlameGraph(), but they are red if more time is spent in
+// them than in a baseline, blue if less time is spent in them, and more
+// saturated as the difference grows. The tooltip of a frame also tells the
+// difference.
+// @param tree the call tree. ComputeInclusiveTimes() and ComputeChildren()
+//     must have been called.
+// @param baseline_times the inclusive time of each node of |tree| in the
+//     baseline.
+// @param frames the frames of the call tree.
+// @param options rendering options.
+// @param out the stream to which the image is written.
+// @returns true if the image was written, false otherwise.
+bool WriteSvgDiffFlameGraph(const CallTree& tree,
+                            const std::vector<base::Timestamp>& baseline_times,
+                            const FrameTable& frames,
+                            const SvgRendererOptions& options,
+                            std::ostream* out);
+
+// Same as WriteSvgDiffFlameGraph(), but the image is embedded in a standalone
+// HTML page, like in WriteHtmlFlameGraph().
+bool WriteHtmlDiffFlameGraph(
+    const CallTree& tree,
+    const std::vector<base::Timestamp>& baseline_times,
+    const FrameTable& frames,
+    const SvgRendererOptions& options,
+    std::ostream* out);
+
+}  // namespace etw_insights
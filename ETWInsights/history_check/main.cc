@@ -0,0 +1,422 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Checks that the variants of base::History, the lookups of many timestamps
+// at once and the merged iteration of several histories give the same results
+// as the lookups and iterations of base::History on synthetic histories.
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "base/command_line.h"
+#include "base/compact_history.h"
+#include "base/history.h"
+#include "base/merged_history_iterator.h"
+#include "base/numeric_conversions.h"
+#include "base/types.h"
+
+namespace {
+
+// Default number of elements inserted in each history.
+const uint64_t kDefaultNumElements = 100000;
+
+// Number of elements compared after the element at which an iteration starts.
+const size_t kNumIteratedElements = 3;
+
+// One in this number of the sorted queries is looked up in the sparse batch
+// of GetValues(), so that consecutive timestamps are far apart.
+const size_t kSparseQueryInterval = 37;
+
+// Ids of the histories merged by MergedHistoryIterator, in the order in which
+// they are added to the iteration.
+const uint64_t kMergedHistoryIds[] = {5, 1, 3, 0};
+
+// A value inserted in a history at a timestamp.
+struct Insertion {
+  base::Timestamp ts;
+  uint32_t value;
+};
+
+// An element visited by MergedHistoryIterator.
+struct MergedElement {
+  uint64_t id;
+  base::Timestamp start_ts;
+  base::Timestamp end_ts;
+  uint32_t value;
+};
+
+void ShowUsage() {
+  std::cout << "Usage: history_check.exe [options]" << std::endl
+            << std::endl
+            << "Options:" << std::endl
+            << "  --elements: Number of elements inserted in each history. "
+               "Default: "
+            << kDefaultNumElements << std::endl;
+}
+
+// Generates insertions with timestamps that are sometimes equal to the
+// previous one, and otherwise spaced by deltas of 1 to 6 bytes once varint
+// encoded, and with values that often repeat the previous one.
+std::vector<Insertion> GenerateInsertions(size_t num_insertions,
+                                          uint32_t seed) {
+  std::mt19937 generator(seed);
+  std::uniform_int_distribution<int> percent(0, 99);
+  std::uniform_int_distribution<uint32_t> value(0, 7);
+  std::uniform_int_distribution<base::Timestamp> small_delta(1, 127);
+  std::uniform_int_distribution<base::Timestamp> medium_delta(128, 1 << 14);
+  std::uniform_int_distribution<base::Timestamp> large_delta(
+      1 << 14, static_cast<base::Timestamp>(1) << 40);
+
+  std::vector<Insertion> insertions;
+  base::Timestamp ts = percent(generator);
+  for (size_t i = 0; i < num_insertions; ++i) {
+    // The other insertions repeat the timestamp of the previous one, and are
+    // rejected.
+    int choice = percent(generator);
+    if (choice >= 95)
+      ts += large_delta(generator);
+    else if (choice >= 70)
+      ts += medium_delta(generator);
+    else if (choice >= 5)
+      ts += small_delta(generator);
+    insertions.push_back({ts, value(generator)});
+  }
+  return insertions;
+}
+
+// @returns timestamps at which histories built from |insertions| are queried:
+//     before, at and after the timestamp of each insertion.
+std::vector<base::Timestamp> GenerateQueries(
+    const std::vector<Insertion>& insertions) {
+  std::vector<base::Timestamp> queries;
+  queries.push_back(0);
+  for (const Insertion& insertion : insertions) {
+    if (insertion.ts != 0)
+      queries.push_back(insertion.ts - 1);
+    queries.push_back(insertion.ts);
+    queries.push_back(insertion.ts + 1);
+  }
+  queries.push_back(base::kInvalidTimestamp);
+  return queries;
+}
+
+// Compares the elements of two histories produced by two iterators, up to
+// |max_elements| or to the end of the histories.
+// @returns true if the elements are the same.
+template <typename ExpectedHistory, typename History>
+bool ElementsAreEqual(const ExpectedHistory& expected_history,
+                      typename ExpectedHistory::HistoryConstIterator expected_it,
+                      const History& history,
+                      typename History::HistoryConstIterator it,
+                      size_t max_elements) {
+  const auto expected_end = expected_history.IteratorEnd();
+  const auto end = history.IteratorEnd();
+  for (size_t i = 0; i < max_elements; ++i, ++expected_it, ++it) {
+    if ((expected_it == expected_end) != (it == end))
+      return false;
+    if (expected_it == expected_end)
+      return true;
+    if (expected_it->start_ts != it->start_ts ||
+        expected_it->value != it->value) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Checks that a CompactHistory gives the same results as a History built from
+// the same insertions.
+// @returns true if the results are the same.
+template <size_t kBlockSize>
+bool CheckCompactHistory(const std::vector<Insertion>& insertions,
+                         const std::vector<base::Timestamp>& queries) {
+  const std::string description =
+      "in a CompactHistory with blocks of " + std::to_string(kBlockSize);
+
+  base::History<uint32_t> expected_history;
+  base::CompactHistory<uint32_t, kBlockSize> history;
+  for (const Insertion& insertion : insertions) {
+    if (expected_history.Insert(insertion.ts, insertion.value) !=
+        history.Insert(insertion.ts, insertion.value)) {
+      std::cout << "Insertion at ts=" << insertion.ts << " differs "
+                << description << "." << std::endl;
+      return false;
+    }
+  }
+
+  uint32_t expected_last_value = 0;
+  uint32_t last_value = 0;
+  base::Timestamp expected_last_ts = 0;
+  base::Timestamp last_ts = 0;
+  if (expected_history.size() != history.size() ||
+      expected_history.GetLastElementValue(&expected_last_value) !=
+          history.GetLastElementValue(&last_value) ||
+      expected_last_value != last_value ||
+      expected_history.GetLastElementTimestamp(&expected_last_ts) !=
+          history.GetLastElementTimestamp(&last_ts) ||
+      expected_last_ts != last_ts) {
+    std::cout << "The size or the last element differs " << description << "."
+              << std::endl;
+    return false;
+  }
+
+  if (!ElementsAreEqual(expected_history, expected_history.IteratorBegin(),
+                        history, history.IteratorBegin(), history.size() + 1)) {
+    std::cout << "The elements differ " << description << "." << std::endl;
+    return false;
+  }
+
+  // The const History gives const iterators, like CompactHistory.
+  const base::History<uint32_t>& const_expected_history = expected_history;
+  for (base::Timestamp ts : queries) {
+    const uint32_t* expected_value = nullptr;
+    const uint32_t* value = nullptr;
+    bool expected_found = expected_history.GetValue(ts, &expected_value);
+    if (expected_found != history.GetValue(ts, &value) ||
+        (expected_found && *expected_value != *value)) {
+      std::cout << "GetValue(" << ts << ") differs " << description << "."
+                << std::endl;
+      return false;
+    }
+
+    if (!ElementsAreEqual(expected_history,
+                          const_expected_history.IteratorFromTimestamp(ts),
+                          history, history.IteratorFromTimestamp(ts),
+                          kNumIteratedElements)) {
+      std::cout << "IteratorFromTimestamp(" << ts << ") differs "
+                << description << "." << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Checks that the values of sorted timestamps looked up at once by
+// GetValues() are the values looked up one at a time by GetValue().
+// @param history the history in which the values are looked up.
+// @param timestamps timestamps sorted in increasing order.
+// @param description the history, for the error message.
+// @returns true if the values are the same.
+bool CheckGetValues(const base::History<uint32_t>& history,
+                    const std::vector<base::Timestamp>& timestamps,
+                    const std::string& description) {
+  std::vector<const uint32_t*> values;
+  history.GetValues(timestamps, &values);
+  if (values.size() != timestamps.size()) {
+    std::cout << "GetValues() returned " << values.size() << " values for "
+              << timestamps.size() << " timestamps " << description << "."
+              << std::endl;
+    return false;
+  }
+  for (size_t i = 0; i < timestamps.size(); ++i) {
+    const uint32_t* expected_value = nullptr;
+    history.GetValue(timestamps[i], &expected_value);
+    if (values[i] != expected_value) {
+      std::cout << "GetValues() differs from GetValue(" << timestamps[i]
+                << ") " << description << "." << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Checks that a History with a search index gives the same results as a
+// History without one, and that GetValues() gives the same results as
+// GetValue() in both.
+// @returns true if the results are the same.
+bool CheckHistoryLookups(const std::vector<Insertion>& insertions,
+                         const std::vector<base::Timestamp>& queries) {
+  base::History<uint32_t> expected_history;
+  base::History<uint32_t> indexed_history;
+  for (const Insertion& insertion : insertions) {
+    expected_history.Insert(insertion.ts, insertion.value);
+    indexed_history.Insert(insertion.ts, insertion.value);
+  }
+  indexed_history.BuildSearchIndex();
+
+  const base::History<uint32_t>& const_expected_history = expected_history;
+  const base::History<uint32_t>& const_indexed_history = indexed_history;
+  for (base::Timestamp ts : queries) {
+    const uint32_t* expected_value = nullptr;
+    const uint32_t* value = nullptr;
+    bool expected_found = expected_history.GetValue(ts, &expected_value);
+    if (expected_found != indexed_history.GetValue(ts, &value) ||
+        (expected_found && *expected_value != *value)) {
+      std::cout << "GetValue(" << ts << ") differs in a History with a search "
+                << "index." << std::endl;
+      return false;
+    }
+
+    if (!ElementsAreEqual(expected_history,
+                          const_expected_history.IteratorFromTimestamp(ts),
+                          indexed_history,
+                          const_indexed_history.IteratorFromTimestamp(ts),
+                          kNumIteratedElements)) {
+      std::cout << "IteratorFromTimestamp(" << ts << ") differs in a History "
+                << "with a search index." << std::endl;
+      return false;
+    }
+  }
+
+  std::vector<base::Timestamp> sorted_queries = queries;
+  std::sort(sorted_queries.begin(), sorted_queries.end());
+  std::vector<base::Timestamp> sparse_queries;
+  for (size_t i = 0; i < sorted_queries.size(); i += kSparseQueryInterval)
+    sparse_queries.push_back(sorted_queries[i]);
+
+  return CheckGetValues(expected_history, sorted_queries, "in a History") &&
+         CheckGetValues(expected_history, sparse_queries,
+                        "for sparse timestamps in a History") &&
+         CheckGetValues(indexed_history, sorted_queries,
+                        "in a History with a search index") &&
+         CheckGetValues(indexed_history, sparse_queries,
+                        "for sparse timestamps in a History with a search "
+                        "index");
+}
+
+// Checks that MergedHistoryIterator visits the elements of histories that
+// share start timestamps by increasing start timestamp, then by increasing id,
+// with the end timestamp of each history after its last element.
+// @param insertions the elements are inserted in some of the histories, with
+//     other values.
+// @param seed seed of the choice of the histories.
+// @returns true if the elements are visited in that order.
+bool CheckMergedHistoryIterator(const std::vector<Insertion>& insertions,
+                                uint32_t seed) {
+  const size_t kNumHistories = std::size(kMergedHistoryIds);
+  std::mt19937 generator(seed);
+  std::uniform_int_distribution<int> coin(0, 1);
+  std::uniform_int_distribution<uint32_t> value(0, 3);
+
+  std::vector<base::History<uint32_t>> histories(kNumHistories);
+  std::vector<base::Timestamp> end_timestamps(kNumHistories, 0);
+  for (const Insertion& insertion : insertions) {
+    for (size_t i = 0; i < kNumHistories; ++i) {
+      if (coin(generator) == 0)
+        continue;
+      histories[i].Insert(insertion.ts, value(generator));
+      end_timestamps[i] = insertion.ts + 1 + i;
+    }
+  }
+
+  // The iteration starts before the first element, in the middle of the
+  // histories and after the last element.
+  std::vector<base::Timestamp> start_timestamps;
+  start_timestamps.push_back(0);
+  for (size_t i = 1; i < 4 && !insertions.empty(); ++i)
+    start_timestamps.push_back(insertions[insertions.size() * i / 4].ts);
+  if (!insertions.empty())
+    start_timestamps.push_back(insertions.back().ts);
+  start_timestamps.push_back(base::kInvalidTimestamp);
+
+  for (base::Timestamp start_ts : start_timestamps) {
+    base::MergedHistoryIterator<uint32_t> it;
+    std::vector<MergedElement> expected_elements;
+    for (size_t i = 0; i < kNumHistories; ++i) {
+      const base::History<uint32_t>& history = histories[i];
+      it.AddHistory(kMergedHistoryIds[i], &history, end_timestamps[i],
+                    start_ts);
+      for (auto history_it = history.IteratorFromTimestamp(start_ts);
+           history_it != history.IteratorEnd(); ++history_it) {
+        auto next_it = history_it + 1;
+        expected_elements.push_back(
+            {kMergedHistoryIds[i], history_it->start_ts,
+             next_it == history.IteratorEnd() ? end_timestamps[i]
+                                              : next_it->start_ts,
+             history_it->value});
+      }
+    }
+    std::sort(expected_elements.begin(), expected_elements.end(),
+              [](const MergedElement& a, const MergedElement& b) {
+                if (a.start_ts != b.start_ts)
+                  return a.start_ts < b.start_ts;
+                return a.id < b.id;
+              });
+
+    for (const MergedElement& expected_element : expected_elements) {
+      if (it.Done() || it.id() != expected_element.id ||
+          it.start_ts() != expected_element.start_ts ||
+          it.end_ts() != expected_element.end_ts ||
+          it.value() != expected_element.value) {
+        std::cout << "The merged iteration from ts=" << start_ts
+                  << " differs at the element of history "
+                  << expected_element.id
+                  << " at ts=" << expected_element.start_ts << "."
+                  << std::endl;
+        return false;
+      }
+      it.Next();
+    }
+    if (!it.Done()) {
+      std::cout << "The merged iteration from ts=" << start_ts
+                << " visits too many elements." << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int wmain(int argc, wchar_t* argv[], wchar_t* /*envp */ []) {
+  base::CommandLine command_line(argc, argv);
+
+  if (command_line.HasSwitch(L"help")) {
+    ShowUsage();
+    return 1;
+  }
+
+  uint64_t num_elements = kDefaultNumElements;
+  if (command_line.HasSwitch(L"elements") &&
+      !base::StrToULong(command_line.GetSwitchValue(L"elements"),
+                        &num_elements)) {
+    ShowUsage();
+    return 1;
+  }
+
+  // Histories of all sizes up to a few blocks, then a large history.
+  std::vector<std::vector<Insertion>> histories;
+  for (size_t size = 0; size <= 300; ++size)
+    histories.push_back(GenerateInsertions(size, static_cast<uint32_t>(size)));
+  histories.push_back(
+      GenerateInsertions(static_cast<size_t>(num_elements), 42));
+
+  bool equal = true;
+  for (size_t i = 0; i < histories.size(); ++i) {
+    const std::vector<Insertion>& insertions = histories[i];
+    std::vector<base::Timestamp> queries = GenerateQueries(insertions);
+    if (!CheckHistoryLookups(insertions, queries) ||
+        !CheckMergedHistoryIterator(insertions, static_cast<uint32_t>(i)) ||
+        !CheckCompactHistory<128>(insertions, queries) ||
+        !CheckCompactHistory<3>(insertions, queries) ||
+        !CheckCompactHistory<1>(insertions, queries)) {
+      equal = false;
+      break;
+    }
+  }
+  if (!equal) {
+    std::cout << "A variant of History differs from History." << std::endl;
+    return 1;
+  }
+
+  std::cout << "The variants of History give the same results as History."
+            << std::endl;
+  return 0;
+}
@@ -0,0 +1,343 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Checks that the system history built on a pool of threads is the same as
+// the system history built on the calling thread, on a synthetic stream of
+// events, and that the history mapped from its snapshot is the same too.
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "base/command_line.h"
+#include "base/file.h"
+#include "base/numeric_conversions.h"
+#include "base/string_utils.h"
+#include "base/thread_pool.h"
+#include "etw_reader/event_schema.h"
+#include "etw_reader/generate_history_from_trace.h"
+#include "etw_reader/system_history.h"
+#include "etw_reader/system_history_snapshot.h"
+#include "etw_reader/trace_event.h"
+
+using namespace etw_insights;
+
+namespace {
+
+// Default number of synthetic events.
+const uint64_t kDefaultNumEvents = 200000;
+
+// Default number of threads that build the parallel history.
+const uint64_t kDefaultNumThreads = 4;
+
+// Default path of the trace next to which the snapshot of the history is
+// written. The trace is an empty file, created and removed by the check.
+const wchar_t kDefaultTracePath[] = L"system_history_check.etl";
+
+// Number of threads and processes of the synthetic trace.
+const base::Tid kNumTraceThreads = 37;
+const base::Pid kNumTraceProcesses = 5;
+
+// Frames of the synthetic stacks.
+const char* const kFrames[] = {
+    "ntdll.dll!RtlUserThreadStart", "kernel32.dll!BaseThreadInitThunk",
+    "chrome.dll!MessageLoop::Run",  "chrome.dll!RunTask",
+    "chrome.dll!Paint",             "chrome.dll!Layout",
+    "ntdll.dll!NtWaitForSingleObject",
+};
+
+const size_t kNumFrames = sizeof(kFrames) / sizeof(kFrames[0]);
+
+void ShowUsage() {
+  std::cout << "Usage: system_history_check.exe [options]" << std::endl
+            << std::endl
+            << "Options:" << std::endl
+            << "  --events: Number of synthetic events. Default: "
+            << kDefaultNumEvents << std::endl
+            << "  --threads: Number of threads that build the parallel "
+               "history. Default: "
+            << kDefaultNumThreads << std::endl
+            << "  --trace: Empty trace created to write the snapshot of the "
+               "history next to it. Default: "
+            << base::WStringToString(kDefaultTracePath) << std::endl;
+}
+
+// Generates events that look like the decoded events of a trace: sampled
+// profiles and context switches followed by their stacks, file operations,
+// and the starts and ends of processes and threads.
+std::vector<TraceEvent> GenerateEvents(const EventSchema& schema,
+                                       uint64_t num_events) {
+  EventTypeId sampled_profile_type_id = schema.GetTypeId("SampledProfile");
+  EventTypeId cswitch_type_id = schema.GetTypeId("CSwitch");
+  EventTypeId stack_type_id = schema.GetTypeId("Stack");
+
+  std::mt19937 generator(42);
+  std::uniform_int_distribution<base::Tid> thread(1, kNumTraceThreads);
+  std::uniform_int_distribution<size_t> frame(0, kNumFrames - 1);
+  std::uniform_int_distribution<int> percent(0, 99);
+
+  std::vector<TraceEvent> events;
+  base::Timestamp ts = 1000;
+
+  for (base::Pid pid = 1; pid <= kNumTraceProcesses; ++pid) {
+    TraceEvent event;
+    event.kind = kProcessStartEventKind;
+    event.ts = ts;
+    event.pid = pid;
+    event.text = "process" + std::to_string(pid) + ".exe";
+    events.push_back(event);
+  }
+  for (base::Tid tid = 1; tid <= kNumTraceThreads; ++tid) {
+    TraceEvent event;
+    event.kind = kThreadStartEventKind;
+    event.ts = ts;
+    event.tid = tid;
+    event.pid = tid % kNumTraceProcesses + 1;
+    events.push_back(event);
+  }
+
+  while (events.size() < num_events) {
+    ts += 1 + percent(generator);
+    base::Tid tid = thread(generator);
+    int choice = percent(generator);
+
+    TraceEvent event;
+    event.ts = ts;
+    event.tid = tid;
+    if (choice < 10) {
+      // A file operation starts or ends on the thread.
+      event.kind = choice < 5 ? kFileIoEventKind : kFileIoOpEndEventKind;
+      event.logging_tid = tid;
+      if (event.kind == kFileIoEventKind)
+        event.text = "file" + std::to_string(choice) + ".txt";
+      events.push_back(event);
+      continue;
+    }
+
+    if (choice < 50) {
+      // The thread is switched in.
+      event.kind = kCSwitchEventKind;
+      event.type_id = cswitch_type_id;
+      event.new_tid = tid;
+      event.old_tid = thread(generator);
+      event.time_since_last = percent(generator) * 10;
+    } else {
+      event.type_id = sampled_profile_type_id;
+    }
+    events.push_back(event);
+
+    // The stack of the event, sometimes split in two Stack events.
+    int num_stacks = percent(generator) < 10 ? 2 : 1;
+    for (int i = 0; i < num_stacks; ++i) {
+      TraceEvent stack_event;
+      stack_event.kind = kStackEventKind;
+      stack_event.type_id = stack_type_id;
+      stack_event.ts = ts;
+      stack_event.tid = tid;
+      size_t depth = 1 + frame(generator);
+      for (size_t j = 0; j < depth; ++j)
+        stack_event.stack.push_back(kFrames[frame(generator)]);
+      events.push_back(stack_event);
+    }
+  }
+
+  for (base::Tid tid = 1; tid <= kNumTraceThreads; ++tid) {
+    TraceEvent event;
+    event.kind = kThreadEndEventKind;
+    event.ts = ts;
+    event.tid = tid;
+    events.push_back(event);
+  }
+
+  return events;
+}
+
+// Builds a system history from events.
+// @param thread_pool threads that build the history, or nullptr.
+void BuildHistory(const EventSchema& schema,
+                  const std::vector<TraceEvent>& events,
+                  base::ThreadPool* thread_pool,
+                  SystemHistory* system_history) {
+  std::unique_ptr<TraceAnalyzer> analyzer(CreateSystemHistoryAnalyzer(
+      Subscription(), thread_pool, system_history));
+  analyzer->OnBeginTrace(schema);
+  for (const auto& event : events) {
+    if (!analyzer->OnEvent(event))
+      break;
+  }
+  analyzer->OnEndTrace();
+}
+
+// @returns true if two thread histories have the same stacks at the same
+//     times. Stacks are compared by frames, since stack ids differ.
+bool StacksAreEqual(const ThreadHistory::StackHistory& expected_stacks,
+                    const StackTrie& expected_trie,
+                    const ThreadHistory::StackHistory& stacks,
+                    const StackTrie& trie) {
+  if (expected_stacks.size() != stacks.size())
+    return false;
+  auto expected_it = expected_stacks.IteratorFromTimestamp(0);
+  auto it = stacks.IteratorFromTimestamp(0);
+  for (; expected_it != expected_stacks.IteratorEnd(); ++expected_it, ++it) {
+    if (expected_it->start_ts != it->start_ts ||
+        expected_trie.GetStack(expected_it->value) !=
+            trie.GetStack(it->value)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Compares two system histories.
+// @returns true if they are the same, except for the ids of their stacks.
+bool HistoriesAreEqual(const SystemHistory& expected_history,
+                       const SystemHistory& history) {
+  bool equal = true;
+
+  if (expected_history.first_event_ts() != history.first_event_ts() ||
+      expected_history.last_event_ts() != history.last_event_ts() ||
+      expected_history.first_non_empty_paint_ts() !=
+          history.first_non_empty_paint_ts()) {
+    std::cout << "The bounds of the histories differ." << std::endl;
+    equal = false;
+  }
+
+  for (auto it = expected_history.processes_begin();
+       it != expected_history.processes_end(); ++it) {
+    if (history.GetProcessName(it->first) != it->second) {
+      std::cout << "Process " << it->first << " differs." << std::endl;
+      equal = false;
+    }
+  }
+  if (std::distance(expected_history.processes_begin(),
+                    expected_history.processes_end()) !=
+      std::distance(history.processes_begin(), history.processes_end())) {
+    std::cout << "The number of processes differs." << std::endl;
+    equal = false;
+  }
+
+  for (auto expected_it = expected_history.threads_begin();
+       expected_it != expected_history.threads_end(); ++expected_it) {
+    const ThreadHistory& expected_thread = expected_it->second;
+    auto it = history.threads_begin();
+    while (it != history.threads_end() && it->first != expected_it->first)
+      ++it;
+    if (it == history.threads_end() ||
+        it->second.start_ts() != expected_thread.start_ts() ||
+        it->second.end_ts() != expected_thread.end_ts() ||
+        it->second.parent_process_id() !=
+            expected_thread.parent_process_id() ||
+        !StacksAreEqual(expected_thread.Stacks(),
+                        expected_history.stack_trie(), it->second.Stacks(),
+                        history.stack_trie())) {
+      std::cout << "Thread " << expected_it->first << " differs." << std::endl;
+      equal = false;
+    }
+  }
+  if (std::distance(expected_history.threads_begin(),
+                    expected_history.threads_end()) !=
+      std::distance(history.threads_begin(), history.threads_end())) {
+    std::cout << "The number of threads differs." << std::endl;
+    equal = false;
+  }
+
+  return equal;
+}
+
+// Writes the snapshot of a system history, maps it and compares the mapped
+// history to the history. The trace and the snapshot are removed afterwards.
+// @param system_history the history.
+// @param trace_path path of an empty trace, created to write the snapshot
+//     next to it.
+// @returns true if the mapped history is the same as the history.
+bool CheckSnapshot(const SystemHistory& system_history,
+                   const std::wstring& trace_path) {
+  bool equal = false;
+  std::ofstream(trace_path, std::ios::out | std::ios::binary);
+  if (!WriteSystemHistorySnapshot(system_history, trace_path)) {
+    std::cout << "Unable to write the snapshot." << std::endl;
+  } else {
+    SystemHistory snapshot_history;
+    if (!OpenSystemHistorySnapshot(trace_path, &snapshot_history))
+      std::cout << "Unable to open the snapshot." << std::endl;
+    else
+      equal = HistoriesAreEqual(system_history, snapshot_history);
+  }
+  base::RemoveFile(SnapshotPathForTrace(trace_path));
+  base::RemoveFile(trace_path);
+  return equal;
+}
+
+}  // namespace
+
+int wmain(int argc, wchar_t* argv[], wchar_t* /*envp */ []) {
+  base::CommandLine command_line(argc, argv);
+
+  if (command_line.HasSwitch(L"help")) {
+    ShowUsage();
+    return 1;
+  }
+
+  uint64_t num_events = kDefaultNumEvents;
+  uint64_t num_threads = kDefaultNumThreads;
+  if ((command_line.HasSwitch(L"events") &&
+       !base::StrToULong(command_line.GetSwitchValue(L"events"),
+                         &num_events)) ||
+      (command_line.HasSwitch(L"threads") &&
+       (!base::StrToULong(command_line.GetSwitchValue(L"threads"),
+                          &num_threads) ||
+        num_threads == 0))) {
+    ShowUsage();
+    return 1;
+  }
+
+  EventSchema schema;
+  schema.AddType("SampledProfile", {"TimeStamp", "ThreadID"});
+  schema.AddType("CSwitch", {"TimeStamp", "New TID", "Old TID"});
+  schema.AddType("Stack", {"TimeStamp", "ThreadID", "Image!Function"});
+  std::vector<TraceEvent> events(GenerateEvents(schema, num_events));
+
+  SystemHistory expected_history;
+  BuildHistory(schema, events, nullptr, &expected_history);
+
+  SystemHistory history;
+  base::ThreadPool thread_pool(static_cast<size_t>(num_threads));
+  BuildHistory(schema, events, &thread_pool, &history);
+
+  if (!HistoriesAreEqual(expected_history, history)) {
+    std::cout << "The parallel history differs from the serial history."
+              << std::endl;
+    return 1;
+  }
+
+  std::wstring trace_path = command_line.GetSwitchValue(L"trace");
+  if (trace_path.empty())
+    trace_path = kDefaultTracePath;
+  if (!CheckSnapshot(expected_history, trace_path)) {
+    std::cout << "The history mapped from the snapshot differs from the "
+                 "history."
+              << std::endl;
+    return 1;
+  }
+
+  std::cout << "The histories of " << events.size()
+            << " events are the same." << std::endl;
+  return 0;
+}